@@ -29,6 +29,32 @@
  - another page of network information
  - reuse existing httpd server to save 10kb ram
  - drop 1-second updates and just print entire graph
+ Ver 8.0
+ - sample rate can be changed at runtime with /config, short high rate captures with /burst
+ - largest free block on the memory graph, triggers freeze the history into /capture
+ - optional history in a flash partition (or a file) that survives a reboot, see /history, ring tested on linux in tools/
+ - last 16 samples kept in no-init memory, so /lastboot shows the final state before a crash
+ - optional binary udp export to a collector, receiver in tools/
+ - sampler runs on a fixed schedule, memory sampled with the cpu, timestamps and sampler cost in /data
+ - sample count, task slots and sample storage type are #defines, each feature can be compiled out
+ - unpinned tasks are split between core 0 and core 1 by a tick hook on each core, stacked per-core view
+ - /data?top=&min=&window=&tasks=&points= picks the tasks and decimates the history, used by the graph
+ - min, max, mean, std and p95 per task over the window and since boot, in /dataInfo and the task table
+ - heap leak trend with time to exhaustion, and per task cpu anomalies, in /dataInfo and the serial line
+ - markers on the graph with before/after cpu, and optional POST /control for priority, suspend and resume
+ - core balance: per core load over the window, which tasks to move where, and taskman_balance_apply()
+ - task state history, starved tasks and priority boosts (mutex inheritance) in /dataInfo
+ - taskman_watch_queue() / taskman_watch_mutex(): queue depth and mutex wait series on the graph, taskman_mutex_take()
+ - taskman_counter_add() / taskman_gauge_set(): your own counters and gauges, per core atomic, charted with the cpu
+ - TASKMAN_SCOPE("name") times a block with the cycle counter, regions table and series on the dashboard, benchmarked on linux in tools/
+ - /profile pc sampling from a timer interrupt on each core, tools/taskman_profile.cpp symbolizes it, table tested on linux
+ - TASKMAN_ISR_SCOPE(src) and taskman_timer_create(): interrupt and esp_timer callback time, taken off the interrupted task
+ - workloads with a known cpu (fixed duty, mutex pair, queue, alloc churn, http) and /scenario, expected vs measured
+ - run time deltas relative to the sample length, recreated tasks and stale cross-core reads handled, tested on linux in tools/
+ - built-in canvas graphs, no Chart.js download, and /data?since= so the page fetches only the new samples
+ - wall clock (SNTP) time of every sample, and /export.csv streams the whole history a row per sample
+ - adaptive sampling: fast while usage or heap is changing, back to a slow base, slower still with no viewers
+ - every sample keeps the ms it covers, and averages over samples (window stats, state mix, queue %) weight by it
  
 More info:
 
@@ -42,6 +68,7 @@ Your own code needs wifi, and these lines:
 #include "taskman.h"       //  <--- the important bit
 #define PROGRAM_NAME "your program" 
 #define SAMPLE_RATE_HZ 1    // default is 1, or 2,4,8 for samples per second
+                            // or change it later with taskman_set_sample_interval(ms) or /config?interval=ms
 
 void setup(){
   taskman_setup();         //  <--- the important bit
@@ -58,6 +85,7 @@ void setup(){
   
   // Option 2 - taskman on port 80 along with all your own endpoints
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.max_uri_handlers = TASKMAN_URI_HANDLERS + 8;  // taskman's endpoints and 8 of your own
   httpd_handle_t mainServer = NULL; 
   httpd_start(&mainServer, &config);
   taskman_server_setup(mainServer);  <--- the important bit
@@ -69,6 +97,8 @@ void setup(){
 #include <Arduino.h>
 #include <WiFi.h>
 #include "esp_http_server.h"
+#include "esp_timer.h"
+#include "taskman_runtime.h"
 
 #ifndef PROGRAM_NAME
 #define PROGRAM_NAME "replace with your name"
@@ -80,19 +110,353 @@ void setup(){
 #endif
 
 #define SAMPLE_INTERVAL (1000 / SAMPLE_RATE_HZ)
-#define SAMPLE_COUNT 100
+
+// ─── Build configuration ─────────────────────────────────
+// Everything below can be set before the #include "taskman.h".  The footprint table in
+// the README shows what each choice costs - the small ESP32-C3 builds want them off.
+
+#ifndef SAMPLE_COUNT
+#define SAMPLE_COUNT 100       // samples kept per series
+#endif
+#ifndef TASKMAN_MAX_TASKS
+#define TASKMAN_MAX_TASKS 25   // task slots
+#endif
+// how cpu % is stored: float (4 bytes), uint16_t (tenths of a percent) or uint8_t (half percent)
+#ifndef TASKMAN_SAMPLE_TYPE
+#define TASKMAN_SAMPLE_TYPE float
+#endif
+
+#ifndef TASKMAN_DASHBOARD
+#define TASKMAN_DASHBOARD 1      // /taskman graph page
+#endif
+#ifndef TASKMAN_NETWORK_PAGE
+#define TASKMAN_NETWORK_PAGE 1   // /network page
+#endif
+#ifndef TASKMAN_SESSIONS
+#define TASKMAN_SESSIONS 1       // endpoint stats and active sessions, wraps every taskman handler
+#endif
+#ifndef TASKMAN_FAKE_LOAD
+#define TASKMAN_FAKE_LOAD 1      // demo load, workloads with a known cpu and /scenario
+#endif
+#ifndef TASKMAN_MONITOR_STATS
+#define TASKMAN_MONITOR_STATS 1  // what the sampler itself costs, in /data
+#endif
+#ifndef TASKMAN_BURST
+#define TASKMAN_BURST 1          // /burst
+#endif
+#ifndef TASKMAN_TRIGGERS
+#define TASKMAN_TRIGGERS 1       // /trigger and /capture
+#endif
+#ifndef TASKMAN_LASTGASP
+#define TASKMAN_LASTGASP 1       // /lastboot
+#endif
+#ifndef TASKMAN_CORE_SPLIT
+#define TASKMAN_CORE_SPLIT 1     // which core unpinned tasks ran on, from a tick hook on each core
+#endif
+#ifndef TASKMAN_TASK_STATS
+#define TASKMAN_TASK_STATS 1     // min/max/mean/std/p95 per task in /dataInfo
+#endif
+#ifndef TASKMAN_STATE_HISTORY
+#define TASKMAN_STATE_HISTORY 1  // task state of every sample, starvation and priority boosts in /dataInfo
+#endif
+#ifndef TASKMAN_IPC
+#define TASKMAN_IPC 1            // taskman_watch_queue() and taskman_watch_mutex() series
+#endif
+#ifndef TASKMAN_METRICS
+#define TASKMAN_METRICS 1        // taskman_counter_add() and taskman_gauge_set() series
+#endif
+#ifndef TASKMAN_REGIONS
+#define TASKMAN_REGIONS 1        // TASKMAN_SCOPE("name") code region timing
+#endif
+#ifndef TASKMAN_PROFILER
+#define TASKMAN_PROFILER 1       // /profile pc sampling, off until started
+#endif
+#ifndef TASKMAN_ISR_STATS
+#define TASKMAN_ISR_STATS 1      // TASKMAN_ISR_SCOPE and taskman_timer_create() time, taken off the tasks
+#endif
+#ifndef TASKMAN_WALL_CLOCK
+#define TASKMAN_WALL_CLOCK 1     // epoch ms of every sample once SNTP has set the clock
+#endif
+#ifndef TASKMAN_CSV_EXPORT
+#define TASKMAN_CSV_EXPORT 1     // /export.csv
+#endif
+#ifndef TASKMAN_ADAPTIVE
+#define TASKMAN_ADAPTIVE 1       // taskman_set_adaptive() and /config?adaptive=1, off until started
+#endif
+
+// starvation - Ready for this many samples in a row without getting any cpu
+#ifndef STARVE_PERIODS
+#define STARVE_PERIODS 5
+#endif
+#ifndef STARVE_PCT
+#define STARVE_PCT 0.1f  // "any cpu"
+#endif
+
+// queues and mutexes that can be watched
+#ifndef MAX_WATCHED
+#define MAX_WATCHED 8
+#endif
+
+// your own counters and gauges
+#ifndef MAX_METRICS
+#define MAX_METRICS 8
+#endif
+
+// TASKMAN_SCOPE regions
+#ifndef MAX_REGIONS
+#define MAX_REGIONS 8
+#endif
+
+// interrupt sources and esp_timer callbacks that are timed
+#ifndef MAX_ISR_SOURCES
+#define MAX_ISR_SOURCES 8
+#endif
+
+// workloads one scenario can run, see /scenario
+#ifndef MAX_WORKLOADS
+#define MAX_WORKLOADS 8
+#endif
+
+// adaptive sampling - what counts as a change, and how long it stays fast after one
+#ifndef ADAPTIVE_CPU_STEP
+#define ADAPTIVE_CPU_STEP 10.0f   // % a task moved from one sample to the next
+#endif
+#ifndef ADAPTIVE_HEAP_STEP_KB
+#define ADAPTIVE_HEAP_STEP_KB 16  // KB free ram moved
+#endif
+#ifndef ADAPTIVE_HOLD
+#define ADAPTIVE_HOLD 10          // quiet samples before it starts slowing down
+#endif
+#ifndef ADAPTIVE_VIEWER_MS
+#define ADAPTIVE_VIEWER_MS 30000  // no /data or /dataInfo for this long is nobody watching
+#endif
+
+// pc sampling profiler, allocated when it is first started
+#ifndef PROFILE_HZ
+#define PROFILE_HZ 997      // not a multiple of the 1000Hz tick, so it doesn't lock step with it
+#endif
+#ifndef PROFILE_RING
+#define PROFILE_RING 256    // samples per core between two drains
+#endif
+#ifndef PROFILE_SLOTS
+#define PROFILE_SLOTS 512   // distinct pc, task and core
+#endif
+#if TASKMAN_PROFILER && !(CONFIG_IDF_TARGET_ARCH_XTENSA || CONFIG_IDF_TARGET_ARCH_RISCV)
+#undef TASKMAN_PROFILER
+#define TASKMAN_PROFILER 0
+#endif
+
+// burst capture - short high rate recording into a separate buffer, see /burst
+#ifndef BURST_MAX_SAMPLES
+#define BURST_MAX_SAMPLES 200
+#endif
+
+// flight recorder - triggers freeze the history plus a post-trigger window, see /trigger and /capture
+#ifndef MAX_TRIGGERS
+#define MAX_TRIGGERS 4
+#endif
+#ifndef MAX_CAPTURES
+#define MAX_CAPTURES 2
+#endif
+#ifndef CAPTURE_MAX_POST
+#define CAPTURE_MAX_POST 50
+#endif
+
+// history that survives a reboot - needs a data partition labelled "taskman", see /history
+#ifndef TASKMAN_PERSIST
+#define TASKMAN_PERSIST 0
+#endif
+#ifndef PERSIST_ROLLUP
+#define PERSIST_ROLLUP 10  // samples averaged into one flash record
+#endif
+#ifndef PERSIST_BATCH
+#define PERSIST_BATCH 8    // records buffered in ram per flash write
+#endif
+
+// last few samples kept in memory that is not cleared by a panic or watchdog reset, see /lastboot
+#ifndef LASTGASP_SAMPLES
+#define LASTGASP_SAMPLES 16
+#endif
+#ifndef LASTGASP_ATTR
+#define LASTGASP_ATTR RTC_NOINIT_ATTR
+#endif
+
+// binary udp export to a collector, see taskman_udp_export_start() and tools/taskman_udp_receiver.cpp
+#ifndef TASKMAN_UDP_EXPORT
+#define TASKMAN_UDP_EXPORT 0
+#endif
+#ifndef UDP_BATCH_MAX
+#define UDP_BATCH_MAX 10  // sample periods per datagram
+#endif
+
+// heap leak trend and per task cpu anomalies, in /dataInfo "_alerts" and the serial line
+#ifndef TASKMAN_ALERTS
+#define TASKMAN_ALERTS 1
+#endif
+#ifndef LEAK_ROLLUP_MS
+#define LEAK_ROLLUP_MS 60000  // memory averaged over this long for each point of the fit
+#endif
+#ifndef LEAK_DECAY
+#define LEAK_DECAY 0.995      // weight a point keeps per rollup, so the fit looks back about 200 rollups (3 hours)
+#endif
+#ifndef LEAK_MIN_POINTS
+#define LEAK_MIN_POINTS 10    // rollups before the fit is believed
+#endif
+#ifndef LEAK_FLOOR_KB
+#define LEAK_FLOOR_KB 8       // counts as exhausted below this
+#endif
+#ifndef LEAK_ALERT_HOURS
+#define LEAK_ALERT_HOURS 48   // alert when exhaustion is closer than this
+#endif
+#ifndef ANOMALY_ALPHA
+#define ANOMALY_ALPHA 0.05f   // ewma weight of a sample one nominal interval long
+#endif
+#ifndef ANOMALY_Z
+#define ANOMALY_Z 4.0f        // standard deviations from the ewma
+#endif
+#ifndef ANOMALY_MIN_PCT
+#define ANOMALY_MIN_PCT 5.0f  // and at least this far, so a flat task isn't flagged for a 1% wobble
+#endif
+#ifndef ANOMALY_WARMUP
+#define ANOMALY_WARMUP 30     // nominal intervals of samples before a task can be flagged
+#endif
+#ifndef ANOMALY_HOLD_MS
+#define ANOMALY_HOLD_MS 60000 // how long an anomaly stays in the alerts
+#endif
+
+// markers on the graph, from /control or taskman_annotate()
+#ifndef TASKMAN_ANNOTATIONS
+#define TASKMAN_ANNOTATIONS 1
+#endif
+#ifndef MAX_ANNOTATIONS
+#define MAX_ANNOTATIONS 8
+#endif
+#ifndef ANNOTATION_SAMPLES
+#define ANNOTATION_SAMPLES 10  // samples averaged before and after a marker
+#endif
+
+// POST /control changes priorities and suspends tasks - only compiled in with a token:
+//   #define TASKMAN_CONTROL_TOKEN "something long"
+//   #define TASKMAN_CONTROL_ALLOW "loopTask,myWorker"   // tasks it may touch
+#ifdef TASKMAN_CONTROL_TOKEN
+#ifndef TASKMAN_CONTROL_ALLOW
+#define TASKMAN_CONTROL_ALLOW "loopTask"
+#endif
+#endif
+
+// which core does the work and which tasks could move, in /dataInfo "_balance"
+#ifndef TASKMAN_BALANCE
+#define TASKMAN_BALANCE TASKMAN_CORE_SPLIT  // needs the per-core split
+#endif
+#ifndef BALANCE_EVERY
+#define BALANCE_EVERY SAMPLE_COUNT  // samples per plan, one screen of history
+#endif
+#ifndef BALANCE_MIN_PCT
+#define BALANCE_MIN_PCT 1.0f        // lighter tasks stay where they are
+#endif
+#ifndef BALANCE_MIN_GAIN
+#define BALANCE_MIN_GAIN 5.0f       // % the busier core has to drop before moves are suggested
+#endif
+#ifndef BALANCE_SLACK
+#define BALANCE_SLACK 1.0f          // % of peak the plan gives up to make fewer moves
+#endif
+#ifndef TASKMAN_BALANCE_FIXED
+#define TASKMAN_BALANCE_FIXED "IDLE,IDLE0,IDLE1,ipc0,ipc1,esp_timer,wifi,tiT,sys_evt,Tmr Svc,CPU_Monitor,TM_Export,btController,BTC_TASK,BTU_TASK,hciT,arduino_events"
+#endif
+#if TASKMAN_BALANCE && !TASKMAN_CORE_SPLIT
+#error "TASKMAN_BALANCE needs TASKMAN_CORE_SPLIT"
+#endif
+
+// uri handlers taskman_server_setup() registers - a server you pass in needs max_uri_handlers of
+// at least this plus your own, the httpd default of 8 is too few
+#ifdef TASKMAN_CONTROL_TOKEN
+#define TASKMAN_URI_CONTROL_POST TASKMAN_ANNOTATIONS
+#else
+#define TASKMAN_URI_CONTROL_POST 0
+#endif
+#define TASKMAN_URI_HANDLERS (3 + TASKMAN_NETWORK_PAGE + TASKMAN_DASHBOARD + TASKMAN_BURST + 2 * TASKMAN_TRIGGERS + \
+                              TASKMAN_LASTGASP + TASKMAN_ANNOTATIONS + TASKMAN_URI_CONTROL_POST + TASKMAN_PERSIST + \
+                              TASKMAN_PROFILER + TASKMAN_FAKE_LOAD + TASKMAN_CSV_EXPORT)
+
+// the sample interval can be changed at runtime with /config?interval=250 or taskman_set_sample_interval()
+uint32_t taskman_sample_interval_ms = SAMPLE_INTERVAL;
+volatile uint32_t taskman_pending_interval_ms = 0;  // picked up by cpuMonitorTask, which resets the rings
+uint32_t taskman_period_ms = SAMPLE_INTERVAL;       // the interval sampled at now, varies with adaptive sampling
+uint32_t taskman_nominal_ms = SAMPLE_INTERVAL;      // what counts in samples (STARVE_PERIODS, ANOMALY_WARMUP) are counted in
 
 httpd_handle_t taskman_server = NULL;
 
 // ─── STRUCTS ─────────────────────────────────────────────
-struct TaskSample {
-  String name;
-  float usage[SAMPLE_COUNT];
+
+// How a cpu % is packed into the sample type
+template <typename T>
+struct SampleCodec {
+  static T encode(float v) { return v; }
+  static float decode(T v) { return v; }
+};
+
+template <>
+struct SampleCodec<uint16_t> {  // tenths of a percent
+  static uint16_t encode(float v) { return constrain(v, 0.0f, 6553.5f) * 10.0f + 0.5f; }
+  static float decode(uint16_t v) { return v / 10.0f; }
+};
+
+template <>
+struct SampleCodec<uint8_t> {  // half percent
+  static uint8_t encode(float v) { return constrain(v, 0.0f, 127.5f) * 2.0f + 0.5f; }
+  static float decode(uint8_t v) { return v / 2.0f; }
+};
+
+// Fixed size ring, the storage is all inside so the size is known at compile time
+template <typename T, int N>
+struct SampleRing {
+  static constexpr int capacity = N;
+  T v[N] = {};
+  int index = 0;  // next slot to write, which is also the oldest
+
+  void push(T x) {
+    v[index] = x;
+    index = (index + 1) % N;
+  }
+  T newest(int back = 0) const { return v[(index - 1 - back + 2 * N) % N]; }
+  T oldest(int i) const { return v[(index + i) % N]; }
+  void clear() {
+    memset(v, 0, sizeof(v));
+    index = 0;
+  }
+};
+
+// Task state per sample, 2 bits each, oldest first like SampleRing
+enum TaskmanState : uint8_t { TM_RUNNING, TM_READY, TM_BLOCKED, TM_STOPPED };  // stopped: suspended, deleted or not seen
+
+template <int N>
+struct StateRing {
+  uint8_t v[(N + 3) / 4];
   int index = 0;
+
+  void push(uint8_t s) {
+    int shift = (index & 3) * 2;
+    v[index >> 2] = (v[index >> 2] & ~(3 << shift)) | (s << shift);
+    index = (index + 1) % N;
+  }
+  uint8_t get(int k) const { return (v[k >> 2] >> ((k & 3) * 2)) & 3; }
+  uint8_t newest(int back = 0) const { return get((index - 1 - back + 2 * N) % N); }
+  uint8_t oldest(int i) const { return get((index + i) % N); }
+  void clear() {
+    memset(v, 0xFF, sizeof(v));  // TM_STOPPED until seen
+    index = 0;
+  }
+};
+
+template <typename T, int N>
+struct TaskSampleT {
+  String name;
+  SampleRing<T, N> usage;
   bool active = false;
 
   // from FreeRTOS TaskStatus_t
   UBaseType_t taskNumber = 0;
+  TaskHandle_t handle = nullptr;
   eTaskState state;
   UBaseType_t currentPrio = 0;
   UBaseType_t basePrio = 0;
@@ -102,32 +466,245 @@ struct TaskSample {
 
   uint32_t prevRunTime = 0;
   bool over2 = false;
+  float corePct[2] = { 0, 0 };  // newest usage split between core 0 and core 1
+
+#if TASKMAN_ALERTS
+  // ewma of the usage, and the last sample that was too far from it
+  float ewMean = 0;
+  float ewVar = 0;
+  uint32_t ewMs = 0;  // time in the ewma, up to the warmup
+  float anomalyPct = 0;
+  float anomalyZ = 0;
+  uint64_t anomalyMs = 0;  // esp_timer ms, 0 never
+#endif
+
+#if TASKMAN_STATE_HISTORY
+  StateRing<N> states;
+  uint32_t readyIdleMs = 0;    // time Ready with no cpu, in a row, now
+  uint32_t starveLongestMs = 0;  // longest such run
+  uint16_t starveEvents = 0;   // runs that reached STARVE_PERIODS
+  uint32_t starveMs = 0;       // last sample that was starved, 0 never
+  bool boosted = false;        // currentPrio != basePrio, now
+  uint16_t boostEvents = 0;
+  uint32_t boostMs = 0;        // last sample that was boosted, 0 never
+#endif
 
   //  Track how long since we last saw it alive
   int missingCount = 0;
+
+  void push(float u) { usage.push(SampleCodec<T>::encode(u)); }
+  float last(int back = 0) const { return SampleCodec<T>::decode(usage.newest(back)); }
+  float at(int i) const { return SampleCodec<T>::decode(usage.oldest(i)); }  // 0 is the oldest
+};
+
+using TaskSample = TaskSampleT<TASKMAN_SAMPLE_TYPE, SAMPLE_COUNT>;
+
+// What the sampler costs on core 0 - one element each when it is compiled out
+template <int N, bool Enabled>
+struct MonitorSeries {
+  static constexpr bool enabled = Enabled;
+  static constexpr int M = Enabled ? N : 1;
+  uint32_t execUs[M];      // cpuMonitorTask time for the whole sample
+  uint32_t snapshotUs[M];  // uxTaskGetSystemState alone
+  int32_t jitterUs[M];     // actual period minus the nominal one
+  uint8_t missed[M];       // periods skipped before this sample
+  uint32_t missedTotal = 0;
+
+  void clear() {
+    memset(execUs, 0, sizeof(execUs));
+    memset(snapshotUs, 0, sizeof(snapshotUs));
+    memset(jitterUs, 0, sizeof(jitterUs));
+    memset(missed, 0, sizeof(missed));
+  }
+};
+
+// Time in timed interrupts and esp_timer callbacks, in tenths of a % of one core
+template <int N, bool Enabled>
+struct IsrSeries {
+  static constexpr bool enabled = Enabled;
+  static constexpr int M = Enabled ? N : 1;
+  uint16_t isr[2][M];  // TASKMAN_ISR_SCOPE and ISR dispatched timers, by core
+  uint16_t timer[M];   // callbacks run by the esp_timer task
+
+  void clear() {
+    memset(isr, 0, sizeof(isr));
+    memset(timer, 0, sizeof(timer));
+  }
+};
+
+// Wall clock of each sample in ms since 1970, 0 while the clock wasn't set
+template <int N, bool Enabled>
+struct ClockSeries {
+  static constexpr bool enabled = Enabled;
+  static constexpr int M = Enabled ? N : 1;
+  uint64_t epochMs[M];
+
+  void clear() { memset(epochMs, 0, sizeof(epochMs)); }
 };
 
 // ---- System-wide sampling ----
-struct SystemSample {
-  uint32_t freeRam[SAMPLE_COUNT];    // free RAM in KB
-  uint32_t freePSRam[SAMPLE_COUNT];  // free PSRAM in KB
-  int index = 0;                     // rolling index for samples
+template <int N, bool MonitorStats, bool IsrStats, bool WallClock>
+struct SystemSampleT {
+  uint16_t freeRam[N];       // free RAM in KB
+  uint16_t freePSRam[N];     // free PSRAM in KB
+  uint16_t largestBlock[N];  // largest free internal block in KB
+  uint32_t timeMs[N];        // uptime when the sample was taken
+  uint16_t spanMs[N];        // scheduled ms since the sample before, what its cpu % averages over
+  MonitorSeries<N, MonitorStats> mon;
+  IsrSeries<N, IsrStats> isr;
+  ClockSeries<N, WallClock> clock;
+  int index = 0;             // rolling index for samples
+
+  int newest(int back = 0) const { return (index - 1 - back + 2 * N) % N; }
+  int oldest(int i) const { return (index + i) % N; }
+  void clear() {
+    memset(freeRam, 0, sizeof(freeRam));
+    memset(freePSRam, 0, sizeof(freePSRam));
+    memset(largestBlock, 0, sizeof(largestBlock));
+    memset(timeMs, 0, sizeof(timeMs));
+    memset(spanMs, 0, sizeof(spanMs));
+    mon.clear();
+    isr.clear();
+    clock.clear();
+    index = 0;
+  }
 };
 
+using SystemSample = SystemSampleT<SAMPLE_COUNT, TASKMAN_MONITOR_STATS, TASKMAN_ISR_STATS, TASKMAN_WALL_CLOCK>;
+
 // Global instance
 SystemSample sysSamples;
 
-constexpr int MAX_TASKS = 25;
+// How much a sample counts in an average over the ring, newest first: the ms it covers, so
+// the fast samples of adaptive sampling don't outvote the slow ones.  0 for a slot not
+// filled since boot or a rate change.
+uint32_t taskman_sampleMs(int back = 0) {
+  int pos = sysSamples.newest(back);
+  return sysSamples.timeMs[pos] ? sysSamples.spanMs[pos] : 0;
+}
+
+constexpr int MAX_TASKS = TASKMAN_MAX_TASKS;
 TaskSample tasks[MAX_TASKS];
 TaskStatus_t* taskStatusArray = nullptr;
 uint32_t prevTotalRunTime = 0;
 int maxtaskCount = 0;
 
+#if TASKMAN_BURST
+// ---- Burst capture ----
+// usage is stored as tenths of a percent, one row of MAX_TASKS per sample
+struct BurstCapture {
+  uint16_t* usage = nullptr;
+  uint32_t prevRunTime[MAX_TASKS];
+  int count = 0;        // samples captured so far
+  int target = 0;       // samples requested
+  uint32_t intervalMs = 0;
+  uint64_t startUs = 0;
+  volatile bool requested = false;
+  volatile bool running = false;
+  bool ready = false;
+};
+
+BurstCapture burst;
+#endif
+
+#if TASKMAN_TRIGGERS
+// ---- Flight recorder ----
+enum TriggerType { TRIG_NONE,
+                   TRIG_TASK_ABOVE,
+                   TRIG_HEAP_BELOW,
+                   TRIG_LARGEST_BELOW };
+
+struct Trigger {
+  TriggerType type = TRIG_NONE;
+  char task[16];
+  float threshold = 0;  // percent or KB
+  bool armed = false;
+};
+
+#define CAPTURE_ROWS (SAMPLE_COUNT + CAPTURE_MAX_POST)
+
+struct Capture {
+  bool used = false;
+  bool complete = false;
+  uint64_t timeUs = 0;  // uptime at the trigger
+  time_t epoch = 0;     // wall clock at the trigger, 0 if not set
+  char reason[48];
+  uint32_t intervalMs = 0;
+  int pre = 0;          // samples before and including the trigger
+  int count = 0;        // samples stored so far
+  int postLeft = 0;
+  char names[MAX_TASKS][16];
+  uint16_t* usage = nullptr;  // [CAPTURE_ROWS][MAX_TASKS] tenths of a percent
+  uint32_t* mem = nullptr;    // [CAPTURE_ROWS][3] ram, psram, largest block in KB
+};
+
+Trigger triggers[MAX_TRIGGERS];
+Capture captures[MAX_CAPTURES];
+int capturePost = 20;       // post-trigger samples
+int activeCapture = -1;     // capture still filling its post window
+int nextCapture = 0;        // oldest slot, reused when all are full
+#endif
+
+int taskman_findTask(const char* name) {
+  for (int j = 0; j < maxtaskCount; j++) {
+    if (tasks[j].name == name) return j;
+  }
+  return -1;
+}
+
+// true if name is one of the comma separated names in list
+bool taskman_inList(const char* list, const String& name) {
+  const char* p = list;
+  int n = name.length();
+  while (*p) {
+    const char* comma = strchr(p, ',');
+    int len = comma ? comma - p : strlen(p);
+    if (len == n && strncmp(p, name.c_str(), n) == 0) return true;
+    if (!comma) break;
+    p = comma + 1;
+  }
+  return false;
+}
+
+// s as the inside of a json string - quote and backslash escaped, control characters as
+// \u00XX - cut short rather than run past size
+char* taskman_jsonEscape(const char* s, char* out, size_t size) {
+  size_t n = 0;
+  for (; *s && n + 7 < size; s++) {
+    unsigned char ch = *s;
+    if (ch == '"' || ch == '\\') {
+      out[n++] = '\\';
+      out[n++] = ch;
+    } else if (ch < 0x20) {
+      n += snprintf(out + n, size - n, "\\u%04x", ch);
+    } else {
+      out[n++] = ch;
+    }
+  }
+  out[n] = 0;
+  return out;
+}
+
+// Fresh handle for a task number, so a task deleted since the last sample isn't touched
+TaskHandle_t taskman_handleForNumber(UBaseType_t number) {
+  UBaseType_t n = uxTaskGetNumberOfTasks() + 4;
+  TaskStatus_t* list = (TaskStatus_t*)malloc(n * sizeof(TaskStatus_t));
+  if (!list) return nullptr;
+  TaskHandle_t h = nullptr;
+  n = uxTaskGetSystemState(list, n, nullptr);
+  for (UBaseType_t i = 0; i < n; i++) {
+    if (list[i].xTaskNumber == number) h = list[i].xHandle;
+  }
+  free(list);
+  return h;
+}
+
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <lwip/sockets.h>
 
+#if TASKMAN_SESSIONS
 #define MAX_URI 16
 #define MAX_URI_LEN 32
 
@@ -165,13 +742,22 @@ UriStats* getUriStats(const char* uri) {
   // No room
   return nullptr;
 }
+#endif
 
+// Uptime - gettimeofday() would jump when SNTP sets the clock
 static uint64_t nowUs() {
+  return esp_timer_get_time();
+}
+
+// Wall clock in ms since 1970, 0 until SNTP (or settimeofday) has set it
+static uint64_t taskman_epochMs() {
   struct timeval tv;
   gettimeofday(&tv, NULL);
-  return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+  if (tv.tv_sec < 1600000000) return 0;
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+#if TASKMAN_SESSIONS
 // ====== Session Tracking ======
 
 #include <string.h>
@@ -250,14 +836,17 @@ esp_err_t tracked_handler(httpd_req_t* req) {
 
   return res;
 }
+#endif
 
 #include "esp_http_server.h"
+#include "esp_timer.h"
 #include "lwip/sockets.h"
 #include "lwip/tcp.h"
 #include "lwip/priv/tcp_priv.h"  // access internal tcp_pcb list
 #include "lwip/inet.h"
 #include "lwip/ip_addr.h"
 
+#if TASKMAN_NETWORK_PAGE
 // Convert lwIP tcp_state enum to readable text
 static const char* tcpStateName(enum tcp_state st) {
   switch (st) {
@@ -597,6 +1186,7 @@ esp_err_t taskman_handleNetwork(httpd_req_t* req) {
           "td, th { border:1px solid #ccc; padding:4px; text-align:left; }"
           "</style></head><body>";
 
+#if TASKMAN_SESSIONS
   html += "<h2>Active Sessions</h2>";
   html += "<table>";
   html += "<tr><th>#</th><th>In Use</th><th>Socket</th><th>IPv4</th><th>IPv6</th><th>Port</th><th>URI</th>"
@@ -683,6 +1273,7 @@ esp_err_t taskman_handleNetwork(httpd_req_t* req) {
     html += "</tr>";
   }
   html += "</table>";
+#endif
 
   //////////////////////////////////////////////
   // HTTPD Client List With TCP State + Pending
@@ -755,12 +1346,14 @@ esp_err_t taskman_handleNetwork(httpd_req_t* req) {
 
       // Check if tracked in your session manager
       const char* tracked = "no";
+#if TASKMAN_SESSIONS
       for (int j = 0; j < MAX_ACTIVE_SESS; j++) {
         if (sessions[j].in_use && sessions[j].sock == sock) {
           tracked = "yes";
           break;
         }
       }
+#endif
 
       // New: pull TCP state and unread buffer size
       const char* tcpState = getTcpState(sock);
@@ -806,7 +1399,7 @@ esp_err_t taskman_handleNetwork(httpd_req_t* req) {
   "<p style=\"margin: 0;\">"
     "<a href=\"https://github.com/jameszah/ESP32-Task-Manager\" target=\"_blank\" "
        "style=\"color:#0078d4; text-decoration:none;\">"
-       "Source Code on GitHub: <b>ESP32-Task-Manager 7.0</b>"
+       "Source Code on GitHub: <b>ESP32-Task-Manager 8.0</b>"
     "</a>"
   "</p>";
 
@@ -814,636 +1407,4743 @@ esp_err_t taskman_handleNetwork(httpd_req_t* req) {
   httpd_resp_set_type(req, "text/html");
   return httpd_resp_sendstr(req, html.c_str());
 }
+#endif
 
 
 //////////////////////////////////////////
 
-void cpuMonitorTask(void* param) {
-  Serial.println("cpuMonitor started ...");
-
-  // Allocate system state array once
-  if (!taskStatusArray) {
-    taskStatusArray = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * MAX_TASKS);
-    if (!taskStatusArray) {
-      Serial.println("Failed to allocate taskStatusArray");
-      vTaskDelete(nullptr);
-      return;
+#if TASKMAN_TRIGGERS
+// Reserve the capture buffers when the first trigger is armed, not when the heap is already low
+bool taskman_reserveCaptures() {
+  for (int c = 0; c < MAX_CAPTURES; c++) {
+    size_t usageBytes = sizeof(uint16_t) * CAPTURE_ROWS * MAX_TASKS;
+    size_t memBytes = sizeof(uint32_t) * CAPTURE_ROWS * 3;
+    // only what a failed try didn't get, so a retry doesn't leak the half it did
+    if (!captures[c].usage) captures[c].usage = (uint16_t*)(psramFound() ? ps_malloc(usageBytes) : malloc(usageBytes));
+    if (!captures[c].mem) captures[c].mem = (uint32_t*)(psramFound() ? ps_malloc(memBytes) : malloc(memBytes));
+    if (!captures[c].usage || !captures[c].mem) {
+      Serial.println("Failed to allocate capture buffers");
+      return false;
     }
   }
+  return true;
+}
 
-  for (;;) {
-    uint32_t totalRunTime;
-    UBaseType_t numReturned = uxTaskGetSystemState(taskStatusArray, MAX_TASKS, &totalRunTime);
+bool taskman_armTrigger(TriggerType type, const char* task, float threshold) {
+  if (!taskman_reserveCaptures()) return false;
+  for (int i = 0; i < MAX_TRIGGERS; i++) {
+    if (triggers[i].armed) continue;
+    triggers[i].type = type;
+    strncpy(triggers[i].task, task ? task : "", sizeof(triggers[i].task) - 1);
+    triggers[i].task[sizeof(triggers[i].task) - 1] = 0;
+    triggers[i].threshold = threshold;
+    triggers[i].armed = true;
+    return true;
+  }
+  return false;  // all slots armed
+}
 
-    if (numReturned == 0 || totalRunTime == prevTotalRunTime) {
-      vTaskDelay(pdMS_TO_TICKS(SAMPLE_INTERVAL));
-      continue;
-    }
+// Fire when a task goes above pct percent of its core
+bool taskman_arm_task_trigger(const char* task, float pct) {
+  return taskman_armTrigger(TRIG_TASK_ABOVE, task, pct);
+}
 
-    uint32_t deltaTotal = totalRunTime - prevTotalRunTime;
-    prevTotalRunTime = totalRunTime;
+// Fire when free internal heap drops below kb
+bool taskman_arm_heap_trigger(uint32_t kb) {
+  return taskman_armTrigger(TRIG_HEAP_BELOW, nullptr, kb);
+}
 
-    // Mark all tasks as unseen this cycle
-    bool seen[MAX_TASKS] = { false };
+// Fire when the largest free internal block drops below kb
+bool taskman_arm_largest_trigger(uint32_t kb) {
+  return taskman_armTrigger(TRIG_LARGEST_BELOW, nullptr, kb);
+}
 
-    // ── Process current system tasks ───────────────────────────────
-    for (uint32_t i = 0; i < numReturned; i++) {
-      TaskStatus_t* t = &taskStatusArray[i];
-      if (!t->pcTaskName) continue;
+void taskman_set_capture_post(int samples) {
+  capturePost = constrain(samples, 0, CAPTURE_MAX_POST);
+}
 
-      // Find existing task
-      int idx = -1;
-      for (int j = 0; j < maxtaskCount; j++) {
-        if (tasks[j].name == t->pcTaskName) {
-          idx = j;
-          break;
-        }
-      }
+void taskman_disarm_triggers() {
+  for (int i = 0; i < MAX_TRIGGERS; i++) triggers[i].armed = false;
+}
 
-      // If not found, add new one (if space)
-      if (idx == -1 && maxtaskCount < MAX_TASKS) {
-        idx = maxtaskCount++;
-        tasks[idx].name = t->pcTaskName;
-        tasks[idx].active = true;
-        tasks[idx].prevRunTime = t->ulRunTimeCounter;
-        memset(tasks[idx].usage, 0, sizeof(tasks[idx].usage));
-        //Serial.printf("New task observed: %s\n", t->pcTaskName);
-      }
+void taskman_copyCaptureNames(Capture& c) {
+  for (int i = 0; i < MAX_TASKS; i++) {
+    c.names[i][0] = 0;
+    if (i < maxtaskCount) {
+      strncpy(c.names[i], tasks[i].name.c_str(), sizeof(c.names[i]) - 1);
+      c.names[i][sizeof(c.names[i]) - 1] = 0;
+    }
+  }
+}
 
-      if (idx == -1) continue;  // no free slot available
-      seen[idx] = true;
+// One row of the capture from the newest sample, or from ring position back samples ago
+void taskman_captureRow(Capture& c, int back) {
+  if (c.count >= CAPTURE_ROWS) return;
+  uint16_t* row = &c.usage[c.count * MAX_TASKS];
+  for (int i = 0; i < MAX_TASKS; i++) {
+    float u = 0;
+    if (i < maxtaskCount) u = tasks[i].last(back);
+    row[i] = (uint16_t)(u * 10.0f + 0.5f);
+  }
+  int pos = sysSamples.newest(back);
+  c.mem[c.count * 3 + 0] = sysSamples.freeRam[pos];
+  c.mem[c.count * 3 + 1] = sysSamples.freePSRam[pos];
+  c.mem[c.count * 3 + 2] = sysSamples.largestBlock[pos];
+  c.count++;
+}
 
-      uint32_t curr = t->ulRunTimeCounter;
-      uint32_t prev = tasks[idx].prevRunTime;
+void taskman_fireTrigger(const char* reason) {
+  Capture& c = captures[nextCapture];
+  if (!c.usage || !c.mem) return;
+  activeCapture = nextCapture;
+  nextCapture = (nextCapture + 1) % MAX_CAPTURES;
+
+  c.used = true;
+  c.complete = false;
+  c.timeUs = nowUs();
+  time_t now = time(nullptr);
+  c.epoch = (now > 1600000000) ? now : 0;
+  strncpy(c.reason, reason, sizeof(c.reason) - 1);
+  c.reason[sizeof(c.reason) - 1] = 0;
+  c.intervalMs = taskman_period_ms;
+  c.count = 0;
+
+  // freeze the ring, oldest first, ending with the sample that fired - from the oldest slot
+  // that holds a sample, so soon after boot or a reset pre counts only real ones
+  int oldest = SAMPLE_COUNT - 1;
+  while (oldest > 0 && !sysSamples.timeMs[sysSamples.newest(oldest)]) oldest--;
+  for (int back = oldest; back >= 0; back--) taskman_captureRow(c, back);
+  c.pre = c.count;
+  c.postLeft = capturePost;
+  taskman_copyCaptureNames(c);
+
+  Serial.printf("Taskman trigger: %s\n", c.reason);
+}
 
-      // If runtime goes backward
-      if (curr < prev) {
-        uint32_t diff = prev - curr;
+void taskman_finishCapture() {
+  if (activeCapture < 0) return;
+  Capture& c = captures[activeCapture];
+  taskman_copyCaptureNames(c);  // pick up tasks created during the post window
+  c.complete = true;
+  activeCapture = -1;
+}
 
-        if (diff > 0x0FFFFFFF) {
-          //  Valid 32-bit counter rollover (huge backward jump)
-          //    Let unsigned math handle it normally below
-        } else {
-          //  Small backward jump = bogus data from other core or race condition
-          continue;
-        }
+// Called by cpuMonitorTask after each sample
+void taskman_checkTriggers() {
+  if (activeCapture >= 0) {
+    Capture& c = captures[activeCapture];
+    if (c.postLeft-- > 0) taskman_captureRow(c, 0);
+    if (c.postLeft <= 0) taskman_finishCapture();
+    return;
+  }
+
+  int pos = sysSamples.newest();
+  char reason[48];
+
+  for (int i = 0; i < MAX_TRIGGERS; i++) {
+    Trigger& t = triggers[i];
+    if (!t.armed) continue;
+
+    bool fire = false;
+    if (t.type == TRIG_TASK_ABOVE) {
+      int idx = taskman_findTask(t.task);
+      if (idx >= 0) {
+        float u = tasks[idx].last();
+        fire = u > t.threshold;
+        if (fire) snprintf(reason, sizeof(reason), "%s %.1f%% > %.1f%%", t.task, u, t.threshold);
       }
+    } else if (t.type == TRIG_HEAP_BELOW) {
+      fire = sysSamples.freeRam[pos] < t.threshold;
+      if (fire) snprintf(reason, sizeof(reason), "free heap %uKB < %.0fKB", sysSamples.freeRam[pos], t.threshold);
+    } else if (t.type == TRIG_LARGEST_BELOW) {
+      fire = sysSamples.largestBlock[pos] < t.threshold;
+      if (fire) snprintf(reason, sizeof(reason), "largest block %uKB < %.0fKB", sysSamples.largestBlock[pos], t.threshold);
+    }
+
+    if (fire) {
+      t.armed = false;  // one shot, arm it again to catch the next one
+      taskman_fireTrigger(reason);
+      if (capturePost == 0) taskman_finishCapture();
+      return;
+    }
+  }
+}
+#endif
+
+#if TASKMAN_PERSIST
+// ---- Flash history ----
+// The record, the crc and the ring are in taskman_persist.h.  The rollup in progress and
+// the batch not written yet are kept here.
+
+#include "taskman_persist.h"
+
+struct PersistState : TaskmanPersistLog {
+  PersistRecord batch[PERSIST_BATCH];
+  int batchCount = 0;
+  // rollup in progress, the sums are % times the ms each sample covers
+  int samples = 0;
+  uint32_t ms = 0;
+  uint32_t ramMin, psramMin, largestMin;
+  float busySum[2];
+  float taskSum[MAX_TASKS];
+  float taskMax[MAX_TASKS];
+};
 
-      // Compute delta normally — unsigned arithmetic handles rollover correctly
-      uint32_t delta = curr - prev;
+PersistState persist;
 
-      //  Filter out absurdly large deltas (corrupted data)
-      if (delta > 0x0FFFFFFF) continue;
+// ---- esp32 partition backend ----
+const esp_partition_t* persistPartition = nullptr;
 
-      uint32_t deltaTask = delta;     // t->ulRunTimeCounter - tasks[idx].prevRunTime;
-      tasks[idx].prevRunTime = curr;  // t->ulRunTimeCounter;
+bool taskman_partRead(uint32_t off, void* dst, size_t len) {
+  return esp_partition_read(persistPartition, off, dst, len) == ESP_OK;
+}
+bool taskman_partWrite(uint32_t off, const void* src, size_t len) {
+  return esp_partition_write(persistPartition, off, src, len) == ESP_OK;
+}
+bool taskman_partErase(uint32_t off, size_t len) {
+  return esp_partition_erase_range(persistPartition, off, len) == ESP_OK;
+}
 
-      float usage = (deltaTotal > 0) ? (float)deltaTask / deltaTotal * 100.0f : 0.0f;
-      tasks[idx].usage[tasks[idx].index] = usage;
-      tasks[idx].index = (tasks[idx].index + 1) % SAMPLE_COUNT;
+TaskmanFlash taskmanPartitionFlash = { 0, 4096, taskman_partRead, taskman_partWrite, taskman_partErase };
 
-      // Update system info
-      tasks[idx].taskNumber = t->xTaskNumber;
-      tasks[idx].state = t->eCurrentState;
-      tasks[idx].currentPrio = t->uxCurrentPriority;
-      tasks[idx].basePrio = t->uxBasePriority;
-      tasks[idx].runTime = t->ulRunTimeCounter;
-      tasks[idx].stackHighWater = t->usStackHighWaterMark;
-      tasks[idx].core = t->xCoreID;
-      //tasks[idx].over2          = (usage > 2.0f);
-      if (usage > 2.0f) tasks[idx].over2 = true;
+// Scan the log for the head and the boot counter, with the partition or any other TaskmanFlash
+bool taskman_persist_begin(const TaskmanFlash* io = nullptr) {
+  if (!io) {
+    persistPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "taskman");
+    if (!persistPartition) {
+      Serial.println("Taskman history: no \"taskman\" data partition, history not saved");
+      return false;
     }
+    taskmanPartitionFlash.size = persistPartition->size;
+    io = &taskmanPartitionFlash;
+  }
 
-    // ── Roll zeros for missing tasks ───────────────────────────────
-    for (int j = 0; j < maxtaskCount; j++) {
-      if (!seen[j]) {
-        // Task not observed this round → roll in zero usage
-        tasks[j].usage[tasks[j].index] = 0.0f;
-        tasks[j].index = (tasks[j].index + 1) % SAMPLE_COUNT;
-      }
+  if (!taskman_persistScan(persist, io, PERSIST_BATCH)) {
+    Serial.println("Taskman history: partition too small or batch does not fit a sector");
+    return false;
+  }
+
+  persist.samples = 0;
+  persist.batchCount = 0;
+  Serial.printf("Taskman history: %u records, boot %u, head %u\n", persist.slots, persist.boot, persist.head);
+  return true;
+}
+
+// Write the buffered records, erasing the next sector when the head reaches it
+void taskman_persist_flush() {
+  if (!persist.io || persist.batchCount == 0) return;
+
+  taskman_persistWrite(persist, persist.batch, persist.batchCount);
+  persist.batchCount = 0;
+}
+
+void taskman_persistRollup() {
+  PersistRecord& r = persist.batch[persist.batchCount];
+  memset(&r, 0, sizeof(r));
+  r.magic = PERSIST_MAGIC;
+  r.seq = persist.seq++;
+  r.boot = persist.boot;
+  r.samples = persist.samples;
+  r.uptimeS = nowUs() / 1000000ULL;
+  time_t now = time(nullptr);
+  r.epoch = (now > 1600000000) ? now : 0;
+  r.ramMinKB = persist.ramMin;
+  r.psramMinKB = persist.psramMin;
+  r.largestMinKB = persist.largestMin;
+  r.coreBusy[0] = persist.busySum[0] / persist.ms + 0.5f;
+  r.coreBusy[1] = persist.busySum[1] / persist.ms + 0.5f;
+  r.intervalMs = persist.ms / persist.samples;  // the average, adaptive sampling mixes intervals
+
+  for (int k = 0; k < 3; k++) {
+    int best = -1;
+    for (int i = 0; i < maxtaskCount; i++) {
+      if (tasks[i].name.startsWith("IDLE") || persist.taskSum[i] <= 0) continue;
+      if (best < 0 || persist.taskSum[i] > persist.taskSum[best]) best = i;
     }
+    if (best < 0) break;
+    strncpy(r.top[k].name, tasks[best].name.c_str(), sizeof(r.top[k].name));
+    r.top[k].avg2 = min(200.0f, persist.taskSum[best] / persist.ms * 2.0f + 0.5f);
+    r.top[k].max2 = min(200.0f, persist.taskMax[best] * 2.0f + 0.5f);
+    persist.taskSum[best] = -1;  // taken
+  }
 
-    vTaskDelay(pdMS_TO_TICKS(SAMPLE_INTERVAL));
+  r.crc = taskman_crc32((const uint8_t*)&r, offsetof(PersistRecord, crc));
 
-    sysSamples.freeRam[sysSamples.index] = ESP.getFreeHeap() / 1024;
-    sysSamples.freePSRam[sysSamples.index] = ESP.getFreePsram() / 1024;
-    sysSamples.index = (sysSamples.index + 1) % SAMPLE_COUNT;
+  if (++persist.batchCount >= PERSIST_BATCH) taskman_persist_flush();
+  persist.samples = 0;
+  persist.ms = 0;
+}
+
+// Record i of the history, oldest first - flash starting at the head, then the batch not
+// written yet, up to persist.slots + persist.batchCount.  False for an empty or bad slot.
+bool taskman_persistRecord(uint32_t i, PersistRecord& r) {
+  if (i < persist.slots) {
+    if (!persist.io->read(((persist.head + i) % persist.slots) * sizeof(r), &r, sizeof(r))) return false;
+  } else {
+    r = persist.batch[i - persist.slots];
   }
+  return taskman_recordValid(r);
 }
 
-void FakeLoad1(void* pv) {
-  uint32_t idleMs = 10000UL;
-  //Serial.printf("FakeLoad1: Core 1, idle for %lu ms...\n", idleMs);
-  vTaskDelay(pdMS_TO_TICKS(idleMs));
+// Called by cpuMonitorTask after each sample
+void taskman_persistSample() {
+  if (!persist.io) return;
 
-  for (;;) {
-    uint32_t runSecs = random(1, 10);
-    //Serial.printf("FakeLoad1: Core 1, running for %lu seconds...\n", runSecs);
+  if (persist.samples == 0) {
+    persist.ramMin = persist.psramMin = persist.largestMin = UINT32_MAX;
+    persist.busySum[0] = persist.busySum[1] = 0;
+    memset(persist.taskSum, 0, sizeof(persist.taskSum));
+    memset(persist.taskMax, 0, sizeof(persist.taskMax));
+  }
 
-    // Allocate PSRAM once per load phase (optional)
-    uint8_t* psramBuffer = (uint8_t*)ps_malloc(2 * 1024 * 1024);  // 1 MB PSRAM
-    if (psramBuffer) memset(psramBuffer, 0xAA, 2 * 1024 * 1024);
+  int pos = sysSamples.newest();
+  persist.ramMin = min(persist.ramMin, (uint32_t)sysSamples.freeRam[pos]);
+  persist.psramMin = min(persist.psramMin, (uint32_t)sysSamples.freePSRam[pos]);
+  persist.largestMin = min(persist.largestMin, (uint32_t)sysSamples.largestBlock[pos]);
 
-    uint8_t* ramBuffer = nullptr;
-    size_t ramSize = 0;
+  uint32_t ms = taskman_sampleMs();
+  for (int i = 0; i < maxtaskCount; i++) {
+    float u = tasks[i].last();
+    persist.taskSum[i] += u * ms;
+    if (u > persist.taskMax[i]) persist.taskMax[i] = u;
+    if (tasks[i].name == "IDLE0") persist.busySum[0] += (100.0f - u) * ms;
+    if (tasks[i].name == "IDLE1") persist.busySum[1] += (100.0f - u) * ms;
+  }
+  persist.ms += ms;
 
-    uint32_t start = millis();
-    uint32_t lastIncrease = start;
+  if (++persist.samples >= PERSIST_ROLLUP) taskman_persistRollup();
+}
+#endif
 
-    while ((millis() - start) < (runSecs * 1000UL)) {
-      int j = 0;
-      for (int i = 0; i < 200000; i++) {
-        j = (j + 1) * -1;
-      }
-      if (j < 0) Serial.println("Fake Load 1!");
-      // every 1 second: increase RAM allocation by 2 KB
-      if (millis() - lastIncrease >= 1000) {
-        lastIncrease = millis();
-        ramSize += 5 * 1024;  // +2 KB
-        uint8_t* newBuffer = (uint8_t*)heap_caps_realloc(ramBuffer, ramSize, MALLOC_CAP_INTERNAL);
-        //uint8_t* newBuffer = (uint8_t*)realloc(ramBuffer, ramSize);
-        if (newBuffer) {
-          ramBuffer = newBuffer;
-          memset(ramBuffer + ramSize - 5 * 1024, 0xAA, 5 * 1024);  // touch new region
-          //Serial.printf("FakeLoad1: increased RAM to %u KB\n", ramSize / 1024);
-        } else {
-          Serial.println("FakeLoad1: realloc failed");
-          break;  // stop increasing on failure
-        }
-      }
+#if TASKMAN_LASTGASP
+// ---- Last gasp ----
+// A small mirror of the newest samples in no-init memory.  Each sample is 5 words with its
+// own xor check, so a sample torn by the crash is just dropped.  Task names only change
+// when a new task shows up, so they are kept once and the samples just hold the slot.
+
+#define LASTGASP_MAGIC 0x5047544C  // "LTGP"
+
+struct LastGaspEntry {
+  uint32_t uptimeMs;
+  uint16_t ramKB;
+  uint16_t largestKB;
+  uint16_t psramKB;
+  uint8_t slot[3];  // busiest tasks, names in LastGasp::names
+  uint8_t pct2[3];  // half percent steps
+  uint32_t check;   // xor of the words above and the magic
+};
 
-      vTaskDelay(1);
+struct LastGasp {
+  uint32_t magic;
+  uint32_t head;  // next entry
+  char names[MAX_TASKS][12];
+  LastGaspEntry e[LASTGASP_SAMPLES];
+};
+
+LASTGASP_ATTR LastGasp lastGasp;
+
+// copy made at boot, before the new run starts writing
+struct PrevBoot {
+  bool valid = false;
+  esp_reset_reason_t reason;
+  int count = 0;
+  char names[MAX_TASKS][12];
+  LastGaspEntry e[LASTGASP_SAMPLES];
+};
+
+PrevBoot prevBoot;
+
+uint32_t taskman_lastGaspCheck(const LastGaspEntry& e) {
+  uint32_t w[4];
+  memcpy(w, &e, sizeof(w));
+  return w[0] ^ w[1] ^ w[2] ^ w[3] ^ LASTGASP_MAGIC;
+}
+
+const char* taskman_resetReasonName(esp_reset_reason_t r) {
+  switch (r) {
+    case ESP_RST_POWERON: return "POWERON";
+    case ESP_RST_EXT: return "EXT";
+    case ESP_RST_SW: return "SW";
+    case ESP_RST_PANIC: return "PANIC";
+    case ESP_RST_INT_WDT: return "INT_WDT";
+    case ESP_RST_TASK_WDT: return "TASK_WDT";
+    case ESP_RST_WDT: return "WDT";
+    case ESP_RST_DEEPSLEEP: return "DEEPSLEEP";
+    case ESP_RST_BROWNOUT: return "BROWNOUT";
+    case ESP_RST_SDIO: return "SDIO";
+    default: return "UNKNOWN";
+  }
+}
+
+// Called from taskman_setup() - keep what the last run left behind, then start over
+void taskman_lastGaspBegin() {
+  prevBoot.reason = esp_reset_reason();
+  prevBoot.count = 0;
+
+  if (lastGasp.magic == LASTGASP_MAGIC && lastGasp.head < LASTGASP_SAMPLES) {
+    memcpy(prevBoot.names, lastGasp.names, sizeof(prevBoot.names));
+    for (int i = 0; i < MAX_TASKS; i++) prevBoot.names[i][sizeof(prevBoot.names[i]) - 1] = 0;
+
+    // oldest first
+    for (int i = 0; i < LASTGASP_SAMPLES; i++) {
+      const LastGaspEntry& e = lastGasp.e[(lastGasp.head + i) % LASTGASP_SAMPLES];
+      if (e.uptimeMs == 0 || e.check != taskman_lastGaspCheck(e)) continue;
+      prevBoot.e[prevBoot.count++] = e;
     }
+    prevBoot.valid = prevBoot.count > 0;
+  }
 
-    if (ramBuffer) free(ramBuffer);
-    if (psramBuffer) free(psramBuffer);
+  memset(&lastGasp, 0, sizeof(lastGasp));
+  lastGasp.magic = LASTGASP_MAGIC;
 
-    uint32_t idleMs = random(5, 20) * 1000UL;
-    //Serial.printf("FakeLoad1: idle for %lu ms...\n", idleMs);
-    vTaskDelay(pdMS_TO_TICKS(idleMs));
+  if (prevBoot.valid) {
+    const LastGaspEntry& e = prevBoot.e[prevBoot.count - 1];
+    Serial.printf("Previous boot ended (%s) at %us, RAM=%uKB largest=%uKB, busiest %s\n",
+                  taskman_resetReasonName(prevBoot.reason), e.uptimeMs / 1000, e.ramKB, e.largestKB,
+                  e.pct2[0] ? prevBoot.names[e.slot[0] % MAX_TASKS] : "-");
   }
 }
 
-void FakeLoad0(void* pv) {
-  const uint32_t cycleMs = 30000UL;  // full sine wave cycle = 30 seconds
-  const float minLoad = 0.05;        // 5% minimum load
-  const float maxLoad = 0.50;        // 50% maximum load
-  const uint32_t stepMs = 200;       // time step resolution
+void taskman_lastGaspName(int idx, const char* name) {
+  strncpy(lastGasp.names[idx], name, sizeof(lastGasp.names[idx]) - 1);
+}
 
-  Serial.printf("FakeLoad0: Core %d, sine-wave fake load (%.0f–%.0f%%, %lus cycle)\n",
-                xPortGetCoreID(), minLoad * 100, maxLoad * 100, cycleMs / 1000);
+// Called by cpuMonitorTask after each sample - one entry, a handful of stores
+void taskman_lastGaspSample() {
+  LastGaspEntry e;
+  memset(&e, 0, sizeof(e));
 
-  uint32_t startCycle = millis();
-  uint32_t lastReport = millis();
+  int pos = sysSamples.newest();
+  e.uptimeMs = millis();
+  e.ramKB = sysSamples.freeRam[pos];
+  e.largestKB = sysSamples.largestBlock[pos];
+  e.psramKB = sysSamples.freePSRam[pos];
 
-  for (;;) {
-    uint32_t elapsed = (millis() - startCycle) % cycleMs;
+  // busiest 3, IDLE excluded
+  float best[3] = { 0, 0, 0 };
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (tasks[i].name.startsWith("IDLE")) continue;
+    float u = tasks[i].last();
+    for (int k = 0; k < 3; k++) {
+      if (u <= best[k]) continue;
+      for (int m = 2; m > k; m--) {
+        best[m] = best[m - 1];
+        e.slot[m] = e.slot[m - 1];
+      }
+      best[k] = u;
+      e.slot[k] = i;
+      break;
+    }
+  }
+  for (int k = 0; k < 3; k++) e.pct2[k] = min(200.0f, best[k] * 2.0f + 0.5f);
 
-    // Sine wave 0→2π
-    float phase = (2.0f * PI * elapsed) / cycleMs;
-    float loadFrac = minLoad + (maxLoad - minLoad) * (0.5f * (sinf(phase) + 1.0f));
+  e.check = taskman_lastGaspCheck(e);
+
+  uint32_t head = lastGasp.head;
+  lastGasp.e[head] = e;
+  lastGasp.head = (head + 1) % LASTGASP_SAMPLES;
+}
+#endif
+
+#if TASKMAN_UDP_EXPORT
+// ---- UDP export ----
+// cpuMonitorTask copies each period into a staging row (a few hundred bytes of memcpy),
+// and when a batch is full it hands the buffer to the exporter task, which packs it
+// and does one sendto.  Everything is little endian.
+//
+//   header   u32 magic "TMU1", u32 device id, u32 batch seq, u16 interval ms,
+//            u8 periods, u8 tasks
+//   names    per task: u8 length, name bytes
+//   periods  per period: u32 uptime ms, u16 ram KB, u16 psram KB, u16 largest KB,
+//            u16 http hits in the period, u8 open sessions, u8 reserved,
+//            then u16 usage per task in tenths of a percent
+
+#define UDP_MAGIC 0x31554D54  // "TMU1"
+#define UDP_HEADER_BYTES 16
+#define UDP_PERIOD_BYTES 14
+#define UDP_NAME_MAX 16
+#define UDP_PACKET_MAX (UDP_HEADER_BYTES + MAX_TASKS * (1 + UDP_NAME_MAX) + UDP_BATCH_MAX * (UDP_PERIOD_BYTES + 2 * MAX_TASKS))
+static_assert(UDP_PACKET_MAX <= 1472, "udp export batch does not fit one datagram, lower UDP_BATCH_MAX");
+
+struct UdpRow {
+  uint32_t uptimeMs;
+  uint16_t ramKB, psramKB, largestKB;
+  uint16_t hits;
+  uint8_t sessions;
+  uint16_t usage[MAX_TASKS];
+};
+
+struct UdpExport {
+  TaskHandle_t task = nullptr;
+  int sock = -1;
+  struct sockaddr_in dest;
+  int batch = UDP_BATCH_MAX;
+  UdpRow rows[2][UDP_BATCH_MAX];  // monitor fills one while the exporter sends the other
+  int fill = 0;                   // buffer being filled
+  int count = 0;                  // rows in it
+  volatile int sendCount = 0;     // rows in the other one, 0 when the exporter is done
+  uint32_t seq = 0;               // per batch, sent or dropped, so the receiver sees the gap
+  uint32_t lastHits = 0;
+  uint32_t sent = 0;
+  uint32_t dropped = 0;
+  uint8_t packet[UDP_PACKET_MAX];
+};
+
+UdpExport udpExport;
+
+static uint8_t* udpPut16(uint8_t* p, uint16_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+static uint8_t* udpPut32(uint8_t* p, uint32_t v) {
+  p = udpPut16(p, v);
+  return udpPut16(p, v >> 16);
+}
 
-    uint32_t busyMs = (uint32_t)(stepMs * loadFrac);
-    uint32_t idleMs = stepMs - busyMs;
+void udpExportTask(void* param) {
+  uint32_t deviceId = (uint32_t)ESP.getEfuseMac();
 
-    // --- Busy loop ---
-    uint32_t t0 = millis();
-    while ((millis() - t0) < busyMs) {
-      float f = 0.0f;
-      for (int i = 0; i < 500; i++) f += 3.14f / 2.71f;
-      if (f < 0) Serial.println("Fake Load 0!");
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int n = udpExport.sendCount;
+    if (n == 0) continue;
+    const UdpRow* rows = udpExport.rows[udpExport.fill ^ 1];
+
+    int taskCount = maxtaskCount;
+    uint8_t* p = udpExport.packet;
+    p = udpPut32(p, UDP_MAGIC);
+    p = udpPut32(p, deviceId);
+    p = udpPut32(p, __atomic_fetch_add(&udpExport.seq, 1, __ATOMIC_RELAXED));
+    p = udpPut16(p, taskman_period_ms);
+    *p++ = n;
+    *p++ = taskCount;
+
+    for (int i = 0; i < taskCount; i++) {
+      int len = min((int)tasks[i].name.length(), UDP_NAME_MAX);
+      *p++ = len;
+      memcpy(p, tasks[i].name.c_str(), len);
+      p += len;
     }
 
-    // --- Idle for remainder ---
-    vTaskDelay(pdMS_TO_TICKS(idleMs));
+    for (int r = 0; r < n; r++) {
+      p = udpPut32(p, rows[r].uptimeMs);
+      p = udpPut16(p, rows[r].ramKB);
+      p = udpPut16(p, rows[r].psramKB);
+      p = udpPut16(p, rows[r].largestKB);
+      p = udpPut16(p, rows[r].hits);
+      *p++ = rows[r].sessions;
+      *p++ = 0;
+      for (int i = 0; i < taskCount; i++) p = udpPut16(p, rows[r].usage[i]);
+    }
+
+    int len = p - udpExport.packet;
+    if (sendto(udpExport.sock, udpExport.packet, len, 0, (struct sockaddr*)&udpExport.dest, sizeof(udpExport.dest)) == len) {
+      udpExport.sent++;
+    } else {
+      udpExport.dropped++;
+    }
+    udpExport.sendCount = 0;
   }
 }
 
-String getProgramName() {
-  String path = __FILE__;
-  int slash = path.lastIndexOf('/');
-  if (slash < 0) slash = path.lastIndexOf('\\');  // handle Windows
-  int dot = path.lastIndexOf('.');
-  if (dot < 0) dot = path.length();
-  return path.substring(slash + 1, dot);
+// Send every sample period to ip:port, batch periods per datagram
+bool taskman_udp_export_start(const char* ip, uint16_t port, int batch = UDP_BATCH_MAX) {
+  if (udpExport.task) return false;
+
+  memset(&udpExport.dest, 0, sizeof(udpExport.dest));
+  udpExport.dest.sin_family = AF_INET;
+  udpExport.dest.sin_port = htons(port);
+  if (inet_pton(AF_INET, ip, &udpExport.dest.sin_addr) != 1) {
+    Serial.printf("Taskman udp export: bad address %s\n", ip);
+    return false;
+  }
+
+  udpExport.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (udpExport.sock < 0) {
+    Serial.println("Taskman udp export: socket failed");
+    return false;
+  }
+
+  udpExport.batch = constrain(batch, 1, UDP_BATCH_MAX);
+  udpExport.count = 0;
+  xTaskCreatePinnedToCore(udpExportTask, "TM_Export", 2048, nullptr, 2, &udpExport.task, 0);
+  Serial.printf("Taskman udp export to %s:%u, %d periods per datagram\n", ip, port, udpExport.batch);
+  return true;
 }
 
-esp_err_t taskman_handleRoot(httpd_req_t* req) {
-  //String progName = getProgramName();
-  String progName = PROGRAM_NAME;
+// Called by cpuMonitorTask after each sample
+void taskman_exportSample() {
+  if (!udpExport.task) return;
+
+  UdpRow& row = udpExport.rows[udpExport.fill][udpExport.count];
+  int pos = sysSamples.newest();
+  row.uptimeMs = millis();
+  row.ramKB = sysSamples.freeRam[pos];
+  row.psramKB = sysSamples.freePSRam[pos];
+  row.largestKB = sysSamples.largestBlock[pos];
+
+  row.hits = 0;
+  row.sessions = 0;
+#if TASKMAN_SESSIONS
+  uint32_t hits = 0;
+  for (int i = 0; i < MAX_URI; i++) hits += uriStats[i].hits;
+  row.hits = hits - udpExport.lastHits;
+  udpExport.lastHits = hits;
+
+  for (int i = 0; i < MAX_ACTIVE_SESS; i++) row.sessions += sessions[i].in_use;
+#endif
 
-  String html = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-  <title>)rawliteral";
-  html += progName;
-  html += R"rawliteral( - ESP32 Task Manager</title>
-  <script src="https://cdn.jsdelivr.net/npm/chart.js"></script>
-  
-  <style>
-    body {
-      font-family: sans-serif;
-      margin: 0;
-      background: #fff;
-      padding: 1em;
+  memset(row.usage, 0, sizeof(row.usage));
+  for (int i = 0; i < maxtaskCount; i++) {
+    row.usage[i] = tasks[i].last() * 10.0f + 0.5f;
+  }
+
+  if (++udpExport.count < udpExport.batch) return;
+
+  if (udpExport.sendCount) {
+    udpExport.dropped++;  // exporter still busy with the last batch, reuse this one
+    __atomic_fetch_add(&udpExport.seq, 1, __ATOMIC_RELAXED);
+  } else {
+    udpExport.sendCount = udpExport.count;
+    udpExport.fill ^= 1;
+    xTaskNotifyGive(udpExport.task);
+  }
+  udpExport.count = 0;
+}
+#endif
+
+#if TASKMAN_CORE_SPLIT
+// ---- Per-core attribution ----
+// The run time counters say how long a task ran, not where.  A tick hook on each core
+// counts which task it interrupted, so every tick (1ms) is one sample of what each core
+// is running, and the runtime of an unpinned task is split in the same proportion.  The
+// hooks are in IRAM and only touch this struct, so they keep counting during flash writes.
+
+#include "esp_freertos_hooks.h"
+
+struct CoreSplit {
+  TaskHandle_t handle[MAX_TASKS];            // by task slot, written by cpuMonitorTask
+  volatile int count = 0;                    // slots the hooks look at
+  volatile uint32_t ticks[2][MAX_TASKS];     // written only by the hook on that core
+  uint32_t prevTicks[2][MAX_TASKS];
+};
+
+DRAM_ATTR CoreSplit coreSplit;
+
+static inline __attribute__((always_inline)) void taskman_countTick(int core) {
+  TaskHandle_t h = xTaskGetCurrentTaskHandleForCore(core);
+  int n = coreSplit.count;
+  for (int i = 0; i < n; i++) {
+    if (coreSplit.handle[i] == h) {
+      coreSplit.ticks[core][i]++;
+      return;
     }
-    #cpuChart {
-      width: 100%;
-      max-height: 400px;
+  }
+}
+
+void IRAM_ATTR taskman_tickHook0() {
+  taskman_countTick(0);
+}
+
+void IRAM_ATTR taskman_tickHook1() {
+  taskman_countTick(1);
+}
+
+void taskman_coreSplitBegin() {
+  if (portNUM_PROCESSORS < 2) return;
+  esp_register_freertos_tick_hook_for_cpu(taskman_tickHook0, 0);
+  esp_register_freertos_tick_hook_for_cpu(taskman_tickHook1, 1);
+}
+
+// Called by cpuMonitorTask for every slot it has seen, handle first so a recreated task is followed
+void taskman_coreSplitHandle(int idx, TaskHandle_t h) {
+  coreSplit.handle[idx] = h;
+  if (coreSplit.count <= idx) coreSplit.count = idx + 1;
+}
+
+// Share this sample's usage between the cores the hooks saw the task on
+void taskman_splitCores(int idx, float usage) {
+  uint32_t d[2];
+  for (int c = 0; c < 2; c++) {
+    uint32_t now = coreSplit.ticks[c][idx];
+    d[c] = now - coreSplit.prevTicks[c][idx];
+    coreSplit.prevTicks[c][idx] = now;
+  }
+
+  TaskSample& t = tasks[idx];
+  if (t.core == 0 || t.core == 1 || portNUM_PROCESSORS < 2) {
+    int c = (t.core == 1) ? 1 : 0;  // pinned, no guessing
+    t.corePct[c] = usage;
+    t.corePct[1 - c] = 0;
+  } else if (d[0] + d[1] > 0) {
+    t.corePct[0] = usage * d[0] / (d[0] + d[1]);
+    t.corePct[1] = usage - t.corePct[0];
+  } else {
+    // ran less than a tick, keep the last split
+    float last = t.corePct[0] + t.corePct[1];
+    float share0 = last > 0 ? t.corePct[0] / last : 0.5f;
+    t.corePct[0] = usage * share0;
+    t.corePct[1] = usage - t.corePct[0];
+  }
+}
+#endif
+
+// ---- Task statistics ----
+// Two sets per task.  The window is the ring itself, read when /dataInfo asks: each
+// sample weighted by the ms it covers into sums of tenths and a 1% histogram for min,
+// max and p95, so under adaptive sampling the stats are over time, not over samples.
+// Since boot, O(1) per sample: Welford mean/variance and a P-square p95 estimate, which
+// needs 5 markers instead of the history - those count samples.
+
+#if TASKMAN_TASK_STATS
+#define STATS_BINS 101  // 0..100%, a task over 100 (both cores) counts as 100
+
+// Jain and Chlamtac's P-square estimate of one quantile
+struct P2Quantile {
+  float p = 0.95f;
+  float q[5];     // marker heights
+  int n[5];       // marker positions
+  float np[5];    // desired positions
+  float dn[5];    // desired position increments
+  uint32_t count = 0;
+
+  void add(float x) {
+    if (count < 5) {
+      q[count++] = x;
+      if (count == 5) {
+        std::sort(q, q + 5);
+        for (int i = 0; i < 5; i++) n[i] = i;
+        np[0] = 0;
+        np[1] = 2 * p;
+        np[2] = 4 * p;
+        np[3] = 2 + 2 * p;
+        np[4] = 4;
+        dn[0] = 0;
+        dn[1] = p / 2;
+        dn[2] = p;
+        dn[3] = (1 + p) / 2;
+        dn[4] = 1;
+      }
+      return;
     }
-    table {
-      width: 100%;
-      border-collapse: collapse;
-      margin-top: 20px;
+
+    int k;
+    if (x < q[0]) {
+      q[0] = x;
+      k = 0;
+    } else if (x >= q[4]) {
+      q[4] = max(q[4], x);
+      k = 3;
+    } else {
+      k = 0;
+      while (x >= q[k + 1]) k++;
     }
-    th, td {
-      border: 1px solid #ccc;
-      padding: 6px 10px;
-      text-align: left;
+    for (int i = k + 1; i < 5; i++) n[i]++;
+    for (int i = 0; i < 5; i++) np[i] += dn[i];
+    count++;
+
+    // move the middle markers towards where they should be, parabolic if it stays in order
+    for (int i = 1; i < 4; i++) {
+      float d = np[i] - n[i];
+      if ((d >= 1 && n[i + 1] - n[i] > 1) || (d <= -1 && n[i - 1] - n[i] < -1)) {
+        int s = d > 0 ? 1 : -1;
+        float qp = q[i] + (float)s / (n[i + 1] - n[i - 1]) * ((n[i] - n[i - 1] + s) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) + (n[i + 1] - n[i] - s) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+        if (q[i - 1] < qp && qp < q[i + 1]) q[i] = qp;
+        else q[i] = q[i] + s * (q[i + s] - q[i]) / (n[i + s] - n[i]);
+        n[i] += s;
+      }
     }
-    th {
-      background: #eee;
+  }
+
+  float value() const {
+    if (count >= 5) return q[2];
+    if (count == 0) return 0;
+    float sorted[5];
+    memcpy(sorted, q, sizeof(float) * count);
+    std::sort(sorted, sorted + count);
+    return sorted[(int)(p * (count - 1) + 0.5f)];
+  }
+};
+
+// since the task was first seen
+struct TaskStats {
+  uint32_t count = 0;
+  float mean = 0;
+  float m2 = 0;  // Welford's sum of squared differences
+  float min = 0;
+  float max = 0;
+  P2Quantile p95;
+};
+
+TaskStats taskStats[MAX_TASKS];
+
+static inline int taskman_statsBin(int tenths) {
+  return min((tenths + 5) / 10, STATS_BINS - 1);
+}
+
+void taskman_statsReset(int idx) {
+  taskStats[idx] = TaskStats();
+}
+
+void taskman_statsAdd(int idx, float now) {
+  TaskStats& st = taskStats[idx];
+  st.count++;
+  float delta = now - st.mean;
+  st.mean += delta / st.count;
+  st.m2 += delta * (now - st.mean);
+  st.min = st.count == 1 ? now : min(st.min, now);
+  st.max = st.count == 1 ? now : max(st.max, now);
+  st.p95.add(now);
+}
+
+// smallest bin holding the fraction q of the ms in the window
+static int taskman_statsQuantile(const uint32_t* hist, uint32_t ms, float q) {
+  if (!ms) return 0;
+  uint32_t need = (uint32_t)ceilf(q * ms);
+  if (need == 0) need = 1;
+  uint32_t seen = 0;
+  for (int b = 0; b < STATS_BINS; b++) {
+    seen += hist[b];
+    if (seen >= need) return b;
+  }
+  return STATS_BINS - 1;
+}
+
+String taskman_statsJson(int idx) {
+  const TaskStats& st = taskStats[idx];
+  uint32_t hist[STATS_BINS] = {};  // ms at each 1%
+  uint32_t ms = 0;
+  uint64_t sum10 = 0, sumSq10 = 0;  // tenths of a percent times ms
+  for (int k = 0; k < SAMPLE_COUNT; k++) {
+    uint32_t w = taskman_sampleMs(k);
+    if (!w) continue;
+    uint32_t v = tasks[idx].last(k) * 10.0f + 0.5f;
+    hist[taskman_statsBin(v)] += w;
+    ms += w;
+    sum10 += (uint64_t)v * w;
+    sumSq10 += (uint64_t)v * v * w;
+  }
+  float mean = ms ? sum10 / 10.0 / ms : 0;
+  float var = ms ? sumSq10 / 100.0 / ms - (double)mean * mean : 0;
+  float bootVar = st.count > 1 ? st.m2 / (st.count - 1) : 0;
+
+  char json[256];
+  snprintf(json, sizeof(json),
+           "\"win\":{\"min\":%d,\"max\":%d,\"mean\":%.1f,\"std\":%.1f,\"p95\":%d},"
+           "\"boot\":{\"n\":%u,\"min\":%.1f,\"max\":%.1f,\"mean\":%.1f,\"std\":%.1f,\"p95\":%.1f}",
+           taskman_statsQuantile(hist, ms, 0), taskman_statsQuantile(hist, ms, 1.0f), mean, sqrtf(max(var, 0.0f)),
+           taskman_statsQuantile(hist, ms, 0.95f), st.count, st.min, st.max, st.mean, sqrtf(bootVar), st.p95.value());
+  return json;
+}
+#endif
+
+#if TASKMAN_STATE_HISTORY
+// ---- Task state history ----
+// The state uxTaskGetSystemState saw at each sample.  A task Ready for STARVE_PERIODS
+// nominal intervals (the fixed interval, or baseMs with adaptive sampling) of samples
+// without getting any cpu is starved - something of the same or higher priority
+// has the core.  A task whose current priority isn't its base priority has inherited it,
+// which means it holds a mutex a higher priority task is waiting on.  The sampler runs
+// on core 0 so nothing there is ever seen Running, only Ready.
+
+uint8_t taskman_packState(eTaskState s) {
+  switch (s) {
+    case eRunning: return TM_RUNNING;
+    case eReady: return TM_READY;
+    case eBlocked: return TM_BLOCKED;
+    default: return TM_STOPPED;
+  }
+}
+
+bool taskman_starving(const TaskSample& t) {
+  return t.readyIdleMs >= STARVE_PERIODS * taskman_nominal_ms;
+}
+
+void taskman_stateSample(int idx, uint8_t s, float usage) {
+  TaskSample& t = tasks[idx];
+  t.states.push(s);
+
+  if (s == TM_READY && usage < STARVE_PCT) {
+    bool was = taskman_starving(t);
+    t.readyIdleMs += taskman_sampleMs();
+    if (taskman_starving(t)) {
+      if (!was) t.starveEvents++;
+      t.starveMs = millis() | 1;
     }
-  </style>
-</head>
-<body>
-<h2>ESP32 Task Manager - )rawliteral";
-  html += progName;
-  html += R"rawliteral(</h2>
-  
-  <canvas id="memChart" width="900" height="200" style="margin-top: 20px;"></canvas>
-  <canvas id="cpuChart" width="900" height="400"></canvas>
+    t.starveLongestMs = max(t.starveLongestMs, t.readyIdleMs);
+  } else {
+    t.readyIdleMs = 0;
+  }
 
-<div style="
-  background: #fff;
-  padding: 12px 16px;
-  border-radius: 10px;
-  box-shadow: 0 2px 6px rgba(0,0,0,0.1);
-  max-width: 900px;
-  margin-top: 15px;
-  line-height: 1.6;
-  font-size: 14px;
-  color: #333;
-">
-  <ul style="margin: 0 0 10px 20px; padding: 0;">
-    <li>Click task names in legend to hide or restore lines</li>
-    <li>Hover over a line to see task name and current CPU usage</li>
-    <li><a href="/network">Network Info</a></li>
-  </ul>
-  <p style="margin: 0;">
-    <a href="https://github.com/jameszah/ESP32-Task-Manager" target="_blank" 
-       style="color:#0078d4; text-decoration:none;">
-       Source Code on GitHub: <b>ESP32-Task-Manager 7.0</b>
-    </a>
-  </p>
-</div>
-<h3>Task Info - updates every 30 sec</h3>
-<table id="taskTable" border="1" style="margin-top:10px; border-collapse:collapse; width:100%; background:white;">
-  <thead>
-    <tr style="background:#eee;">
-      <th>Task Name</th>
-      <th>Core</th>
-      <th>Priority</th>
-      <th>Stack HW</th>
-      <th>State</th>
-    </tr>
-  </thead>
-  <tbody></tbody>
-</table>
+  bool boosted = s != TM_STOPPED && t.currentPrio != t.basePrio;
+  if (boosted && !t.boosted) t.boostEvents++;
+  if (boosted) t.boostMs = millis() | 1;
+  t.boosted = boosted;
+}
 
-<script>
+void taskman_stateReset(int idx) {
+  TaskSample& t = tasks[idx];
+  t.states.clear();
+  t.readyIdleMs = t.starveLongestMs = 0;
+  t.starveEvents = t.boostEvents = 0;
+  t.starveMs = t.boostMs = 0;
+  t.boosted = false;
+}
 
-let cpuChart, memChart;
+static int taskman_agoS(uint32_t ms) {
+  return ms ? (int)((millis() - ms) / 1000) : -1;
+}
 
-let sampleCount = 100; // number of samples to keep on screen
+// "states" is one letter a sample, oldest first: R running, r ready, b blocked, - suspended or gone.
+// "mix" is the % of the window's time in each.
+String taskman_stateJson(int idx) {
+  const TaskSample& t = tasks[idx];
+  char hist[SAMPLE_COUNT + 1];
+  uint32_t mix[4] = { 0, 0, 0, 0 };
+  for (int i = 0; i < SAMPLE_COUNT; i++) {
+    uint8_t s = t.states.oldest(i);
+    hist[i] = "Rrb-"[s];
+    mix[s] += taskman_sampleMs(SAMPLE_COUNT - 1 - i);
+  }
+  hist[SAMPLE_COUNT] = 0;
+  uint32_t ms = mix[0] + mix[1] + mix[2] + mix[3];
+  float per = ms ? 100.0f / ms : 0;
+
+  char json[224];
+  snprintf(json, sizeof(json),
+           "\"mix\":[%.0f,%.0f,%.0f,%.0f],\"starve\":{\"now\":%s,\"nowMs\":%u,\"longestMs\":%u,\"events\":%u,\"agoS\":%d},"
+           "\"boost\":{\"now\":%s,\"base\":%u,\"events\":%u,\"agoS\":%d},\"states\":\"",
+           mix[0] * per, mix[1] * per, mix[2] * per, mix[3] * per,
+           taskman_starving(t) ? "true" : "false", (unsigned)t.readyIdleMs, (unsigned)t.starveLongestMs, t.starveEvents, taskman_agoS(t.starveMs),
+           t.boosted ? "true" : "false", (unsigned)t.basePrio, t.boostEvents, taskman_agoS(t.boostMs));
+  return String(json) + hist + "\"";
+}
 
-function createChart() {
-  // === CPU Chart ===
-  const ctx = document.getElementById('cpuChart').getContext('2d');
-  cpuChart = new Chart(ctx, {
-    type: 'line',
-    data: {
-      labels: Array.from({ length: sampleCount }, (_, i) => i - sampleCount + 1),
-      datasets: [] // You can push CPU datasets dynamically
-    },
-    options: {
-      animation: false,
-      responsive: true,
-      layout: {
-      padding: {
-        right: 67   
-      }
-    },
-        
-  interaction: {
-    mode: 'nearest',    // hover on nearest point, not just direct hit
-    intersect: false,   // don't require pointer to be exactly on a line
-    axis: 'x'           // hover works along x-axis
-  },
-      scales: {
-        x: { title: { display: true, text: 'Seconds Ago' } },
-        y: {
-          beginAtZero: true,
-          max: 100,
-          title: { display: true, text: 'CPU %' }
-        }
-      },
-      plugins: {
-        legend: { position: 'bottom', labels: { boxWidth: 12 } }
-      }
+// Who is boosted right now, and the blocked tasks at that priority that could be waiting for it
+String taskman_inversionsJson() {
+  String json = "\"_inversions\":[";
+  bool first = true;
+  for (int i = 0; i < maxtaskCount; i++) {
+    const TaskSample& h = tasks[i];
+    if (!h.boosted) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"holder\":\"" + h.name + "\",\"base\":" + String(h.basePrio) + ",\"prio\":" + String(h.currentPrio) + ",\"waiting\":[";
+    bool firstWaiter = true;
+    for (int j = 0; j < maxtaskCount; j++) {
+      if (j == i || tasks[j].states.newest() != TM_BLOCKED || tasks[j].currentPrio != h.currentPrio) continue;
+      if (!firstWaiter) json += ",";
+      firstWaiter = false;
+      json += "\"" + tasks[j].name + "\"";
     }
-  });
+    json += "]}";
+  }
+  json += "]";
+  return json;
+}
+#endif
+
+#if TASKMAN_IPC
+// ---- Queues and mutexes ----
+// Register the queues and mutexes your pipeline hangs on.  Each sample records how many
+// messages a queue holds, or how long tasks waited in taskman_mutex_take() for a mutex,
+// so a consumer that is too slow (queue full) can be told from one that is starved of
+// input (queue empty).  Waits are only seen through taskman_mutex_take(), the stock
+// FreeRTOS build has no trace hooks to count them from.
+
+struct Watched {
+  char name[16];
+  QueueHandle_t handle = nullptr;         // a mutex is a queue underneath
+  bool isMutex = false;
+  uint16_t capacity = 0;                  // queues
+  SampleRing<uint16_t, SAMPLE_COUNT> value;  // queue: messages waiting, mutex: ms waited this sample
+  uint32_t samples = 0;                   // queues, since registered
+  uint64_t ms = 0, fullMs = 0, emptyMs = 0;  // and the time those covered, full and empty
+  TaskHandle_t holder = nullptr;          // mutex holder at the newest sample
+
+  // from taskman_mutex_take, any task on either core
+  uint32_t takes = 0;
+  uint32_t blocked = 0;                   // takes that had to wait
+  uint32_t timeouts = 0;
+  uint32_t waitUs = 0;                    // not yet sampled
+  uint64_t waitUsTotal = 0;
+  uint32_t waitUsMax = 0;
+};
+
+Watched watched[MAX_WATCHED];
+int watchedCount = 0;
+
+bool taskman_watch(QueueHandle_t handle, const char* name, bool isMutex) {
+  if (!handle || watchedCount >= MAX_WATCHED) return false;
+  Watched& w = watched[watchedCount];
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.name[sizeof(w.name) - 1] = 0;
+  w.isMutex = isMutex;
+  w.capacity = isMutex ? 1 : uxQueueMessagesWaiting(handle) + uxQueueSpacesAvailable(handle);
+  w.value.clear();
+  w.handle = handle;
+  watchedCount++;  // last, cpuMonitorTask only looks below watchedCount
+  return true;
+}
+
+bool taskman_watch_queue(QueueHandle_t q, const char* name) {
+  return taskman_watch(q, name, false);
+}
+
+bool taskman_watch_mutex(SemaphoreHandle_t m, const char* name) {
+  return taskman_watch(m, name, true);
+}
+
+Watched* taskman_findWatched(QueueHandle_t handle) {
+  for (int i = 0; i < watchedCount; i++) {
+    if (watched[i].handle == handle) return &watched[i];
+  }
+  return nullptr;
+}
+
+// xSemaphoreTake that counts the takes that had to wait and for how long.  Not for
+// recursive mutexes.
+BaseType_t taskman_mutex_take(SemaphoreHandle_t m, TickType_t timeout) {
+  Watched* w = taskman_findWatched(m);
+  if (!w) return xSemaphoreTake(m, timeout);
+
+  __atomic_fetch_add(&w->takes, 1, __ATOMIC_RELAXED);
+  if (xSemaphoreTake(m, 0) == pdTRUE) return pdTRUE;
+  if (timeout == 0) {
+    __atomic_fetch_add(&w->timeouts, 1, __ATOMIC_RELAXED);
+    return pdFALSE;
+  }
+
+  uint64_t start = nowUs();
+  BaseType_t ok = xSemaphoreTake(m, timeout);
+  uint32_t us = nowUs() - start;
+
+  __atomic_fetch_add(&w->blocked, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&w->waitUs, us, __ATOMIC_RELAXED);
+  if (!ok) __atomic_fetch_add(&w->timeouts, 1, __ATOMIC_RELAXED);
+  if (us > w->waitUsMax) w->waitUsMax = us;  // two cores racing here can lose a max, fine
+  return ok;
+}
+
+// Once per sample from cpuMonitorTask
+void taskman_ipcSample() {
+  for (int i = 0; i < watchedCount; i++) {
+    Watched& w = watched[i];
+    if (w.isMutex) {
+      uint32_t us = __atomic_exchange_n(&w.waitUs, 0, __ATOMIC_RELAXED);
+      w.waitUsTotal += us;
+      w.value.push(min(us / 1000, (uint32_t)0xFFFF));
+      w.holder = xSemaphoreGetMutexHolder(w.handle);
+    } else {
+      UBaseType_t n = uxQueueMessagesWaiting(w.handle);
+      w.value.push(min(n, (UBaseType_t)0xFFFF));
+      uint32_t ms = taskman_sampleMs();
+      w.samples++;
+      w.ms += ms;
+      if (n >= w.capacity) w.fullMs += ms;
+      if (n == 0) w.emptyMs += ms;
+    }
+  }
+}
+
+// "_ipc" for /dataInfo - the window in % of the time full/empty for queues, each sample
+// standing for the ms it covers, and the wait counts for mutexes
+String taskman_ipcJson() {
+  String json = "\"_ipc\":{";
+  char item[256];
+  for (int i = 0; i < watchedCount; i++) {
+    const Watched& w = watched[i];
+    if (w.isMutex) {
+      int slot = -1;
+      for (int j = 0; j < maxtaskCount; j++) {
+        if (w.holder && tasks[j].handle == w.holder) slot = j;
+      }
+      snprintf(item, sizeof(item),
+               "%s\"%s\":{\"kind\":\"mutex\",\"holder\":\"%.16s\",\"takes\":%u,\"blocked\":%u,\"timeouts\":%u,\"waitMsTotal\":%.1f,\"waitMsMax\":%.1f}",
+               i ? "," : "", w.name, slot >= 0 ? tasks[slot].name.c_str() : "", (unsigned)w.takes, (unsigned)w.blocked,
+               (unsigned)w.timeouts, w.waitUsTotal / 1000.0, w.waitUsMax / 1000.0);
+    } else {
+      // only the samples taken since it was registered, the rest of the ring is not a queue that was empty
+      int window = min(w.samples, (uint32_t)SAMPLE_COUNT);
+      uint32_t ms = 0, full = 0, empty = 0;
+      float sum = 0;
+      for (int j = 0; j < window; j++) {
+        uint16_t n = w.value.newest(j);
+        uint32_t dt = taskman_sampleMs(j);
+        ms += dt;
+        sum += (float)n * dt;
+        if (n >= w.capacity) full += dt;
+        if (n == 0) empty += dt;
+      }
+      float per = ms ? 1.0f / ms : 0;
+      // a queue that is mostly full has a slow consumer, mostly empty one that waits for input
+      const char* hint = !ms ? "" : full * 2 >= ms ? "consumer slow" : empty * 2 >= ms ? "consumer waiting for input" : "";
+      snprintf(item, sizeof(item),
+               "%s\"%s\":{\"kind\":\"queue\",\"cap\":%u,\"now\":%u,\"avg\":%.1f,\"fullPct\":%.0f,\"emptyPct\":%.0f,\"bootFullPct\":%.1f,\"bootEmptyPct\":%.1f,\"hint\":\"%s\"}",
+               i ? "," : "", w.name, w.capacity, w.value.newest(), sum * per, full * 100.0f * per,
+               empty * 100.0f * per, w.ms ? w.fullMs * 100.0 / w.ms : 0.0,
+               w.ms ? w.emptyMs * 100.0 / w.ms : 0.0, hint);
+    }
+    json += item;
+  }
+  json += "}";
+  return json;
+}
+#endif
+
+#if TASKMAN_METRICS
+// ---- Application metrics ----
+// Your own numbers on the same timeline as the cpu.  A counter is one atomic add into the
+// slot of the core it runs on, so the two cores never contend for it, and it is safe in
+// an ISR or a hot loop.  A gauge is one 32 bit store.  cpuMonitorTask adds the cores
+// up each sample, and a counter is recorded as its rate per second.
+
+typedef int taskman_metric_t;  // -1 when all MAX_METRICS are taken, and then updates do nothing
+
+struct Metrics {
+  volatile uint32_t counts[2][MAX_METRICS];  // counters, by core, only ever added to
+  volatile float gauge[MAX_METRICS];
+  char name[MAX_METRICS][16];
+  bool isGauge[MAX_METRICS];
+  uint32_t prevTotal[MAX_METRICS];           // counter at the last sample
+  uint32_t prevMs = 0;
+  SampleRing<float, SAMPLE_COUNT> value[MAX_METRICS];  // per second, or the gauge
+  volatile int used = 0;
+};
+
+DRAM_ATTR Metrics metrics;
+
+// Register once, at setup - the same name gives the same handle
+taskman_metric_t taskman_metric(const char* name, bool isGauge) {
+  for (int i = 0; i < metrics.used; i++) {
+    if (strncmp(metrics.name[i], name, sizeof(metrics.name[i]) - 1) == 0) return i;
+  }
+  if (metrics.used >= MAX_METRICS) return -1;
+  int h = metrics.used;
+  strncpy(metrics.name[h], name, sizeof(metrics.name[h]) - 1);
+  metrics.name[h][sizeof(metrics.name[h]) - 1] = 0;
+  metrics.isGauge[h] = isGauge;
+  metrics.prevTotal[h] = metrics.counts[0][h] + metrics.counts[1][h];
+  metrics.value[h].clear();
+  metrics.used = h + 1;  // last, cpuMonitorTask only looks below used
+  return h;
+}
+
+taskman_metric_t taskman_counter(const char* name) {
+  return taskman_metric(name, false);
+}
+
+taskman_metric_t taskman_gauge(const char* name) {
+  return taskman_metric(name, true);
+}
+
+static inline __attribute__((always_inline)) void taskman_counter_add(taskman_metric_t h, uint32_t n = 1) {
+  if (h >= 0) __atomic_fetch_add(&metrics.counts[xPortGetCoreID()][h], n, __ATOMIC_RELAXED);
+}
+
+static inline __attribute__((always_inline)) void taskman_gauge_set(taskman_metric_t h, float v) {
+  if (h >= 0) metrics.gauge[h] = v;
+}
+
+uint32_t taskman_counterTotal(int h) {
+  return metrics.counts[0][h] + metrics.counts[1][h];
+}
+
+// Once per sample from cpuMonitorTask, nowMs is the sample time
+void taskman_metricsSample(uint32_t nowMs) {
+  uint32_t dt = nowMs - metrics.prevMs;
+  for (int i = 0; i < metrics.used; i++) {
+    if (metrics.isGauge[i]) {
+      metrics.value[i].push(metrics.gauge[i]);
+      continue;
+    }
+    uint32_t total = taskman_counterTotal(i);
+    uint32_t delta = total - metrics.prevTotal[i];
+    metrics.prevTotal[i] = total;
+    metrics.value[i].push(metrics.prevMs && dt ? delta * 1000.0f / dt : 0);
+  }
+  metrics.prevMs = nowMs;
+}
+
+// "_metrics" for /dataInfo - the counter totals and the newest values
+String taskman_metricsJson() {
+  String json = "\"_metrics\":{";
+  char item[96];
+  for (int i = 0; i < metrics.used; i++) {
+    if (metrics.isGauge[i]) {
+      snprintf(item, sizeof(item), "%s\"%s\":{\"kind\":\"gauge\",\"value\":%.6g}", i ? "," : "", metrics.name[i], metrics.gauge[i]);
+    } else {
+      snprintf(item, sizeof(item), "%s\"%s\":{\"kind\":\"counter\",\"total\":%u,\"perSec\":%.6g}", i ? "," : "", metrics.name[i],
+               (unsigned)taskman_counterTotal(i), metrics.value[i].newest());
+    }
+    json += item;
+  }
+  json += "}";
+  return json;
+}
+#endif
+
+#define TASKMAN_CAT2(a, b) a##b
+#define TASKMAN_CAT(a, b) TASKMAN_CAT2(a, b)
+
+#if TASKMAN_REGIONS
+// ---- Code regions ----
+// TASKMAN_SCOPE("jpeg_encode"); times the rest of the block it is in with the cycle
+// counter.  A region keeps its calls and cycles per core since the last sample (one
+// atomic add each), the longest call and a histogram with a bucket per power of two
+// cycles, all in a static table.  cpuMonitorTask turns the cycles into % of a core,
+// like a task.  The cycle counters of the two cores don't agree, so a call that starts
+// on one core and ends on the other is dropped - pin the tasks you profile.  Not for
+// ISRs, the first pass through a scope registers it under a lock.  The scope itself is in
+// taskman_regions.h.
+
+#include "esp_cpu.h"
+#define TASKMAN_CYCLES() esp_cpu_get_cycle_count()
+#define TASKMAN_CORE_ID() xPortGetCoreID()
+#include "taskman_regions.h"
+
+struct Region : TaskmanRegionCounters {
+  char name[24];
+  uint64_t totalCalls, totalCycles;          // since boot, folded in each sample
+  float callsPerSec;
+  SampleRing<TASKMAN_SAMPLE_TYPE, SAMPLE_COUNT> usage;  // % of one core
+};
+
+Region regions[MAX_REGIONS];
+volatile int regionCount = 0;
+portMUX_TYPE regionsMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t regionsPrevMs = 0;
+uint32_t regionOverheadCycles = 0;  // an empty scope, from taskman_regionsBenchmark()
+
+// The region for name, registered the first time - nullptr when all MAX_REGIONS are taken
+Region* taskman_region(const char* name) {
+  Region* r = nullptr;
+  taskENTER_CRITICAL(&regionsMux);
+  for (int i = 0; i < regionCount; i++) {
+    if (strncmp(regions[i].name, name, sizeof(regions[i].name) - 1) == 0) r = &regions[i];
+  }
+  if (!r && regionCount < MAX_REGIONS) {
+    r = &regions[regionCount];
+    strncpy(r->name, name, sizeof(r->name) - 1);
+    r->name[sizeof(r->name) - 1] = 0;
+    regionCount = regionCount + 1;
+  }
+  taskEXIT_CRITICAL(&regionsMux);
+  return r;
+}
+
+#define TASKMAN_SCOPE(name) \
+  static Region* const TASKMAN_CAT(taskman_region_, __LINE__) = taskman_region(name); \
+  TaskmanScope TASKMAN_CAT(taskman_scope_, __LINE__)(TASKMAN_CAT(taskman_region_, __LINE__))
+
+// Once per sample from cpuMonitorTask, nowMs is the sample time.  The per-core cycles
+// are 32 bits, so a region busy for more than 2^32 cycles (18s at 240MHz) between two
+// samples wraps - only possible with very long sample intervals.
+void taskman_regionsSample(uint32_t nowMs) {
+  uint32_t dt = nowMs - regionsPrevMs;
+  float coreCycles = ESP.getCpuFreqMHz() * 1000.0f * dt;  // one core's cycles in the period
+  for (int i = 0; i < regionCount; i++) {
+    Region& r = regions[i];
+    uint32_t calls = __atomic_exchange_n(&r.calls[0], 0, __ATOMIC_RELAXED) + __atomic_exchange_n(&r.calls[1], 0, __ATOMIC_RELAXED);
+    uint64_t cycles = (uint64_t)__atomic_exchange_n(&r.cycles[0], 0, __ATOMIC_RELAXED) + __atomic_exchange_n(&r.cycles[1], 0, __ATOMIC_RELAXED);
+    r.totalCalls += calls;
+    r.totalCycles += cycles;
+    bool valid = regionsPrevMs && dt;
+    r.usage.push(SampleCodec<TASKMAN_SAMPLE_TYPE>::encode(valid ? cycles * 100.0f / coreCycles : 0));
+    r.callsPerSec = valid ? calls * 1000.0f / dt : 0;
+  }
+  regionsPrevMs = nowMs;
+}
+
+// What one TASKMAN_SCOPE costs on this chip, measured the first time /dataInfo asks
+void taskman_regionsBenchmark() {
+  static Region bench;
+  regionOverheadCycles = taskman_scopeOverhead(bench);
+}
+
+// "_regions" for /dataInfo - times in us, p50/p99 are the top of their power of two bucket
+String taskman_regionsJson() {
+  if (!regionOverheadCycles) taskman_regionsBenchmark();
+  float mhz = ESP.getCpuFreqMHz();
+  char item[224];
+  snprintf(item, sizeof(item), "\"_regions\":{\"overheadCycles\":%u,\"mhz\":%.0f,\"regions\":{", (unsigned)regionOverheadCycles, mhz);
+  String json = item;
+  for (int i = 0; i < regionCount; i++) {
+    const Region& r = regions[i];
+    float pct = 0;
+    uint32_t ms = 0;
+    for (int j = 0; j < SAMPLE_COUNT; j++) {
+      uint32_t dt = taskman_sampleMs(j);
+      pct += SampleCodec<TASKMAN_SAMPLE_TYPE>::decode(r.usage.newest(j)) * dt;
+      ms += dt;
+    }
+    if (ms) pct /= ms;
+    snprintf(item, sizeof(item),
+             "%s\"%s\":{\"calls\":%llu,\"perSec\":%.1f,\"pct\":%.2f,\"totalMs\":%.1f,\"avgUs\":%.2f,\"p50Us\":%.2f,\"p99Us\":%.2f,\"maxUs\":%.2f}",
+             i ? "," : "", r.name, (unsigned long long)r.totalCalls, r.callsPerSec, pct, r.totalCycles / mhz / 1000.0,
+             r.totalCalls ? r.totalCycles / mhz / r.totalCalls : 0.0, taskman_regionQuantile(r, 0.5f) / mhz,
+             taskman_regionQuantile(r, 0.99f) / mhz, r.maxCycles / mhz);
+    json += item;
+  }
+  json += "}}";
+  return json;
+}
+#else
+#define TASKMAN_SCOPE(name) \
+  do { \
+  } while (0)
+#endif
+
+#if TASKMAN_PROFILER
+// ---- PC sampling profiler ----
+// A gptimer interrupt on each core at PROFILE_HZ records the pc it interrupted and the
+// task that was running, for code that can't have a TASKMAN_SCOPE - libraries, the wifi
+// blobs.  The interrupted context is the frame the port saved on the task's stack, and
+// the first word of a TCB points at it.  Each core has its own ring (the ISR writes,
+// cpuMonitorTask reads) and cpuMonitorTask counts them by pc and task in a hash table.
+// Code that runs with interrupts masked is seen at the point they are unmasked.  Off
+// until taskman_profile_start() or /profile?start=1, and the buffers are allocated then.
+// /profile is symbolized by tools/taskman_profile.cpp.  The table is in taskman_profiler.h.
+
+#include "driver/gptimer.h"
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+#include "xtensa_context.h"
+#define TASKMAN_FRAME_PC(frame) (((XtExcFrame*)(frame))->pc)
+#else
+#include "riscv/rvruntime-frames.h"
+#define TASKMAN_FRAME_PC(frame) (((RvExcFrame*)(frame))->mepc)
+#endif
+
+#include "taskman_profiler.h"
+
+struct ProfileRing {
+  volatile uint32_t head;  // written by the ISR
+  volatile uint32_t tail;  // written by cpuMonitorTask
+  volatile uint32_t dropped;
+  uint32_t pc[PROFILE_RING];
+  TaskHandle_t task[PROFILE_RING];
+};
+
+struct Profiler {
+  ProfileRing* ring = nullptr;   // one per core
+  ProfileSlot* slots = nullptr;  // PROFILE_SLOTS
+  gptimer_handle_t timer[2] = { nullptr, nullptr };
+  SemaphoreHandle_t timerDone = nullptr;  // given by taskman_profileTimerTask when it is through
+  uint32_t hz = 0;
+  bool running = false;
+  uint32_t samples = 0;          // counted into slots
+  uint32_t overflow = 0;         // samples with no free slot
+  uint32_t startMs = 0;
+  volatile bool resetPending = false;  // set by taskman_profile_reset(), done by the drain
+};
+
+Profiler profiler;
+
+static bool IRAM_ATTR taskman_profileIsr(gptimer_handle_t timer, const gptimer_alarm_event_data_t* edata, void* arg) {
+  ProfileRing& r = profiler.ring[xPortGetCoreID()];
+  uint32_t head = r.head;
+  if (head - r.tail >= PROFILE_RING) {
+    r.dropped++;
+    return false;
+  }
+  TaskHandle_t t = xTaskGetCurrentTaskHandle();
+  uint32_t pc = xPortInterruptedFromISRContext() ? PROFILE_IN_ISR : TASKMAN_FRAME_PC(*(void**)t);
+  r.pc[head % PROFILE_RING] = pc;
+  r.task[head % PROFILE_RING] = t;
+  __atomic_store_n(&r.head, head + 1, __ATOMIC_RELEASE);
+  return false;
+}
+
+// Once per sample from cpuMonitorTask, empties both rings into the table.  Only this
+// task writes the table, so a reset is done here too, with what was still in the rings.
+void taskman_profileDrain() {
+  bool reset = profiler.resetPending;
+  if (reset) {
+    if (profiler.slots) memset(profiler.slots, 0, sizeof(ProfileSlot) * PROFILE_SLOTS);
+    profiler.samples = profiler.overflow = 0;
+    profiler.startMs = millis();
+    profiler.resetPending = false;
+  }
+  if (!profiler.ring) return;
+  for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) {
+    ProfileRing& r = profiler.ring[c];
+    uint32_t head = __atomic_load_n(&r.head, __ATOMIC_ACQUIRE);
+    if (reset) {
+      r.dropped = 0;
+      r.tail = head;
+      continue;
+    }
+    for (uint32_t k = r.tail; k != head; k++) {
+      TaskHandle_t h = r.task[k % PROFILE_RING];
+      uint8_t slot = 255;
+      for (int i = 0; i < maxtaskCount; i++) {
+        if (tasks[i].handle == h) slot = i;
+      }
+      if (taskman_profileAdd(profiler.slots, PROFILE_SLOTS, r.pc[k % PROFILE_RING], slot, c)) profiler.samples++;
+      else profiler.overflow++;
+    }
+    r.tail = head;
+  }
+}
+
+// Clears the counts at the next sample - cpuMonitorTask may be counting into the table now
+void taskman_profile_reset() {
+  profiler.resetPending = true;
+}
+
+// The timer interrupt goes to the core that registers the callback, so each core's timer
+// is set up from a short task pinned there
+void taskman_profileTimerTask(void* param) {
+  int core = (int)(intptr_t)param;
+  gptimer_config_t config = {};
+  config.clk_src = GPTIMER_CLK_SRC_DEFAULT;
+  config.direction = GPTIMER_COUNT_UP;
+  config.resolution_hz = 1000000;
+  gptimer_event_callbacks_t cbs = {};
+  cbs.on_alarm = taskman_profileIsr;
+  gptimer_handle_t timer = nullptr;
+  if (gptimer_new_timer(&config, &timer) != ESP_OK ||
+      gptimer_register_event_callbacks(timer, &cbs, nullptr) != ESP_OK ||
+      gptimer_enable(timer) != ESP_OK) {
+    Serial.printf("taskman profiler: no timer for core %d\n", core);
+    if (timer) gptimer_del_timer(timer);
+    timer = nullptr;
+  }
+  profiler.timer[core] = timer;
+  xSemaphoreGive(profiler.timerDone);
+  vTaskDelete(nullptr);
+}
+
+bool taskman_profile_start(uint32_t hz = PROFILE_HZ) {
+  if (profiler.running || hz < 10 || hz > 10000) return false;
+  if (!profiler.ring || !profiler.slots) {
+    free(profiler.ring);
+    free(profiler.slots);
+    profiler.ring = (ProfileRing*)heap_caps_calloc(2, sizeof(ProfileRing), MALLOC_CAP_INTERNAL);
+    profiler.slots = (ProfileSlot*)heap_caps_calloc(PROFILE_SLOTS, sizeof(ProfileSlot), MALLOC_CAP_INTERNAL);
+    if (!profiler.ring || !profiler.slots) {
+      Serial.println("Failed to allocate profiler buffers");
+      free(profiler.ring);
+      free(profiler.slots);
+      profiler.ring = nullptr;
+      profiler.slots = nullptr;
+      return false;
+    }
+  }
+  if (!profiler.timerDone) profiler.timerDone = xSemaphoreCreateBinary();
+  if (!profiler.timerDone) return false;
+  // A core whose timer is missing - first start, or an earlier try that failed - gets
+  // another go, and start waits for each task to say how it went
+  for (int c = 0; c < portNUM_PROCESSORS && c < 2; c++) {
+    if (profiler.timer[c]) continue;
+    if (xTaskCreatePinnedToCore(taskman_profileTimerTask, "TM_Profile", 2048, (void*)(intptr_t)c, 10, nullptr, c) != pdPASS) {
+      Serial.printf("taskman profiler: no task for core %d\n", c);
+      continue;
+    }
+    xSemaphoreTake(profiler.timerDone, pdMS_TO_TICKS(1000));
+  }
+
+  gptimer_alarm_config_t alarm = {};
+  alarm.alarm_count = 1000000 / hz;
+  alarm.reload_count = 0;
+  alarm.flags.auto_reload_on_alarm = 1;
+  bool any = false;
+  for (int c = 0; c < 2; c++) {
+    if (!profiler.timer[c]) continue;
+    gptimer_set_alarm_action(profiler.timer[c], &alarm);
+    any |= gptimer_start(profiler.timer[c]) == ESP_OK;
+  }
+  if (!any) return false;
+  profiler.hz = hz;
+  profiler.running = true;
+  profiler.startMs = millis();
+  return true;
+}
+
+void taskman_profile_stop() {
+  if (!profiler.running) return;
+  for (int c = 0; c < 2; c++) {
+    if (profiler.timer[c]) gptimer_stop(profiler.timer[c]);
+  }
+  profiler.running = false;
+}
+#endif
+
+
+#if TASKMAN_ISR_STATS
+// ---- Interrupt and esp_timer callback time ----
+// The run time counter charges an interrupt to the task it interrupted, so a busy GPIO or
+// I2S handler makes an innocent task look hot.  TASKMAN_ISR_SCOPE(src) at the top of your
+// own handler times it with the cycle counter, by source and core, and notes the task it
+// interrupted - cpuMonitorTask takes that time back off the task and keeps it as its own
+// series.  taskman_timer_create() is esp_timer_create() with the callback timed the same
+// way: a callback the esp_timer task runs is already that task's cpu and is only broken
+// down by name, an ESP_TIMER_ISR one is handled like an interrupt.  The system's own
+// interrupts (wifi, the tick) can't be hooked without rebuilding the IDF and stay in the
+// task they land on.  A timed interrupt nested in another timed one is counted in both.
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+
+struct IsrSource {
+  char name[16];
+  bool timer;                   // an esp_timer callback
+  bool inIsr;                   // runs in an interrupt, so it is taken off a task
+  volatile uint32_t calls[2];   // since the last sample, by core
+  volatile uint32_t cycles[2];
+  volatile uint32_t maxCycles;
+  uint64_t totalCalls, totalCycles;  // since boot, folded in each sample
+  float pct;                    // last sample, % of one core
+  float callsPerSec;
+};
+
+struct IsrTimer {  // the callback taskman_timer_create() wraps
+  esp_timer_cb_t callback;
+  void* arg;
+  int source;
+};
+
+struct IsrStats {
+  IsrSource source[MAX_ISR_SOURCES];
+  IsrTimer timer[MAX_ISR_SOURCES];
+  volatile int count = 0;
+  int timerCount = 0;
+  volatile uint32_t charged[2][MAX_TASKS];  // interrupt cycles by core and the task slot they interrupted
+};
+
+DRAM_ATTR IsrStats isrStats;
+portMUX_TYPE isrMux = portMUX_INITIALIZER_UNLOCKED;
+
+int taskman_isrRegister(const char* name, bool timer, bool inIsr) {
+  int id = -1;
+  taskENTER_CRITICAL(&isrMux);
+  for (int i = 0; i < isrStats.count; i++) {
+    if (strncmp(isrStats.source[i].name, name, sizeof(isrStats.source[i].name) - 1) == 0) id = i;
+  }
+  if (id < 0 && isrStats.count < MAX_ISR_SOURCES) {
+    id = isrStats.count;
+    IsrSource& s = isrStats.source[id];
+    strncpy(s.name, name, sizeof(s.name) - 1);
+    s.name[sizeof(s.name) - 1] = 0;
+    s.timer = timer;
+    s.inIsr = inIsr;
+    isrStats.count = isrStats.count + 1;
+  }
+  taskEXIT_CRITICAL(&isrMux);
+  return id;
+}
+
+// The id TASKMAN_ISR_SCOPE wants for an interrupt source, registered the first time -
+// call it from setup, not from the interrupt.  -1 when all MAX_ISR_SOURCES are taken,
+// and a scope with -1 does nothing.
+int taskman_isr_source(const char* name) {
+  return taskman_isrRegister(name, false, true);
+}
+
+void IRAM_ATTR taskman_isrDone(int source, int core, uint32_t d) {
+  if (source < 0 || xPortGetCoreID() != core) return;
+  IsrSource& s = isrStats.source[source];
+  __atomic_fetch_add(&s.calls[core], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s.cycles[core], d, __ATOMIC_RELAXED);
+  if (d > s.maxCycles) s.maxCycles = d;
+  if (!s.inIsr) return;
+  // in an interrupt the current task is the one it interrupted
+  TaskHandle_t t = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (tasks[i].handle == t) {
+      __atomic_fetch_add(&isrStats.charged[core][i], d, __ATOMIC_RELAXED);
+      return;
+    }
+  }
+}
+
+struct TaskmanIsrScope {
+  int source;
+  int core;
+  uint32_t start;
+
+  inline TaskmanIsrScope(int src)
+    : source(src), core(xPortGetCoreID()), start(esp_cpu_get_cycle_count()) {}
+  inline ~TaskmanIsrScope() {
+    taskman_isrDone(source, core, esp_cpu_get_cycle_count() - start);
+  }
+};
+
+#define TASKMAN_ISR_SCOPE(src) TaskmanIsrScope TASKMAN_CAT(taskman_isr_, __LINE__)(src)
+
+static void IRAM_ATTR taskman_isrTimerCallback(void* arg) {
+  IsrTimer* t = (IsrTimer*)arg;
+  TaskmanIsrScope scope(t->source);
+  t->callback(t->arg);
+}
+
+// esp_timer_create() with the callback timed under args->name.  With every slot taken
+// the timer is still created, just not timed.
+esp_err_t taskman_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+  bool inIsr = false;
+#if CONFIG_ESP_TIMER_SUPPORTS_ISR_DISPATCH_METHOD
+  inIsr = args->dispatch_method == ESP_TIMER_ISR;
+#endif
+  int source = taskman_isrRegister(args->name ? args->name : "esp_timer", true, inIsr);
+  int k = -1;
+  taskENTER_CRITICAL(&isrMux);
+  if (source >= 0 && isrStats.timerCount < MAX_ISR_SOURCES) k = isrStats.timerCount++;
+  taskEXIT_CRITICAL(&isrMux);
+  if (k < 0) return esp_timer_create(args, out);
+
+  isrStats.timer[k] = { args->callback, args->arg, source };
+  esp_timer_create_args_t wrapped = *args;
+  wrapped.callback = taskman_isrTimerCallback;
+  wrapped.arg = &isrStats.timer[k];
+  return esp_timer_create(&wrapped, out);
+}
+
+// What interrupts took from task slot idx since the last sample, in % of deltaTotal (the
+// run time counter, us) - cpuMonitorTask subtracts it from the task's usage
+float taskman_isrTaken(int idx, uint32_t deltaTotal) {
+  uint32_t cycles = __atomic_exchange_n(&isrStats.charged[0][idx], 0, __ATOMIC_RELAXED) +
+                    __atomic_exchange_n(&isrStats.charged[1][idx], 0, __ATOMIC_RELAXED);
+  if (!cycles || !deltaTotal) return 0;
+  return cycles / (float)ESP.getCpuFreqMHz() * 100.0f / deltaTotal;
+}
+
+// Once per sample from cpuMonitorTask, after the tasks - slot is this sample's place in
+// sysSamples
+void taskman_isrSample(int slot, uint32_t deltaTotal) {
+  float mhz = ESP.getCpuFreqMHz();
+  float isrPct[2] = { 0, 0 }, timerPct = 0;
+  for (int i = 0; i < isrStats.count; i++) {
+    IsrSource& s = isrStats.source[i];
+    uint32_t calls = __atomic_exchange_n(&s.calls[0], 0, __ATOMIC_RELAXED) + __atomic_exchange_n(&s.calls[1], 0, __ATOMIC_RELAXED);
+    uint32_t c0 = __atomic_exchange_n(&s.cycles[0], 0, __ATOMIC_RELAXED);
+    uint32_t c1 = __atomic_exchange_n(&s.cycles[1], 0, __ATOMIC_RELAXED);
+    s.totalCalls += calls;
+    s.totalCycles += (uint64_t)c0 + c1;
+    s.pct = deltaTotal ? ((float)c0 + c1) / mhz * 100.0f / deltaTotal : 0;
+    s.callsPerSec = deltaTotal ? calls * 1000000.0f / deltaTotal : 0;
+    if (s.inIsr) {
+      isrPct[0] += deltaTotal ? c0 / mhz * 100.0f / deltaTotal : 0;
+      isrPct[1] += deltaTotal ? c1 / mhz * 100.0f / deltaTotal : 0;
+    } else {
+      timerPct += s.pct;
+    }
+  }
+  for (int c = 0; c < 2; c++) sysSamples.isr.isr[c][slot] = min(isrPct[c] * 10.0f + 0.5f, 65535.0f);
+  sysSamples.isr.timer[slot] = min(timerPct * 10.0f + 0.5f, 65535.0f);
+}
+
+// "_isr" for /dataInfo
+String taskman_isrJson() {
+  float mhz = ESP.getCpuFreqMHz();
+  char item[224];
+  String json = "\"_isr\":{";
+  for (int i = 0; i < isrStats.count; i++) {
+    const IsrSource& s = isrStats.source[i];
+    snprintf(item, sizeof(item),
+             "%s\"%s\":{\"kind\":\"%s\",\"calls\":%llu,\"perSec\":%.1f,\"pct\":%.2f,\"totalMs\":%.1f,\"avgUs\":%.2f,\"maxUs\":%.2f}",
+             i ? "," : "", s.name, !s.timer ? "isr" : s.inIsr ? "timer_isr" : "timer", (unsigned long long)s.totalCalls,
+             s.callsPerSec, s.pct, s.totalCycles / mhz / 1000.0, s.totalCalls ? s.totalCycles / mhz / s.totalCalls : 0.0,
+             s.maxCycles / mhz);
+    json += item;
+  }
+  json += "}";
+  return json;
+}
+#else
+#define TASKMAN_ISR_SCOPE(src) \
+  do { \
+  } while (0)
+#define taskman_isr_source(name) (-1)
+#define taskman_timer_create(args, out) esp_timer_create(args, out)
+#endif
+
+#if TASKMAN_ALERTS
+// ---- Alerts ----
+// Leaks: free heap and the largest block are averaged over LEAK_ROLLUP_MS, and each
+// average is one point of a least squares line with exponentially decayed weights, so
+// it keeps a handful of sums rather than a history and follows a leak that starts late.
+// Where the line crosses LEAK_FLOOR_KB is the time to exhaustion.
+// CPU: each task keeps an ewma and ew variance of its usage, and a sample more than
+// ANOMALY_Z deviations (and ANOMALY_MIN_PCT) from it is an anomaly.
+
+struct TrendFit {
+  double w = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;  // decayed sums, x in hours
+  int points = 0;
+  float slope = 0;       // KB per hour
+  float level = 0;       // fitted KB at the newest point
+  float r2 = 0;
+  float hoursLeft = -1;  // -1 not shrinking
+
+  void add(double x, double y) {
+    w = w * LEAK_DECAY + 1;
+    sx = sx * LEAK_DECAY + x;
+    sy = sy * LEAK_DECAY + y;
+    sxx = sxx * LEAK_DECAY + x * x;
+    sxy = sxy * LEAK_DECAY + x * y;
+    syy = syy * LEAK_DECAY + y * y;
+    points++;
+
+    double vx = w * sxx - sx * sx;
+    double vy = w * syy - sy * sy;
+    double cxy = w * sxy - sx * sy;
+    if (points < 3 || vx <= 0) return;
+    slope = cxy / vx;
+    level = (sy - slope * sx) / w + slope * x;
+    r2 = vy > 0 ? cxy * cxy / (vx * vy) : 0;
+    hoursLeft = slope < 0 ? max(0.0f, (level - LEAK_FLOOR_KB) / -slope) : -1;
+  }
+
+  bool alarming() const {
+    return points >= LEAK_MIN_POINTS && slope < 0 && r2 >= 0.5f && hoursLeft < LEAK_ALERT_HOURS;
+  }
+};
+
+struct LeakWatch {
+  uint32_t sumRam = 0;
+  uint32_t sumLargest = 0;
+  uint32_t n = 0;
+  uint64_t startMs = 0;
+  TrendFit ram;
+  TrendFit largest;
+};
+
+LeakWatch leakWatch;
+
+// Once per sample from cpuMonitorTask, after the memory is in the ring.  The time is the
+// 64 bit esp_timer in ms, the 32 bit sample times wrap after 49.7 days and a leak watch
+// is meant to run that long.
+void taskman_leakSample() {
+  int pos = sysSamples.newest();
+  uint64_t nowMs = esp_timer_get_time() / 1000;
+  if (leakWatch.n == 0) leakWatch.startMs = nowMs;
+  leakWatch.sumRam += sysSamples.freeRam[pos];
+  leakWatch.sumLargest += sysSamples.largestBlock[pos];
+  leakWatch.n++;
+
+  if (nowMs - leakWatch.startMs < LEAK_ROLLUP_MS) return;
+
+  double hours = nowMs / 3600000.0;
+  leakWatch.ram.add(hours, (double)leakWatch.sumRam / leakWatch.n);
+  leakWatch.largest.add(hours, (double)leakWatch.sumLargest / leakWatch.n);
+  leakWatch.sumRam = leakWatch.sumLargest = leakWatch.n = 0;
+}
+
+// A sample that covers k nominal intervals gets the weight of k samples in a row, so the
+// ewma forgets at the same rate in time whatever adaptive sampling does to the spacing
+void taskman_anomalyAdd(int idx, float x) {
+  TaskSample& t = tasks[idx];
+  uint32_t ms = taskman_sampleMs();
+  if (t.ewMs >= ANOMALY_WARMUP * taskman_nominal_ms) {
+    float z = (x - t.ewMean) / max(sqrtf(t.ewVar), 0.5f);
+    if (fabsf(z) > ANOMALY_Z && fabsf(x - t.ewMean) > ANOMALY_MIN_PCT) {
+      t.anomalyPct = x;
+      t.anomalyZ = z;
+      t.anomalyMs = esp_timer_get_time() / 1000 | 1;
+    }
+  } else {
+    t.ewMs += ms;
+  }
+
+  float alpha = ms == taskman_nominal_ms ? ANOMALY_ALPHA : 1 - powf(1 - ANOMALY_ALPHA, (float)ms / taskman_nominal_ms);
+  float diff = x - t.ewMean;
+  float incr = alpha * diff;
+  t.ewMean += incr;
+  t.ewVar = (1 - alpha) * (t.ewVar + diff * incr);
+}
+
+bool taskman_anomalyActive(int idx) {
+  return tasks[idx].anomalyMs && esp_timer_get_time() / 1000 - tasks[idx].anomalyMs < ANOMALY_HOLD_MS;
+}
+
+String taskman_trendJson(const char* name, const TrendFit& f) {
+  char json[128];
+  snprintf(json, sizeof(json), "\"%s\":{\"points\":%d,\"slopeKBh\":%.2f,\"levelKB\":%.0f,\"r2\":%.2f,\"hoursLeft\":%.1f}",
+           name, f.points, f.slope, f.level, f.r2, f.hoursLeft);
+  return json;
+}
+
+// "_trend" always, "_alerts" with whatever is alarming now
+String taskman_alertsJson() {
+  String json = "\"_trend\":{" + taskman_trendJson("ram", leakWatch.ram) + "," + taskman_trendJson("largest", leakWatch.largest) + "}";
+  json += ",\"_alerts\":[";
+  bool first = true;
+  char item[160];
+
+  const TrendFit* fits[] = { &leakWatch.ram, &leakWatch.largest };
+  const char* names[] = { "ram", "largest" };
+  for (int k = 0; k < 2; k++) {
+    if (!fits[k]->alarming()) continue;
+    snprintf(item, sizeof(item), "%s{\"type\":\"leak\",\"series\":\"%s\",\"slopeKBh\":%.2f,\"hoursLeft\":%.1f}",
+             first ? "" : ",", names[k], fits[k]->slope, fits[k]->hoursLeft);
+    json += item;
+    first = false;
+  }
+
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (!taskman_anomalyActive(i)) continue;
+    snprintf(item, sizeof(item), "%s{\"type\":\"cpu\",\"task\":\"%.16s\",\"pct\":%.1f,\"z\":%.1f,\"mean\":%.1f,\"agoS\":%u}",
+             first ? "" : ",", tasks[i].name.c_str(), tasks[i].anomalyPct, tasks[i].anomalyZ, tasks[i].ewMean,
+             (unsigned)((esp_timer_get_time() / 1000 - tasks[i].anomalyMs) / 1000));
+    json += item;
+    first = false;
+  }
+
+  json += "]";
+  return json;
+}
+
+// Short text for the serial line, empty when all is well
+String taskman_alertsLine() {
+  String line;
+  char item[64];
+  if (leakWatch.ram.alarming()) {
+    snprintf(item, sizeof(item), " ram %.1fKB/h %.0fh left", leakWatch.ram.slope, leakWatch.ram.hoursLeft);
+    line += item;
+  }
+  if (leakWatch.largest.alarming()) {
+    snprintf(item, sizeof(item), " largest %.1fKB/h %.0fh left", leakWatch.largest.slope, leakWatch.largest.hoursLeft);
+    line += item;
+  }
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (!taskman_anomalyActive(i)) continue;
+    snprintf(item, sizeof(item), " %.16s %.0f%% z=%.1f", tasks[i].name.c_str(), tasks[i].anomalyPct, tasks[i].anomalyZ);
+    line += item;
+  }
+  return line.length() ? " | ALERT" + line : line;
+}
+#endif
+
+#if TASKMAN_ANNOTATIONS
+// ---- Annotations ----
+// A marker at a point in time, with the averages of the ANNOTATION_SAMPLES before it and,
+// once they have been sampled, the ANNOTATION_SAMPLES after it: the task's cpu, the busy %
+// of its core (100 - IDLE) and the sampler's own period error as a latency figure.
+
+struct Annotation {
+  uint32_t timeMs = 0;  // 0 unused
+  char text[48];
+  int slot = -1;        // task it is about, -1 for none
+  int core = -1;
+  int after = 0;        // samples seen since, final at ANNOTATION_SAMPLES
+  float cpu[2];         // before, after
+  float busy[2];
+  float jitterMs[2];
+};
+
+Annotation annotations[MAX_ANNOTATIONS];
+int nextAnnotation = 0;
+
+float taskman_coreBusy(int core, int back) {
+  char idle[8];
+  snprintf(idle, sizeof(idle), "IDLE%d", core);
+  int i = taskman_findTask(idle);
+  return i < 0 ? 0 : max(0.0f, 100.0f - tasks[i].last(back));
+}
+
+float taskman_jitterMs(int back) {
+  if constexpr (sysSamples.mon.enabled) return abs(sysSamples.mon.jitterUs[sysSamples.newest(back)]) / 1000.0f;
+  return 0;
+}
+
+// Mark now on the graph, about the task in slot (or -1)
+void taskman_annotateSlot(const char* text, int slot) {
+  Annotation& a = annotations[nextAnnotation];
+  nextAnnotation = (nextAnnotation + 1) % MAX_ANNOTATIONS;
+
+  a.timeMs = 0;
+  strncpy(a.text, text, sizeof(a.text) - 1);
+  a.text[sizeof(a.text) - 1] = 0;
+  a.slot = slot;
+  a.core = slot >= 0 && (tasks[slot].core == 0 || tasks[slot].core == 1) ? tasks[slot].core : 0;
+  a.after = 0;
+  a.cpu[0] = a.busy[0] = a.jitterMs[0] = 0;
+  a.cpu[1] = a.busy[1] = a.jitterMs[1] = 0;
+  for (int k = 0; k < ANNOTATION_SAMPLES; k++) {
+    if (slot >= 0) a.cpu[0] += tasks[slot].last(k) / ANNOTATION_SAMPLES;
+    a.busy[0] += taskman_coreBusy(a.core, k) / ANNOTATION_SAMPLES;
+    a.jitterMs[0] += taskman_jitterMs(k) / ANNOTATION_SAMPLES;
+  }
+  a.timeMs = millis() | 1;  // last, cpuMonitorTask skips it until then
+}
+
+// Your own markers - "wifi reconnect", "ota start" ...
+void taskman_annotate(const char* text) {
+  taskman_annotateSlot(text, -1);
+}
+
+// Once per sample from cpuMonitorTask, fills in the after half
+void taskman_annotationSample() {
+  for (int i = 0; i < MAX_ANNOTATIONS; i++) {
+    Annotation& a = annotations[i];
+    if (!a.timeMs || a.after >= ANNOTATION_SAMPLES) continue;
+    if (a.slot >= 0) a.cpu[1] += tasks[a.slot].last() / ANNOTATION_SAMPLES;
+    a.busy[1] += taskman_coreBusy(a.core, 0) / ANNOTATION_SAMPLES;
+    a.jitterMs[1] += taskman_jitterMs(0) / ANNOTATION_SAMPLES;
+    a.after++;
+  }
+}
+
+String taskman_annotationJson(const Annotation& a) {
+  char json[640], text[sizeof(a.text) * 6], task[16 * 6 + 1];
+  bool done = a.after >= ANNOTATION_SAMPLES;
+  snprintf(json, sizeof(json),
+           "{\"t\":%u,\"text\":\"%s\",\"task\":\"%s\",\"done\":%s,\"cpu\":[%.1f,%.1f],\"busy\":[%.1f,%.1f],\"jitterMs\":[%.2f,%.2f]}",
+           a.timeMs, taskman_jsonEscape(a.text, text, sizeof(text)),
+           taskman_jsonEscape(a.slot >= 0 ? tasks[a.slot].name.c_str() : "", task, sizeof(task)), done ? "true" : "false",
+           a.cpu[0], done ? a.cpu[1] : 0, a.busy[0], done ? a.busy[1] : 0, a.jitterMs[0], done ? a.jitterMs[1] : 0);
+  return json;
+}
+#endif
+
+#if TASKMAN_BALANCE
+// ---- Core balance ----
+// Every BALANCE_EVERY samples the average load (over time, not samples) of each task on
+// each core is packed onto the two cores again: the tasks that can move (not in
+// TASKMAN_BALANCE_FIXED) go largest first onto the emptier core, then the moves are taken
+// back smallest first while the peak stays within BALANCE_SLACK, so the plan is the
+// fewest moves for about the best peak.  The fixed tasks, and the time no task accounts
+// for (interrupts), stay put.
+
+struct BalancePlan {
+  uint32_t timeMs = 0;       // 0 none yet
+  float actual[2];           // busy % of each core over the window (100 - IDLE)
+  float projected[2];        // the same after the moves
+  int moves = 0;
+  int8_t target[MAX_TASKS];  // core to pin the slot to, -1 leave it
+  float load[MAX_TASKS];     // window average, both cores together
+};
+
+struct Balance {
+  float sum[2][MAX_TASKS];   // corePct times the ms each sample covers, since the last plan
+  int samples = 0;
+  uint32_t ms = 0;
+  int order[MAX_TASKS];      // movable slots, heaviest first
+  BalancePlan plan;
+  bool (*apply)(TaskHandle_t h, const char* name, int core) = nullptr;
+};
+
+Balance balance;
+
+bool taskman_balanceMovable(int i) {
+  return !taskman_inList(TASKMAN_BALANCE_FIXED, tasks[i].name);
+}
+
+void taskman_balancePlan() {
+  BalancePlan& p = balance.plan;
+  float n = balance.ms;
+  p.timeMs = 0;  // readers skip it until it is finished
+
+  float proj[2];
+  for (int c = 0; c < 2; c++) {
+    char idle[8];
+    snprintf(idle, sizeof(idle), "IDLE%d", c);
+    int k = taskman_findTask(idle);
+    p.actual[c] = k < 0 ? 0 : max(0.0f, 100.0f - balance.sum[c][k] / n);
+    proj[c] = p.actual[c];
+  }
+
+  // take the movable tasks out, what is left is fixed
+  int count = 0;
+  for (int i = 0; i < maxtaskCount; i++) {
+    p.target[i] = -1;
+    p.load[i] = (balance.sum[0][i] + balance.sum[1][i]) / n;
+    if (p.load[i] < BALANCE_MIN_PCT || !taskman_balanceMovable(i)) continue;
+    proj[0] -= balance.sum[0][i] / n;
+    proj[1] -= balance.sum[1][i] / n;
+    balance.order[count++] = i;
+  }
+  std::sort(balance.order, balance.order + count, [&](int a, int b) { return p.load[a] > p.load[b]; });
+
+  // largest first onto the emptier core
+  for (int k = 0; k < count; k++) {
+    int i = balance.order[k];
+    int c = proj[0] <= proj[1] ? 0 : 1;
+    p.target[i] = c;
+    proj[c] += p.load[i];
+  }
+
+  // then back where it was, smallest first, whenever that costs nothing much
+  float best = max(proj[0], proj[1]);
+  for (int k = count - 1; k >= 0; k--) {
+    int i = balance.order[k];
+    float back[2] = { proj[0] + balance.sum[0][i] / n, proj[1] + balance.sum[1][i] / n };
+    back[p.target[i]] -= p.load[i];
+    if (max(back[0], back[1]) > best + BALANCE_SLACK) continue;
+    p.target[i] = -1;
+    proj[0] = back[0];
+    proj[1] = back[1];
+  }
+
+  p.moves = 0;
+  for (int k = 0; k < count; k++) {
+    if (p.target[balance.order[k]] >= 0) p.moves++;
+  }
+  if (max(p.actual[0], p.actual[1]) - max(proj[0], proj[1]) < BALANCE_MIN_GAIN) {
+    for (int k = 0; k < count; k++) p.target[balance.order[k]] = -1;
+    p.moves = 0;
+    proj[0] = p.actual[0];
+    proj[1] = p.actual[1];
+  }
+  p.projected[0] = max(0.0f, proj[0]);
+  p.projected[1] = max(0.0f, proj[1]);
+
+  memset(balance.sum, 0, sizeof(balance.sum));
+  balance.samples = 0;
+  balance.ms = 0;
+  p.timeMs = millis() | 1;
+}
+
+// Once per sample from cpuMonitorTask, after the core split
+void taskman_balanceSample() {
+  if (portNUM_PROCESSORS < 2) return;
+  uint32_t ms = taskman_sampleMs();
+  for (int i = 0; i < maxtaskCount; i++) {
+    balance.sum[0][i] += tasks[i].corePct[0] * ms;
+    balance.sum[1][i] += tasks[i].corePct[1] * ms;
+  }
+  balance.ms += ms;
+  if (++balance.samples >= BALANCE_EVERY) taskman_balancePlan();
+}
+
+// Only the SMP FreeRTOS build can change the core of a running task
+bool taskman_balanceSetAffinity(TaskHandle_t h, const char* name, int core) {
+#if defined(configUSE_CORE_AFFINITY) && configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+  vTaskCoreAffinitySet(h, 1 << core);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// On the usual IDF build your code has to make the move - restart that task pinned to
+// core, and return true if it did
+void taskman_balance_set_apply(bool (*fn)(TaskHandle_t h, const char* name, int core)) {
+  balance.apply = fn;
+}
+
+bool taskman_balanceCanApply() {
+#if defined(configUSE_CORE_AFFINITY) && configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+  return true;
+#else
+  return balance.apply != nullptr;
+#endif
+}
+
+// Make the moves of the newest plan, returns how many were made.  Nothing calls this
+// unless you do.
+int taskman_balance_apply() {
+  const BalancePlan& p = balance.plan;
+  if (!p.timeMs) return 0;
+  int made = 0;
+  for (int i = 0; i < maxtaskCount; i++) {
+    int c = p.target[i];
+    if (c < 0 || tasks[i].core == c) continue;
+    TaskHandle_t h = taskman_handleForNumber(tasks[i].taskNumber);
+    if (!h) continue;
+    bool ok = balance.apply ? balance.apply(h, tasks[i].name.c_str(), c) : taskman_balanceSetAffinity(h, tasks[i].name.c_str(), c);
+    if (!ok) continue;
+    made++;
+
+    char text[48];
+    snprintf(text, sizeof(text), "%.16s to core %d", tasks[i].name.c_str(), c);
+#if TASKMAN_ANNOTATIONS
+    taskman_annotateSlot(text, i);
+#endif
+    Serial.printf("taskman balance: %s\n", text);
+  }
+  return made;
+}
+
+String taskman_balanceJson() {
+  const BalancePlan& p = balance.plan;
+  if (!p.timeMs) return "\"_balance\":null";
+
+  char item[128];
+  snprintf(item, sizeof(item), "\"_balance\":{\"agoS\":%u,\"canApply\":%s,\"actual\":[%.1f,%.1f],\"projected\":[%.1f,%.1f],\"moves\":[",
+           (unsigned)((millis() - p.timeMs) / 1000), taskman_balanceCanApply() ? "true" : "false",
+           p.actual[0], p.actual[1], p.projected[0], p.projected[1]);
+  String json = item;
+  bool first = true;
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (p.target[i] < 0) continue;
+    int from = (tasks[i].core == 0 || tasks[i].core == 1) ? tasks[i].core : -1;
+    snprintf(item, sizeof(item), "%s{\"task\":\"%.16s\",\"pct\":%.1f,\"from\":%d,\"to\":%d}",
+             first ? "" : ",", tasks[i].name.c_str(), p.load[i], from, p.target[i]);
+    json += item;
+    first = false;
+  }
+  json += "]}";
+  return json;
+}
+#endif
+
+// Every cpu sample goes through here so the statistics see what the ring sees
+void taskman_pushUsage(int idx, float usage) {
+#if TASKMAN_ALERTS
+  taskman_anomalyAdd(idx, usage);
+#endif
+  tasks[idx].push(usage);
+#if TASKMAN_TASK_STATS
+  taskman_statsAdd(idx, tasks[idx].last());
+#endif
+}
+
+// Clear every ring together so the cpu and memory columns stay aligned
+void taskman_resetSamples() {
+  for (int j = 0; j < maxtaskCount; j++) {
+    tasks[j].usage.clear();
+#if TASKMAN_STATE_HISTORY
+    tasks[j].states.clear();
+#endif
+  }
+#if TASKMAN_METRICS
+  for (int i = 0; i < metrics.used; i++) metrics.value[i].clear();
+#endif
+#if TASKMAN_REGIONS
+  for (int i = 0; i < regionCount; i++) regions[i].usage.clear();
+#endif
+  sysSamples.clear();
+#if TASKMAN_TRIGGERS
+  taskman_finishCapture();  // a post window can't span two rates
+#endif
+}
+
+#if TASKMAN_ADAPTIVE
+// ---- Adaptive sampling ----
+// Off until taskman_set_adaptive().  Each sample is compared with the one before, and a task
+// that moved ADAPTIVE_CPU_STEP % or free ram that moved ADAPTIVE_HEAP_STEP_KB drops the
+// interval to fastMs.  After ADAPTIVE_HOLD quiet samples it doubles each sample, back up to
+// baseMs - or idleMs when nothing has fetched /data, /dataInfo or /export.csv for
+// ADAPTIVE_VIEWER_MS.  Every sample keeps its own time, so the spacing just gets uneven.
+struct AdaptiveSampling {
+  volatile bool enabled = false;
+  uint32_t fastMs = 250;
+  uint32_t baseMs = 2000;
+  uint32_t idleMs = 0;     // 0 stays at baseMs with nobody watching
+  int quiet = 0;           // samples since the last change
+  uint32_t changes = 0;    // times it went fast
+  volatile uint64_t lastViewUs = 0;
+};
+
+AdaptiveSampling adaptive;
+
+bool taskman_set_adaptive(uint32_t fastMs, uint32_t baseMs, uint32_t idleMs = 0) {
+  if (fastMs < 50 || fastMs > baseMs || baseMs > 60000) return false;
+  if (idleMs && (idleMs < baseMs || idleMs > 60000)) return false;
+  adaptive.fastMs = fastMs;
+  adaptive.baseMs = baseMs;
+  adaptive.idleMs = idleMs;
+  adaptive.quiet = 0;
+  adaptive.enabled = true;
+  return true;
+}
+
+// back to the fixed taskman_sample_interval_ms
+void taskman_adaptive_off() {
+  adaptive.enabled = false;
+}
+
+void taskman_adaptiveViewed() {
+  adaptive.lastViewUs = nowUs();
+}
+
+bool taskman_adaptiveWatched() {
+  return adaptive.lastViewUs && nowUs() - adaptive.lastViewUs < (uint64_t)ADAPTIVE_VIEWER_MS * 1000;
+}
+
+// Interval to the next sample, from how far the newest one moved from the one before
+uint32_t taskman_adaptiveNext(uint32_t current) {
+  if (!adaptive.enabled) return taskman_sample_interval_ms;
+
+  int now = sysSamples.newest(), before = sysSamples.newest(1);
+  bool changed = false;
+  if (sysSamples.timeMs[before]) {
+    changed = abs((int)sysSamples.freeRam[now] - (int)sysSamples.freeRam[before]) >= ADAPTIVE_HEAP_STEP_KB;
+    for (int i = 0; i < maxtaskCount && !changed; i++) changed = fabsf(tasks[i].last(0) - tasks[i].last(1)) >= ADAPTIVE_CPU_STEP;
+  }
+
+  if (changed) {
+    if (current > adaptive.fastMs) adaptive.changes++;
+    adaptive.quiet = 0;
+    return adaptive.fastMs;
+  }
+  uint32_t base = adaptive.idleMs && !taskman_adaptiveWatched() ? adaptive.idleMs : adaptive.baseMs;
+  if (current > base) return base;  // someone started watching
+  if (++adaptive.quiet < ADAPTIVE_HOLD) return current;
+  return min(current * 2, base);
+}
+#else
+inline void taskman_adaptiveViewed() {}
+#endif
+
+// Change the sampling interval at runtime, cpuMonitorTask applies it and resets the rings.
+// A fixed interval turns adaptive sampling off.
+bool taskman_set_sample_interval(uint32_t ms) {
+  if (ms < 50 || ms > 60000) return false;
+#if TASKMAN_ADAPTIVE
+  taskman_adaptive_off();
+#endif
+  taskman_pending_interval_ms = ms;
+  return true;
+}
+
+#if TASKMAN_BURST
+// Record hz samples per second for ms milliseconds into the burst buffer, see /burst.
+// hz has to divide 1000 and the tick rate evenly, 300 would really be 333.
+bool taskman_start_burst(uint32_t hz, uint32_t ms) {
+  if (burst.running || burst.requested) return false;
+  if (hz < 1 || hz > configTICK_RATE_HZ) return false;
+  if (1000 % hz || configTICK_RATE_HZ % hz) return false;  // a whole number of ms and ticks apart
+
+  uint32_t intervalMs = 1000 / hz;
+  int target = (int)((uint64_t)ms * hz / 1000);
+  if (target < 1) return false;
+  if (target > BURST_MAX_SAMPLES) target = BURST_MAX_SAMPLES;
+
+  if (!burst.usage) {
+    size_t bytes = sizeof(uint16_t) * BURST_MAX_SAMPLES * MAX_TASKS;
+    burst.usage = (uint16_t*)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+    if (!burst.usage) {
+      Serial.println("Failed to allocate burst buffer");
+      return false;
+    }
+  }
+
+  burst.intervalMs = intervalMs;
+  burst.target = target;
+  burst.count = 0;
+  burst.ready = false;
+  burst.requested = true;
+  return true;
+}
+
+// Runs inside cpuMonitorTask - the regular ring just has a gap afterwards
+void taskman_runBurst() {
+  burst.requested = false;
+  burst.running = true;
+  memset(burst.usage, 0, sizeof(uint16_t) * BURST_MAX_SAMPLES * MAX_TASKS);
+
+  uint32_t burstPrevTotal = 0;
+  uint32_t totalRunTime;
+  UBaseType_t numReturned = uxTaskGetSystemState(taskStatusArray, MAX_TASKS, &totalRunTime);
+  for (uint32_t i = 0; i < numReturned; i++) {
+    int idx = taskman_findTask(taskStatusArray[i].pcTaskName);
+    if (idx >= 0) burst.prevRunTime[idx] = taskStatusArray[i].ulRunTimeCounter;
+  }
+  burstPrevTotal = totalRunTime;
+  burst.startUs = nowUs();
+
+  TickType_t lastWake = xTaskGetTickCount();
+  TickType_t period = pdMS_TO_TICKS(burst.intervalMs);
+  if (period == 0) period = 1;
+
+  while (burst.count < burst.target) {
+    vTaskDelayUntil(&lastWake, period);
+
+    numReturned = uxTaskGetSystemState(taskStatusArray, MAX_TASKS, &totalRunTime);
+    uint32_t deltaTotal = totalRunTime - burstPrevTotal;
+    burstPrevTotal = totalRunTime;
+    if (numReturned == 0 || deltaTotal == 0) continue;
+
+    uint16_t* row = &burst.usage[burst.count * MAX_TASKS];
+    for (uint32_t i = 0; i < numReturned; i++) {
+      TaskStatus_t* t = &taskStatusArray[i];
+      int idx = taskman_findTask(t->pcTaskName);
+      if (idx < 0) continue;
+
+      TaskmanRunTimeStep step = taskman_runTimeStep(t->ulRunTimeCounter, burst.prevRunTime[idx], deltaTotal);
+      burst.prevRunTime[idx] = step.prev;
+      row[idx] = (uint16_t)((uint64_t)step.delta * 1000 / deltaTotal);
+    }
+    burst.count++;
+  }
+
+  burst.running = false;
+  burst.ready = true;
+}
+#endif
+
+// The per task state taskman_sampleTasks() works on, and what else happens to a task each sample
+struct TaskmanSlots {
+  static constexpr int capacity = MAX_TASKS;
+  uint32_t deltaTotal;
+
+  int count() { return maxtaskCount; }
+  int find(const char* name) { return taskman_findTask(name); }
+
+  int add(const TaskStatus_t& t) {
+    if (maxtaskCount >= MAX_TASKS) return -1;
+    int idx = maxtaskCount++;
+    tasks[idx].name = t.pcTaskName;
+#if TASKMAN_LASTGASP
+    taskman_lastGaspName(idx, t.pcTaskName);
+#endif
+    tasks[idx].active = true;
+    tasks[idx].prevRunTime = t.ulRunTimeCounter;
+    tasks[idx].usage.clear();
+#if TASKMAN_TASK_STATS
+    taskman_statsReset(idx);
+#endif
+#if TASKMAN_STATE_HISTORY
+    taskman_stateReset(idx);
+#endif
+    return idx;
+  }
+
+  bool sameTask(int idx, const TaskStatus_t& t) { return !tasks[idx].handle || tasks[idx].handle == t.xHandle; }
+  uint32_t& prevRunTime(int idx) { return tasks[idx].prevRunTime; }
+
+  void sampled(int idx, const TaskStatus_t& t, float usage, const TaskmanRunTimeStep&) {
+#if TASKMAN_CORE_SPLIT
+    taskman_coreSplitHandle(idx, t.xHandle);
+#endif
+#if TASKMAN_ISR_STATS
+    usage = max(usage - taskman_isrTaken(idx, deltaTotal), 0.0f);
+#endif
+    taskman_pushUsage(idx, usage);
+
+    // Update system info
+    tasks[idx].taskNumber = t.xTaskNumber;
+    tasks[idx].handle = t.xHandle;
+    tasks[idx].state = t.eCurrentState;
+    tasks[idx].currentPrio = t.uxCurrentPriority;
+    tasks[idx].basePrio = t.uxBasePriority;
+    tasks[idx].runTime = t.ulRunTimeCounter;
+    tasks[idx].stackHighWater = t.usStackHighWaterMark;
+    tasks[idx].core = t.xCoreID;
+    if (usage > 2.0f) tasks[idx].over2 = true;
+#if TASKMAN_CORE_SPLIT
+    taskman_splitCores(idx, usage);
+#endif
+#if TASKMAN_STATE_HISTORY
+    taskman_stateSample(idx, taskman_packState(t.eCurrentState), usage);
+#endif
+  }
+
+  // not in the snapshot - deleted, or not created again yet
+  void missing(int idx) {
+    taskman_pushUsage(idx, 0.0f);
+    tasks[idx].corePct[0] = tasks[idx].corePct[1] = 0;
+#if TASKMAN_STATE_HISTORY
+    taskman_stateSample(idx, TM_STOPPED, 0.0f);
+#endif
+  }
+};
+
+// New starting counters for the next sample, after a pause in the regular sampling - so it
+// covers its own period and not the burst or interval change before it too
+void taskman_runTimeBaseline() {
+  uint32_t totalRunTime;
+  UBaseType_t numReturned = uxTaskGetSystemState(taskStatusArray, MAX_TASKS, &totalRunTime);
+  if (numReturned == 0) return;
+  prevTotalRunTime = totalRunTime;
+  for (uint32_t i = 0; i < numReturned; i++) {
+    int idx = taskman_findTask(taskStatusArray[i].pcTaskName);
+    if (idx >= 0) tasks[idx].prevRunTime = taskStatusArray[i].ulRunTimeCounter;
+  }
+}
+
+void cpuMonitorTask(void* param) {
+  Serial.println("cpuMonitor started ...");
+
+  // Allocate system state array once
+  if (!taskStatusArray) {
+    taskStatusArray = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * MAX_TASKS);
+    if (!taskStatusArray) {
+      Serial.println("Failed to allocate taskStatusArray");
+      vTaskDelete(nullptr);
+      return;
+    }
+  }
+
+  // fixed schedule - the work done each period doesn't push the next sample later
+  TickType_t lastWake = xTaskGetTickCount();
+  uint64_t prevStartUs = 0;
+  uint32_t spanMs = 0;  // scheduled time since the last sample that was kept
+
+  for (;;) {
+    uint32_t periodMs = taskman_period_ms;
+    TickType_t period = pdMS_TO_TICKS(periodMs);
+    if (period == 0) period = 1;
+
+    // if we are already past the next deadline, skip the lost periods rather than catch up
+    uint8_t missed = 0;
+    uint32_t lost = 0;
+    TickType_t late = xTaskGetTickCount() - lastWake;
+    if (late >= period) {
+      lost = late / period;
+      missed = min(lost, (uint32_t)255);
+      sysSamples.mon.missedTotal += lost;
+      lastWake += lost * period;
+    }
+    vTaskDelayUntil(&lastWake, period);
+    spanMs += periodMs * (lost + 1);
+
+    if (taskman_pending_interval_ms) {
+      taskman_sample_interval_ms = taskman_pending_interval_ms;
+      taskman_period_ms = taskman_sample_interval_ms;
+      taskman_pending_interval_ms = 0;
+      taskman_resetSamples();
+      taskman_runTimeBaseline();
+      lastWake = xTaskGetTickCount();
+      prevStartUs = 0;
+      spanMs = 0;
+      continue;
+    }
+
+#if TASKMAN_BURST
+    if (burst.requested) {
+      taskman_runBurst();
+      taskman_runTimeBaseline();
+      lastWake = xTaskGetTickCount();
+      prevStartUs = 0;
+      spanMs = 0;
+      continue;
+    }
+#endif
+
+    taskman_nominal_ms = taskman_sample_interval_ms;
+#if TASKMAN_ADAPTIVE
+    if (adaptive.enabled) taskman_nominal_ms = adaptive.baseMs;
+#endif
+
+    // ── Snapshot cpu and memory together ───────────────────────────
+    uint64_t startUs = nowUs();
+    uint32_t totalRunTime;
+    UBaseType_t numReturned = uxTaskGetSystemState(taskStatusArray, MAX_TASKS, &totalRunTime);
+    uint32_t snapshotUs = nowUs() - startUs;
+
+    if (numReturned == 0 || totalRunTime == prevTotalRunTime) continue;
+
+    int slot = sysSamples.index;
+    sysSamples.freeRam[slot] = min(ESP.getFreeHeap() / 1024, (uint32_t)0xFFFF);
+    sysSamples.freePSRam[slot] = min(ESP.getFreePsram() / 1024, (uint32_t)0xFFFF);
+    sysSamples.largestBlock[slot] = min(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) / 1024, (size_t)0xFFFF);
+    sysSamples.timeMs[slot] = startUs / 1000;
+    sysSamples.spanMs[slot] = min(spanMs, (uint32_t)0xFFFF);
+    spanMs = 0;
+    if constexpr (sysSamples.clock.enabled) sysSamples.clock.epochMs[slot] = taskman_epochMs();
+    if constexpr (sysSamples.mon.enabled) {
+      sysSamples.mon.snapshotUs[slot] = snapshotUs;
+      sysSamples.mon.jitterUs[slot] = prevStartUs ? (int32_t)(startUs - prevStartUs) - (int32_t)periodMs * 1000 : 0;
+      sysSamples.mon.missed[slot] = missed;
+    }
+    sysSamples.index = (sysSamples.index + 1) % SAMPLE_COUNT;
+    prevStartUs = startUs;
+
+    uint32_t deltaTotal = totalRunTime - prevTotalRunTime;
+    prevTotalRunTime = totalRunTime;
+
+    // ── Every task's % of the period, 0 for the ones that are gone ──
+    TaskmanSlots slots{ deltaTotal };
+    taskman_sampleTasks(taskStatusArray, numReturned, deltaTotal, slots);
+
+#if TASKMAN_ISR_STATS
+    taskman_isrSample(slot, deltaTotal);
+#endif
+#if TASKMAN_TRIGGERS
+    taskman_checkTriggers();
+#endif
+#if TASKMAN_ALERTS
+    taskman_leakSample();
+#endif
+#if TASKMAN_ANNOTATIONS
+    taskman_annotationSample();
+#endif
+#if TASKMAN_BALANCE
+    taskman_balanceSample();
+#endif
+#if TASKMAN_IPC
+    taskman_ipcSample();
+#endif
+#if TASKMAN_METRICS
+    taskman_metricsSample(startUs / 1000);
+#endif
+#if TASKMAN_REGIONS
+    taskman_regionsSample(startUs / 1000);
+#endif
+#if TASKMAN_PROFILER
+    taskman_profileDrain();
+#endif
+#if TASKMAN_LASTGASP
+    taskman_lastGaspSample();
+#endif
+
+#if TASKMAN_UDP_EXPORT
+    taskman_exportSample();
+#endif
+
+#if TASKMAN_PERSIST
+    taskman_persistSample();
+#endif
+#if TASKMAN_ADAPTIVE
+    taskman_period_ms = taskman_adaptiveNext(periodMs);
+#endif
+
+    if constexpr (sysSamples.mon.enabled) sysSamples.mon.execUs[slot] = nowUs() - startUs;
+  }
+}
+
+#if TASKMAN_FAKE_LOAD
+// ---- Workloads with a known answer ----
+// Each workload is a task (two for mutex and queue) doing a fixed amount of work, so what
+// taskman should show is known before it starts: a cpu workload spins busyUs of every
+// period, each task of a mutex pair holds the mutex and spins busyUs of every period, a
+// queue consumer spins busyUs per message.  Spins are timed with esp_timer, so the answer
+// holds while nothing of a higher priority shares the core.  Alloc sizes and the demo's
+// bursts come from taskman_rand() with a seed, so a run can be repeated exactly.
+// taskman_scenario_start() runs a list of them and compares what taskman measured with
+// what they should show, /scenario.
+
+#include "esp_http_client.h"
+
+enum TaskmanWorkKind : uint8_t { WORK_CPU, WORK_ALLOC, WORK_MUTEX, WORK_QUEUE, WORK_HTTP };
+
+struct TaskmanWorkload {
+  char name[12];       // the tasks are name, or name_a/name_b (mutex), name_tx/name_rx (queue)
+  TaskmanWorkKind kind;
+  int8_t core;         // -1 unpinned, the second task of a pair goes on the other core
+  uint32_t periodMs;   // cpu, mutex: the period; alloc, queue, http: time between operations
+  uint32_t busyUs;     // cpu, mutex: spun per period; queue: consumer work per message
+  uint32_t minBytes, maxBytes, lifetimeMs;  // alloc
+  const char* url;     // http, has to outlive the workload
+  uint32_t seed;
+
+  SemaphoreHandle_t mutex;
+  QueueHandle_t queue;
+  volatile uint8_t running;  // tasks still going
+  volatile bool stop;
+  volatile uint32_t ops, failures;
+};
+
+static const char* const workKindNames[] = { "cpu", "alloc", "mutex", "queue", "http" };
+
+// xorshift32 - the same sequence for the same seed on every chip and every release
+uint32_t taskman_rand(uint32_t& state) {
+  if (!state) state = 0x9E3779B9;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+// lo to hi, both included
+uint32_t taskman_randRange(uint32_t& state, uint32_t lo, uint32_t hi) {
+  return lo + taskman_rand(state) % (hi - lo + 1);
+}
+
+// Keep this core busy for us of wall time
+void taskman_workSpin(uint32_t us) {
+  uint64_t end = nowUs() + us;
+  volatile uint32_t j = 0;
+  while (nowUs() < end) j = j + 1;
+}
+
+TaskmanWorkload taskman_work_cpu(const char* name, int core, float duty, uint32_t periodMs = 100) {
+  TaskmanWorkload w = {};
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.kind = WORK_CPU;
+  w.core = core;
+  w.periodMs = max(periodMs, (uint32_t)portTICK_PERIOD_MS);
+  w.busyUs = constrain(duty, 0.0f, 1.0f) * w.periodMs * 1000;
+  return w;
+}
+
+// One allocation of minBytes to maxBytes every periodMs, each freed lifetimeMs later
+TaskmanWorkload taskman_work_alloc(const char* name, int core, uint32_t minBytes, uint32_t maxBytes, uint32_t lifetimeMs,
+                                   uint32_t periodMs = 10, uint32_t seed = 1) {
+  TaskmanWorkload w = {};
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.kind = WORK_ALLOC;
+  w.core = core;
+  w.periodMs = max(periodMs, (uint32_t)portTICK_PERIOD_MS);
+  w.minBytes = minBytes;
+  w.maxBytes = max(maxBytes, minBytes);
+  w.lifetimeMs = lifetimeMs;
+  w.seed = seed;
+  return w;
+}
+
+// Two tasks on different cores taking turns at one mutex, each holding it busy for holdUs
+// of every periodMs - waiting for it is blocked, not spinning, so contention doesn't
+// change their cpu
+TaskmanWorkload taskman_work_mutex(const char* name, uint32_t holdUs, uint32_t periodMs = 10) {
+  TaskmanWorkload w = {};
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.kind = WORK_MUTEX;
+  w.core = 0;
+  w.periodMs = max(periodMs, (uint32_t)portTICK_PERIOD_MS);
+  w.busyUs = min(holdUs, w.periodMs * 500);  // both fit in the period
+  return w;
+}
+
+// A producer sending a message every periodMs to a consumer that works workUs on each
+TaskmanWorkload taskman_work_queue(const char* name, uint32_t periodMs, uint32_t workUs) {
+  TaskmanWorkload w = {};
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.kind = WORK_QUEUE;
+  w.core = 0;
+  w.periodMs = max(periodMs, (uint32_t)portTICK_PERIOD_MS);
+  w.busyUs = min(workUs, w.periodMs * 1000);
+  return w;
+}
+
+// A GET of url every periodMs - ops and failures count the answers
+TaskmanWorkload taskman_work_http(const char* name, const char* url, uint32_t periodMs = 1000) {
+  TaskmanWorkload w = {};
+  strncpy(w.name, name, sizeof(w.name) - 1);
+  w.kind = WORK_HTTP;
+  w.core = -1;
+  w.periodMs = max(periodMs, (uint32_t)portTICK_PERIOD_MS);
+  w.url = url;
+  return w;
+}
+
+// What each of the workload's tasks should show, % of its core - -1 when there is no
+// fixed answer (alloc and http, they are checked by their ops per second)
+float taskman_workload_expected(const TaskmanWorkload& w, int second = 0) {
+  switch (w.kind) {
+    case WORK_CPU:
+    case WORK_MUTEX: return w.busyUs / (w.periodMs * 10.0f);
+    case WORK_QUEUE: return second ? w.busyUs / (w.periodMs * 10.0f) : 0;  // the producer's send is lost in the rounding
+    default: return -1;
+  }
+}
+
+void taskman_workExit(TaskmanWorkload& w) {
+  __atomic_fetch_sub(&w.running, 1, __ATOMIC_RELAXED);
+  vTaskDelete(nullptr);
+}
+
+void taskman_workCpuTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  TickType_t last = xTaskGetTickCount();
+  while (!w.stop) {
+    taskman_workSpin(w.busyUs);
+    w.ops = w.ops + 1;
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(w.periodMs));
+  }
+  taskman_workExit(w);
+}
+
+void taskman_workAllocTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  // constant lifetime, so they are freed in the order they were made
+  int live = min(w.lifetimeMs / w.periodMs + 1, (uint32_t)256);
+  void** ptrs = (void**)calloc(live, sizeof(void*));
+  uint32_t* dueMs = (uint32_t*)calloc(live, sizeof(uint32_t));
+  int head = 0, count = 0;
+  uint32_t seed = w.seed;
+  TickType_t last = xTaskGetTickCount();
+  while (!w.stop && ptrs && dueMs) {
+    uint32_t now = millis();
+    while (count && (int32_t)(now - dueMs[(head - count + live) % live]) >= 0) {
+      free(ptrs[(head - count + live) % live]);
+      count--;
+    }
+    if (count < live) {
+      size_t size = taskman_randRange(seed, w.minBytes, w.maxBytes);
+      void* m = malloc(size);
+      if (m) {
+        memset(m, 0xA5, size);  // touch it, like a real buffer
+        ptrs[head] = m;
+        dueMs[head] = now + w.lifetimeMs;
+        head = (head + 1) % live;
+        count++;
+        w.ops = w.ops + 1;
+      } else {
+        w.failures = w.failures + 1;
+      }
+    }
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(w.periodMs));
+  }
+  for (; count; count--) free(ptrs[(head - count + live) % live]);
+  free(ptrs);
+  free(dueMs);
+  taskman_workExit(w);
+}
+
+void taskman_workMutexTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  TickType_t last = xTaskGetTickCount();
+  while (!w.stop) {
+#if TASKMAN_IPC
+    BaseType_t got = taskman_mutex_take(w.mutex, pdMS_TO_TICKS(w.periodMs));
+#else
+    BaseType_t got = xSemaphoreTake(w.mutex, pdMS_TO_TICKS(w.periodMs));
+#endif
+    if (got == pdTRUE) {
+      taskman_workSpin(w.busyUs);
+      xSemaphoreGive(w.mutex);
+      w.ops = w.ops + 1;
+    } else {
+      w.failures = w.failures + 1;
+    }
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(w.periodMs));
+  }
+  taskman_workExit(w);
+}
+
+void taskman_workProducerTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  TickType_t last = xTaskGetTickCount();
+  uint32_t n = 0;
+  while (!w.stop) {
+    if (xQueueSend(w.queue, &n, 0) == pdTRUE) n++;
+    else w.failures = w.failures + 1;
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(w.periodMs));
+  }
+  taskman_workExit(w);
+}
+
+void taskman_workConsumerTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  uint32_t n;
+  while (!w.stop) {
+    if (xQueueReceive(w.queue, &n, pdMS_TO_TICKS(100)) != pdTRUE) continue;
+    taskman_workSpin(w.busyUs);
+    w.ops = w.ops + 1;
+  }
+  taskman_workExit(w);
+}
+
+void taskman_workHttpTask(void* p) {
+  TaskmanWorkload& w = *(TaskmanWorkload*)p;
+  esp_http_client_config_t config = {};
+  config.url = w.url;
+  config.timeout_ms = 2000;
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  TickType_t last = xTaskGetTickCount();
+  while (!w.stop && client) {
+    if (esp_http_client_perform(client) == ESP_OK && esp_http_client_get_status_code(client) < 400) w.ops = w.ops + 1;
+    else w.failures = w.failures + 1;
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(w.periodMs));
+  }
+  if (client) esp_http_client_cleanup(client);
+  taskman_workExit(w);
+}
+
+bool taskman_workSpawn(TaskmanWorkload& w, TaskFunction_t fn, const char* suffix, uint32_t stack, int core) {
+  char name[16];
+  snprintf(name, sizeof(name), "%s%s", w.name, suffix);
+  w.running = w.running + 1;
+  if (xTaskCreatePinnedToCore(fn, name, stack, &w, 1, nullptr, core < 0 ? tskNO_AFFINITY : core) == pdPASS) return true;
+  w.running = w.running - 1;
+  return false;
+}
+
+// Start the workload's tasks, at priority 1.  w is used by them until
+// taskman_workload_stop(), so it can't be on the stack of a function that returns.
+bool taskman_workload_start(TaskmanWorkload& w) {
+  if (w.running) return false;
+  w.stop = false;
+  w.ops = w.failures = 0;
+  int other = portNUM_PROCESSORS > 1 ? 1 - max((int)w.core, 0) : 0;
+  switch (w.kind) {
+    case WORK_CPU: return taskman_workSpawn(w, taskman_workCpuTask, "", 2048, w.core);
+    case WORK_ALLOC: return taskman_workSpawn(w, taskman_workAllocTask, "", 2048, w.core);
+    case WORK_HTTP: return taskman_workSpawn(w, taskman_workHttpTask, "", 4096, w.core);
+    case WORK_MUTEX:
+      if (!w.mutex) w.mutex = xSemaphoreCreateMutex();
+      if (!w.mutex) return false;
+#if TASKMAN_IPC
+      taskman_watch_mutex(w.mutex, w.name);
+#endif
+      return taskman_workSpawn(w, taskman_workMutexTask, "_a", 2048, max((int)w.core, 0)) &&
+             taskman_workSpawn(w, taskman_workMutexTask, "_b", 2048, other);
+    case WORK_QUEUE:
+      if (!w.queue) w.queue = xQueueCreate(16, sizeof(uint32_t));
+      if (!w.queue) return false;
+#if TASKMAN_IPC
+      taskman_watch_queue(w.queue, w.name);
+#endif
+      return taskman_workSpawn(w, taskman_workProducerTask, "_tx", 2048, max((int)w.core, 0)) &&
+             taskman_workSpawn(w, taskman_workConsumerTask, "_rx", 2048, other);
+  }
+  return false;
+}
+
+// Ask its tasks to finish and wait for them, up to a couple of seconds for an http request.
+// The mutex or queue is kept for the next start, a watched one is still in the watch list.
+void taskman_workload_stop(TaskmanWorkload& w) {
+  w.stop = true;
+  for (int i = 0; i < 300 && w.running; i++) vTaskDelay(pdMS_TO_TICKS(10));
+}
+
+// ---- Scenario runner ----
+// Starts the workloads, lets them settle for warmupMs, then averages each task's samples
+// over measureMs and stops them.  measureMs is cut to what the sample history holds.
+
+struct ScenarioRow {
+  char task[16];
+  float expected;  // % of its core, -1 none
+  float measured;
+};
+
+struct Scenario {
+  char name[16];
+  TaskmanWorkload* list = nullptr;
+  int count = 0;
+  uint32_t warmupMs = 0, measureMs = 0;
+  volatile bool running = false;
+  bool done = false;
+  ScenarioRow rows[2 * MAX_WORKLOADS];
+  int rowCount = 0;
+  uint32_t ops[MAX_WORKLOADS];        // in the measured window
+  uint32_t failures[MAX_WORKLOADS];
+  float heapUsedKB = 0;               // drop in free heap over the window, all workloads
+  uint32_t finishedMs = 0;
+};
+
+Scenario scenario;
+
+// Mean of task's samples taken in (fromMs, toMs], each weighted by the time since the one
+// before, which varies with adaptive sampling
+float taskman_scenarioMeasured(const char* task, uint32_t fromMs, uint32_t toMs) {
+  int idx = taskman_findTask(task);
+  if (idx < 0) return 0;
+  float sum = 0;
+  uint32_t covered = 0, prev = 0;
+  for (int j = 0; j < SAMPLE_COUNT; j++) {
+    uint32_t t = sysSamples.timeMs[sysSamples.oldest(j)];
+    uint32_t dt = prev ? t - prev : 0;
+    prev = t;
+    if (!dt || (int32_t)(t - fromMs) <= 0 || (int32_t)(t - toMs) > 0) continue;
+    sum += tasks[idx].at(j) * dt;
+    covered += dt;
+  }
+  return covered ? sum / covered : 0;
+}
+
+void taskman_scenarioTask(void* param) {
+  Scenario& s = scenario;
+  uint32_t heapBefore = ESP.getFreeHeap();
+  for (int i = 0; i < s.count; i++) {
+    if (!taskman_workload_start(s.list[i])) Serial.printf("scenario %s: %s did not start\n", s.name, s.list[i].name);
+  }
+  vTaskDelay(pdMS_TO_TICKS(s.warmupMs));
+
+  uint32_t startOps[MAX_WORKLOADS], startFailures[MAX_WORKLOADS];
+  for (int i = 0; i < s.count; i++) {
+    startOps[i] = s.list[i].ops;
+    startFailures[i] = s.list[i].failures;
+  }
+  uint32_t fromMs = millis();
+  uint32_t heapSum = 0, heapN = 0;
+  for (uint32_t waited = 0; waited < s.measureMs; waited += 100) {
+    vTaskDelay(pdMS_TO_TICKS(100));
+    heapSum += ESP.getFreeHeap();
+    heapN++;
+  }
+  uint32_t toMs = millis();
+  for (int i = 0; i < s.count; i++) {
+    s.ops[i] = s.list[i].ops - startOps[i];
+    s.failures[i] = s.list[i].failures - startFailures[i];
+  }
+  vTaskDelay(pdMS_TO_TICKS(taskman_period_ms + 50));  // the sample that closes the window
+
+  s.rowCount = 0;
+  for (int i = 0; i < s.count; i++) {
+    const TaskmanWorkload& w = s.list[i];
+    const char* suffix[2] = { "", "" };
+    int tasksInIt = 1;
+    if (w.kind == WORK_MUTEX) {
+      suffix[0] = "_a";
+      suffix[1] = "_b";
+      tasksInIt = 2;
+    } else if (w.kind == WORK_QUEUE) {
+      suffix[0] = "_tx";
+      suffix[1] = "_rx";
+      tasksInIt = 2;
+    }
+    for (int k = 0; k < tasksInIt; k++) {
+      ScenarioRow& r = s.rows[s.rowCount++];
+      snprintf(r.task, sizeof(r.task), "%s%s", w.name, suffix[k]);
+      r.expected = taskman_workload_expected(w, k);
+      r.measured = taskman_scenarioMeasured(r.task, fromMs, toMs);
+    }
+  }
+  s.heapUsedKB = heapN ? (heapBefore - (float)heapSum / heapN) / 1024 : 0;
+
+  for (int i = 0; i < s.count; i++) taskman_workload_stop(s.list[i]);
+
+  Serial.printf("scenario %s, %u ms measured at %u ms samples\n", s.name, (unsigned)s.measureMs, (unsigned)taskman_sample_interval_ms);
+  float maxErr = 0;
+  for (int i = 0; i < s.rowCount; i++) {
+    const ScenarioRow& r = s.rows[i];
+    if (r.expected < 0) continue;
+    Serial.printf("  %-15s expected %5.1f%%  measured %5.1f%%  error %+5.1f\n", r.task, r.expected, r.measured, r.measured - r.expected);
+    maxErr = max(maxErr, fabsf(r.measured - r.expected));
+  }
+  for (int i = 0; i < s.count; i++) {
+    Serial.printf("  %-15s %s %.1f ops/s, expected %.1f, %u failed\n", s.list[i].name, workKindNames[s.list[i].kind],
+                  s.ops[i] * 1000.0f / s.measureMs, 1000.0f / s.list[i].periodMs, (unsigned)s.failures[i]);
+  }
+  Serial.printf("  largest cpu error %.1f, heap in use %.1f KB\n", maxErr, s.heapUsedKB);
+
+  s.finishedMs = millis();
+  s.done = true;
+  s.running = false;
+  vTaskDelete(nullptr);
+}
+
+// Run list in the background, false if a scenario is already running.  list has to stay
+// around until it is done, scenario.running goes false then.
+bool taskman_scenario_start(const char* name, TaskmanWorkload* list, int count, uint32_t measureMs = 20000, uint32_t warmupMs = 3000) {
+  if (scenario.running || count < 1 || count > MAX_WORKLOADS) return false;
+  uint32_t history = (SAMPLE_COUNT - 2) * taskman_sample_interval_ms;
+#if TASKMAN_ADAPTIVE
+  if (adaptive.enabled) history = (SAMPLE_COUNT - 2) * adaptive.fastMs;  // it may be fast the whole run
+#endif
+  if (measureMs > history) {
+    Serial.printf("scenario %s: %u ms is more than the sample history, measuring %u ms\n", name, (unsigned)measureMs, (unsigned)history);
+    measureMs = history;
+  }
+  strncpy(scenario.name, name, sizeof(scenario.name) - 1);
+  scenario.name[sizeof(scenario.name) - 1] = 0;
+  scenario.list = list;
+  scenario.count = count;
+  scenario.measureMs = measureMs;
+  scenario.warmupMs = warmupMs;
+  scenario.done = false;
+  scenario.running = true;
+  if (xTaskCreatePinnedToCore(taskman_scenarioTask, "TM_Scenario", 3072, nullptr, 2, nullptr, tskNO_AFFINITY) != pdPASS) {
+    scenario.running = false;
+    return false;
+  }
+  return true;
+}
+
+// The built in scenario for /scenario?run=1: fixed cpu on each core, a mutex pair, a queue
+// and alloc churn, plus http when a url is given.  At most 70% of either core.  Built once,
+// so the mutex and queue are reused by the next run.
+TaskmanWorkload calibrateWork[6];
+char calibrateUrl[96];
+
+bool taskman_scenario_calibrate(uint32_t measureMs, const char* url = nullptr) {
+  if (scenario.running) return false;
+  int n = 5;
+  if (!calibrateWork[0].periodMs) {
+    calibrateWork[0] = taskman_work_cpu("cpu10", 0, 0.10f);
+    calibrateWork[1] = taskman_work_cpu("cpu30", 1, 0.30f);
+    calibrateWork[2] = taskman_work_mutex("mtx", 2000, 10);
+    calibrateWork[3] = taskman_work_queue("que", 5, 1000);
+    calibrateWork[4] = taskman_work_alloc("churn", 0, 256, 4096, 500, 10, 42);
+  }
+  if (url && *url) {
+    strncpy(calibrateUrl, url, sizeof(calibrateUrl) - 1);
+    calibrateWork[n++] = taskman_work_http("http", calibrateUrl, 500);
+  }
+  return taskman_scenario_start("calibrate", calibrateWork, n, measureMs);
+}
+#endif
+
+#if TASKMAN_FAKE_LOAD
+void FakeLoad1(void* pv) {
+  uint32_t idleMs = 10000UL;
+  //Serial.printf("FakeLoad1: Core 1, idle for %lu ms...\n", idleMs);
+  vTaskDelay(pdMS_TO_TICKS(idleMs));
+  uint32_t seed = 1;  // the same bursts every boot
+
+  for (;;) {
+    uint32_t runSecs = taskman_randRange(seed, 1, 9);
+    //Serial.printf("FakeLoad1: Core 1, running for %lu seconds...\n", runSecs);
+
+    // Allocate PSRAM once per load phase (optional)
+    uint8_t* psramBuffer = (uint8_t*)ps_malloc(2 * 1024 * 1024);  // 1 MB PSRAM
+    if (psramBuffer) memset(psramBuffer, 0xAA, 2 * 1024 * 1024);
+
+    uint8_t* ramBuffer = nullptr;
+    size_t ramSize = 0;
+
+    uint32_t start = millis();
+    uint32_t lastIncrease = start;
+
+    while ((millis() - start) < (runSecs * 1000UL)) {
+      int j = 0;
+      for (int i = 0; i < 200000; i++) {
+        j = (j + 1) * -1;
+      }
+      if (j < 0) Serial.println("Fake Load 1!");
+      // every 1 second: increase RAM allocation by 2 KB
+      if (millis() - lastIncrease >= 1000) {
+        lastIncrease = millis();
+        ramSize += 5 * 1024;  // +2 KB
+        uint8_t* newBuffer = (uint8_t*)heap_caps_realloc(ramBuffer, ramSize, MALLOC_CAP_INTERNAL);
+        //uint8_t* newBuffer = (uint8_t*)realloc(ramBuffer, ramSize);
+        if (newBuffer) {
+          ramBuffer = newBuffer;
+          memset(ramBuffer + ramSize - 5 * 1024, 0xAA, 5 * 1024);  // touch new region
+          //Serial.printf("FakeLoad1: increased RAM to %u KB\n", ramSize / 1024);
+        } else {
+          Serial.println("FakeLoad1: realloc failed");
+          break;  // stop increasing on failure
+        }
+      }
+
+      vTaskDelay(1);
+    }
+
+    if (ramBuffer) free(ramBuffer);
+    if (psramBuffer) free(psramBuffer);
+
+    uint32_t idleMs = taskman_randRange(seed, 5, 19) * 1000UL;
+    //Serial.printf("FakeLoad1: idle for %lu ms...\n", idleMs);
+    vTaskDelay(pdMS_TO_TICKS(idleMs));
+  }
+}
+
+void FakeLoad0(void* pv) {
+  const uint32_t cycleMs = 30000UL;  // full sine wave cycle = 30 seconds
+  const float minLoad = 0.05;        // 5% minimum load
+  const float maxLoad = 0.50;        // 50% maximum load
+  const uint32_t stepMs = 200;       // time step resolution
+
+  Serial.printf("FakeLoad0: Core %d, sine-wave fake load (%.0f–%.0f%%, %lus cycle)\n",
+                xPortGetCoreID(), minLoad * 100, maxLoad * 100, cycleMs / 1000);
+
+  uint32_t startCycle = millis();
+  TickType_t last = xTaskGetTickCount();
+
+  for (;;) {
+    uint32_t elapsed = (millis() - startCycle) % cycleMs;
+
+    // Sine wave 0→2π
+    float phase = (2.0f * PI * elapsed) / cycleMs;
+    float loadFrac = minLoad + (maxLoad - minLoad) * (0.5f * (sinf(phase) + 1.0f));
+
+    // --- Busy for loadFrac of the step, to the us, then idle to the end of the step ---
+    taskman_workSpin(stepMs * 1000 * loadFrac);
+    vTaskDelayUntil(&last, pdMS_TO_TICKS(stepMs));
+  }
+}
+#endif
+
+String getProgramName() {
+  String path = __FILE__;
+  int slash = path.lastIndexOf('/');
+  if (slash < 0) slash = path.lastIndexOf('\\');  // handle Windows
+  int dot = path.lastIndexOf('.');
+  if (dot < 0) dot = path.length();
+  return path.substring(slash + 1, dot);
+}
+
+#if TASKMAN_DASHBOARD
+esp_err_t taskman_handleRoot(httpd_req_t* req) {
+  //String progName = getProgramName();
+  String progName = PROGRAM_NAME;
+
+  String html = R"rawliteral(
+<!DOCTYPE html>
+<html>
+<head>
+  <title>)rawliteral";
+  html += progName;
+  html += R"rawliteral( - ESP32 Task Manager</title>
+  <style>
+    body {
+      font-family: sans-serif;
+      margin: 0;
+      background: #fff;
+      padding: 1em;
+    }
+    canvas {
+      display: block;
+      width: 100%;
+    }
+    table {
+      width: 100%;
+      border-collapse: collapse;
+      margin-top: 20px;
+    }
+    th, td {
+      border: 1px solid #ccc;
+      padding: 6px 10px;
+      text-align: left;
+    }
+    th {
+      background: #eee;
+    }
+  </style>
+</head>
+<body>
+<h2>ESP32 Task Manager - )rawliteral";
+  html += progName;
+  html += R"rawliteral(</h2>
+  
+  <canvas id="memChart" width="900" height="200" style="margin-top: 20px;"></canvas>
+  <canvas id="cpuChart" width="900" height="400"></canvas>
+  <canvas id="ipcChart" width="900" height="150" style="display: none;"></canvas>
+  <div id="ipcInfo" style="font-size: 12px; color: #666;"></div>
+  <canvas id="metricsChart" width="900" height="150" style="display: none;"></canvas>
+  <canvas id="coreChart" width="900" height="90"></canvas>
+  <div id="monitorInfo" style="font-size: 12px; color: #666;"></div>
+
+<div style="
+  background: #fff;
+  padding: 12px 16px;
+  border-radius: 10px;
+  box-shadow: 0 2px 6px rgba(0,0,0,0.1);
+  max-width: 900px;
+  margin-top: 15px;
+  line-height: 1.6;
+  font-size: 14px;
+  color: #333;
+">
+  <ul style="margin: 0 0 10px 20px; padding: 0;">
+    <li>Click task names in legend to hide or restore lines</li>
+    <li>Hover over a graph to see the values at that time</li>
+)rawliteral";
+#if TASKMAN_NETWORK_PAGE
+  html += R"rawliteral(    <li><a href="/network">Network Info</a></li>
+)rawliteral";
+#endif
+  html += R"rawliteral(
+    <li><a href="/config">Sampling</a> - /config?interval=250 changes the rate, /burst?hz=100&amp;ms=2000 records a short burst</li>
+    <li><a href="/export.csv">Export CSV</a> - the whole history, a row per sample with the wall clock time</li>
+  </ul>
+  <p style="margin: 0;">
+    <a href="https://github.com/jameszah/ESP32-Task-Manager" target="_blank" 
+       style="color:#0078d4; text-decoration:none;">
+       Source Code on GitHub: <b>ESP32-Task-Manager 8.0</b>
+    </a>
+  </p>
+</div>
+<div id="alerts" style="color: #b00; font-weight: bold; margin-top: 10px;"></div>
+<canvas id="balanceChart" width="900" height="80" style="margin-top: 10px;"></canvas>
+<div id="balanceInfo" style="font-size: 12px; color: #666;"></div>
+<table id="regionTable" style="display: none; margin-top: 10px; background: white;">
+  <thead>
+    <tr>
+      <th>Region</th>
+      <th>Calls</th>
+      <th>Calls/s</th>
+      <th>% of core</th>
+      <th>Avg us</th>
+      <th>p50 us</th>
+      <th>p99 us</th>
+      <th>Max us</th>
+      <th>Total ms</th>
+    </tr>
+  </thead>
+  <tbody></tbody>
+</table>
+<div id="regionInfo" style="font-size: 12px; color: #666;"></div>
+<div id="isrInfo" style="font-size: 12px; color: #666;"></div>
+<h3>Task Info - updates every 30 sec</h3>
+<table id="taskTable" border="1" style="margin-top:10px; border-collapse:collapse; width:100%; background:white;">
+  <thead>
+    <tr style="background:#eee;">
+      <th>Task Name</th>
+      <th>Core</th>
+      <th>Core 0 %</th>
+      <th>Core 1 %</th>
+      <th>Avg %</th>
+      <th>Std</th>
+      <th>P95 %</th>
+      <th>Max %</th>
+      <th>Since boot avg / p95 / max</th>
+      <th>Ready / Blocked %</th>
+      <th>Priority</th>
+      <th>Stack HW</th>
+      <th>State</th>
+    </tr>
+  </thead>
+  <tbody></tbody>
+</table>
+
+<script>
+
+let cpuChart, memChart, ipcChart, metricsChart;
+
+let sampleCount = )rawliteral";
+  html += String(SAMPLE_COUNT);
+  html += R"rawliteral(; // number of samples to keep on screen
+let sampleInterval = 1000; // ms per sample, from /data
+let sampleSpan = sampleCount * sampleInterval;  // ms of history on the esp32, the x axis
+let maxTasks = 12; // busiest tasks drawn
+let marks = [];       // annotations from /data
+let lastTime = 0;     // uptime ms of the newest sample we have, 0 to fetch everything
+let clockOffset = 0;  // wall clock minus uptime in ms, 0 until the esp32 has the time
+
+// ---- Canvas charts, a line per series against the sample times, no library ----
+// A full draw puts each series into pixel columns and draws the first, min, max and last
+// value of every column, so a one sample spike is never lost however long the history.
+// New samples scroll what is already drawn to the left and only the new columns are
+// drawn.  The legend under the chart toggles a series.
+const tip = document.createElement('div');
+tip.style.cssText = 'position:absolute; display:none; background:rgba(255,255,255,0.95); border:1px solid #ccc; padding:4px 6px; font-size:12px; pointer-events:none; white-space:nowrap';
+
+function niceMax(v) {
+  if (!(v > 0)) return 1;
+  const p = Math.pow(10, Math.floor(Math.log10(v)));
+  for (const m of [1, 2, 2.5, 5, 10]) if (v <= m * p) return m * p;
+  return 10 * p;
+}
+
+class TmChart {
+  // opt.left / opt.right: { title, max } - max 0 scales to the data
+  constructor(id, opt) {
+    this.canvas = document.getElementById(id);
+    this.ctx = this.canvas.getContext('2d');
+    this.opt = opt;
+    this.series = [];
+    this.t = [];
+    this.span = sampleSpan;
+    this.max = { left: opt.left.max || 1, right: opt.right ? opt.right.max || 1 : 1 };
+    this.pad = { l: 55, r: opt.right ? 60 : 15, t: 8, b: 30 };
+    this.drawn = 0;       // newest time on the canvas, 0 when it needs a full draw
+    this.appends = 0;
+    this.marks = '';
+    this.legend = document.createElement('div');
+    this.legend.style.cssText = 'font-size:12px; margin:2px 0 6px 0; user-select:none';
+    this.canvas.after(this.legend);
+    this.canvas.addEventListener('mousemove', e => this.hover(e));
+    this.canvas.addEventListener('mouseleave', () => tip.style.display = 'none');
+  }
+
+  get x0() { return this.pad.l; }
+  get x1() { return this.canvas.width - this.pad.r; }
+  get y0() { return this.pad.t; }
+  get y1() { return this.canvas.height - this.pad.b; }
+  xOf(t) { return this.x1 - Math.round((this.t[this.t.length - 1] - t) * (this.x1 - this.x0) / this.span); }
+  yOf(v, axis) { return Math.round(this.y1 - Math.min(v / this.max[axis], 1.02) * (this.y1 - this.y0)) + 0.5; }
+
+  // add or restyle a series - style is { color, dash, axis }
+  set(label, style) {
+    let s = this.series.find(x => x.label === label);
+    if (!s) {
+      s = { label, hidden: false, axis: 'left', v: this.t.map(() => null) };
+      this.series.push(s);
+      this.drawn = 0;
+      this.legendDirty = true;
+    }
+    Object.assign(s, style);
+    return s;
+  }
+
+  // everything new: times and { label: values }, series not in data are dropped
+  replace(times, data) {
+    const from = Math.max(times.findIndex(t => t > 0), 0);  // slots not filled since boot
+    this.series = this.series.filter(s => data[s.label]);
+    this.t = times.slice(from);
+    this.series.forEach(s => s.v = data[s.label].slice(from));
+    this.legendDirty = true;
+    this.draw();
+  }
+
+  // samples after the ones we have
+  append(times, data) {
+    if (!times.length) return;
+    let from = this.t.length;
+    times.forEach((t, k) => {
+      this.t.push(t);
+      this.series.forEach(s => s.v.push(data[s.label] ? data[s.label][k] ?? null : null));
+    });
+    let drop = 0;
+    while (drop < this.t.length - 1 && this.t[drop] < this.t[this.t.length - 1] - sampleSpan) drop++;
+    if (drop) {
+      this.t.splice(0, drop);
+      this.series.forEach(s => s.v.splice(0, drop));
+      from -= drop;
+    }
+    const over = this.series.some(s => !s.hidden && s.v.slice(from).some(v => v > this.max[s.axis] * 1.02));
+    const rescale = Math.abs(sampleSpan - this.span) > this.span * 0.02;
+    if (!this.drawn || over || rescale || ++this.appends % 30 == 0) this.draw();
+    else this.scroll(Math.max(from - 1, 0));
+  }
+
+  setMarks(m) {
+    const key = JSON.stringify(m);
+    if (key !== this.marks) this.drawn = 0;
+    this.marks = key;
+  }
+
+  fit() {
+    const w = this.canvas.clientWidth;
+    if (w && this.canvas.width !== w) this.canvas.width = w;
+    this.span = sampleSpan;
+    for (const axis of ['left', 'right']) {
+      const o = this.opt[axis];
+      if (!o || o.max) continue;
+      let peak = 0;
+      this.series.forEach(s => { if (!s.hidden && s.axis === axis) s.v.forEach(v => { if (v > peak) peak = v; }); });
+      this.max[axis] = niceMax(peak);
+    }
+  }
+
+  grid(from, to) {
+    const c = this.ctx;
+    c.strokeStyle = '#eee';
+    c.lineWidth = 1;
+    c.setLineDash([]);
+    c.beginPath();
+    for (let k = 0; k <= 4; k++) {
+      const y = Math.round(this.y0 + (this.y1 - this.y0) * k / 4) + 0.5;
+      c.moveTo(from, y);
+      c.lineTo(to, y);
+    }
+    c.stroke();
+  }
+
+  axes() {
+    const c = this.ctx, H = this.canvas.height;
+    this.grid(this.x0, this.x1);
+    c.strokeStyle = '#999';
+    c.strokeRect(this.x0 + 0.5, this.y0 + 0.5, this.x1 - this.x0, this.y1 - this.y0);
+    c.fillStyle = '#666';
+    c.font = '11px sans-serif';
+    const fmt = v => v >= 1000 ? (v / 1000) + 'k' : +v.toFixed(2);
+    for (let k = 0; k <= 4; k++) {
+      const y = this.y1 - (this.y1 - this.y0) * k / 4;
+      c.textAlign = 'right';
+      c.fillText(fmt(this.max.left * k / 4), this.x0 - 4, y + 4);
+      if (this.opt.right) {
+        c.textAlign = 'left';
+        c.fillText(fmt(this.max.right * k / 4), this.x1 + 4, y + 4);
+      }
+    }
+    // seconds ago, at a step that gives at most 10 labels
+    const spanS = this.span / 1000;
+    const step = [1, 2, 5, 10, 15, 30, 60, 120, 300, 600, 1800, 3600].find(s => spanS / s <= 10) || 7200;
+    c.textAlign = 'center';
+    for (let s = 0; s <= spanS; s += step) {
+      const x = this.x1 - s * 1000 * (this.x1 - this.x0) / this.span;
+      c.fillText(s ? '-' + s : '0', x, this.y1 + 13);
+    }
+    c.fillText('Seconds Ago', (this.x0 + this.x1) / 2, H - 3);
+    const title = (text, x) => {
+      c.save();
+      c.translate(x, (this.y0 + this.y1) / 2);
+      c.rotate(-Math.PI / 2);
+      c.fillText(text, 0, 0);
+      c.restore();
+    };
+    title(this.opt.left.title, 10);
+    if (this.opt.right) title(this.opt.right.title, this.canvas.width - 4);
+  }
+
+  // series s from sample i on, a column at a time
+  line(s, i) {
+    const c = this.ctx;
+    c.strokeStyle = s.color;
+    c.lineWidth = 1.5;
+    c.setLineDash(s.dash || []);
+    c.beginPath();
+    let col = null, first, lo, hi, last, pen = false;
+    const flush = () => {
+      if (col === null) return;
+      const y = v => this.yOf(v, s.axis);
+      if (pen) c.lineTo(col, y(first));
+      else c.moveTo(col, y(first));
+      if (lo !== hi) {
+        c.lineTo(col, y(lo));
+        c.lineTo(col, y(hi));
+      }
+      c.lineTo(col, y(last));
+      pen = true;
+    };
+    for (; i < this.t.length; i++) {
+      const v = s.v[i];
+      if (v === null || v === undefined) {
+        flush();
+        col = null;
+        pen = false;
+        continue;
+      }
+      const x = this.xOf(this.t[i]);
+      if (x !== col) {
+        flush();
+        col = x;
+        first = lo = hi = last = v;
+      } else {
+        lo = Math.min(lo, v);
+        hi = Math.max(hi, v);
+        last = v;
+      }
+    }
+    flush();
+    c.stroke();
+  }
+
+  clip(from, to) {
+    this.ctx.save();
+    this.ctx.beginPath();
+    this.ctx.rect(from, this.y0, to - from, this.y1 - this.y0);
+    this.ctx.clip();
+  }
+
+  draw() {
+    this.fit();
+    const c = this.ctx;
+    c.clearRect(0, 0, this.canvas.width, this.canvas.height);
+    if (this.legendDirty) this.legendBuild();
+    this.axes();
+    if (!this.t.length) return;
+    this.clip(this.x0, this.x1);
+    this.series.forEach(s => { if (!s.hidden) this.line(s, 0); });
+    this.drawMarks();
+    c.restore();
+    this.drawn = this.t[this.t.length - 1];
+  }
+
+  // move the old columns left by however far the newest sample is from the last one drawn
+  scroll(from) {
+    const dx = this.x1 - this.xOf(this.drawn);
+    if (dx <= 0) return;
+    if (dx >= this.x1 - this.x0 || this.legendDirty) return this.draw();
+    const c = this.ctx, w = this.x1 - this.x0 - dx, h = this.y1 - this.y0;
+    c.drawImage(this.canvas, this.x0 + 1 + dx, this.y0 + 1, w - 1, h - 1, this.x0 + 1, this.y0 + 1, w - 1, h - 1);
+    c.clearRect(this.x1 - dx, this.y0 + 1, dx, h - 1);
+    this.grid(this.x1 - dx, this.x1);
+    this.clip(this.xOf(this.t[from]), this.x1);
+    this.series.forEach(s => { if (!s.hidden) this.line(s, from); });
+    c.restore();
+    this.drawn = this.t[this.t.length - 1];
+  }
+
+  // dashed line at each annotation, with what changed after it
+  drawMarks() {
+    const c = this.ctx;
+    (this.opt.marks ? marks : []).forEach(m => {
+      if (m.t < this.t[0]) return;
+      const x = this.xOf(m.t) + 0.5;
+      let text = m.text;
+      if (m.done && m.task) text += ` - cpu ${m.cpu[0]}->${m.cpu[1]}%, core ${m.busy[0]}->${m.busy[1]}%, jitter ${m.jitterMs[0]}->${m.jitterMs[1]}ms`;
+      c.strokeStyle = '#d33';
+      c.lineWidth = 1;
+      c.setLineDash([4, 3]);
+      c.beginPath();
+      c.moveTo(x, this.y0);
+      c.lineTo(x, this.y1);
+      c.stroke();
+      c.fillStyle = '#d33';
+      c.font = '11px sans-serif';
+      c.textAlign = x > (this.x0 + this.x1) / 2 ? 'right' : 'left';
+      c.fillText(text, x + (c.textAlign === 'right' ? -3 : 3), this.y0 + 12);
+    });
+  }
+
+  legendBuild() {
+    this.legendDirty = false;
+    this.legend.innerHTML = '';
+    this.series.forEach(s => {
+      const e = document.createElement('span');
+      e.style.cssText = `cursor:pointer; margin-right:12px; white-space:nowrap; ${s.hidden ? 'text-decoration:line-through; color:#aaa' : ''}`;
+      e.innerHTML = `<span style="display:inline-block; width:12px; height:8px; margin-right:3px; background:${s.color}"></span>`;
+      e.appendChild(document.createTextNode(s.label));
+      e.onclick = () => {
+        s.hidden = !s.hidden;
+        this.legendDirty = true;
+        this.draw();
+      };
+      this.legend.appendChild(e);
+    });
+  }
+
+  // the values at the sample nearest the pointer, biggest first
+  hover(e) {
+    if (!this.t.length) return;
+    const r = this.canvas.getBoundingClientRect();
+    const x = (e.clientX - r.left) * this.canvas.width / r.width;
+    const want = this.t[this.t.length - 1] - (this.x1 - x) * this.span / (this.x1 - this.x0);
+    let i = 0;
+    this.t.forEach((t, k) => { if (Math.abs(t - want) < Math.abs(this.t[i] - want)) i = k; });
+    const rows = this.series.filter(s => !s.hidden && s.v[i] !== null && s.v[i] !== undefined)
+      .sort((a, b) => b.v[i] - a.v[i]).slice(0, 12)
+      .map(s => `<span style="color:${s.color}">&#9632;</span> ${s.label}: ${+s.v[i].toFixed(2)}`);
+    const clock = clockOffset ? new Date(this.t[i] + clockOffset).toLocaleTimeString() + ', ' : '';
+    tip.innerHTML = `${clock}${((this.t[i] - this.t[this.t.length - 1]) / 1000).toFixed(1)}s<br>` + rows.join('<br>');
+    tip.style.left = (e.pageX + 12) + 'px';
+    tip.style.top = (e.pageY + 12) + 'px';
+    tip.style.display = '';
+  }
+}
+
+// Horizontal bars, a row per core - stacked for the per-core task split, side by side with
+// a legend for the balance
+function drawBars(id, sets, stacked, title) {
+  const cv = document.getElementById(id), c = cv.getContext('2d');
+  if (cv.clientWidth && cv.width !== cv.clientWidth) cv.width = cv.clientWidth;
+  const W = cv.width, H = cv.height, l = 50, r = W - (stacked ? 15 : 100), top = 4, bottom = H - 30;
+  const rowH = (bottom - top) / 2;
+  c.clearRect(0, 0, W, H);
+  c.font = '11px sans-serif';
+  c.strokeStyle = '#eee';
+  c.fillStyle = '#666';
+  c.textAlign = 'center';
+  for (let p = 0; p <= 100; p += 25) {
+    const x = Math.round(l + (r - l) * p / 100) + 0.5;
+    c.beginPath();
+    c.moveTo(x, top);
+    c.lineTo(x, bottom);
+    c.stroke();
+    c.fillText(p, x, bottom + 12);
+  }
+  c.fillText(title, (l + r) / 2, H - 3);
+  ['core 0', 'core 1'].forEach((name, k) => {
+    const y = top + k * rowH;
+    c.fillStyle = '#666';
+    c.textAlign = 'right';
+    c.fillText(name, l - 4, y + rowH / 2 + 4);
+    let x = l;
+    sets.forEach((s, j) => {
+      const w = (r - l) * Math.min(s.data[k] || 0, 100) / 100;
+      c.fillStyle = s.color;
+      if (stacked) {
+        c.fillRect(x, y + 3, Math.min(w, r - x), rowH - 6);
+        x += w;
+      } else {
+        const h = (rowH - 6) / sets.length;
+        c.fillRect(l, y + 3 + j * h, w, h - 1);
+      }
+    });
+  });
+  if (!stacked) {
+    c.textAlign = 'left';
+    sets.forEach((s, j) => {
+      c.fillStyle = s.color;
+      c.fillRect(r + 10, top + 6 + j * 16, 12, 8);
+      c.fillStyle = '#666';
+      c.fillText(s.label, r + 26, top + 14 + j * 16);
+    });
+  }
+}
+
+function createChart() {
+  document.body.appendChild(tip);
+  cpuChart = new TmChart('cpuChart', { left: { title: 'CPU %', max: 100 }, marks: true });
+  memChart = new TmChart('memChart', { left: { title: 'RAM (KB)', max: 0 }, right: { title: 'PSRAM (KB)', max: 0 } });
+  memChart.set('free RAM', { color: 'rgb(54, 162, 235)' });
+  memChart.set('free PSRAM', { color: 'rgb(255, 99, 132)', axis: 'right' });
+  memChart.set('largest block', { color: 'rgb(75, 192, 192)', dash: [4, 3] });
+  ipcChart = new TmChart('ipcChart', { left: { title: 'queue % full', max: 100 }, right: { title: 'mutex wait ms', max: 0 } });
+  metricsChart = new TmChart('metricsChart', { left: { title: 'per second, gauges', max: 0 } });
+  window.addEventListener('resize', () => [cpuChart, memChart, ipcChart, metricsChart].forEach(ch => ch.draw()));
+}
+
+let updating = false;
+let stopCharts = false;
+const isrLabels = { core0: '(isr core 0)', core1: '(isr core 1)', timers: '(esp_timer callbacks)' };
+
+async function updateChartData() {
+    if (updating) {
+    //setTimeout(updateChartData, 1000);
+    return;
+  }
+
+  if (stopCharts) return;      // <-- Do not run if stopped
+
+  updating = true;
+  
+  try {
+    // the whole history the first time, then only what is newer than what we have
+    const full = !lastTime;
+    const res = await fetch(`/data?top=${maxTasks}&min=2&window=${sampleCount}` + (full ? '' : `&since=${lastTime}`));
+    const json = await res.json();
+
+    // the samples can be unevenly spaced (adaptive sampling), so the axis is the time the
+    // esp32 history covers rather than a count of samples
+    if (json.interval) sampleInterval = json.interval;
+    if (json.oldest) sampleSpan = Math.max(json.newest - json.oldest, sampleCount * sampleInterval);
+    if (json.epoch) clockOffset = json.epoch - json.newest;
+    const times = json.time || [];
+    marks = json.marks || [];
+    cpuChart.setMarks(marks);
+
+    // ---- Task lines, TASKMAN_SCOPE regions dashed, interrupts dotted - all % of a core ----
+    const cpu = {};
+    const taskNames = [];
+    Object.entries(json).forEach(([name, data]) => {
+      if (['ram', 'psram', 'largest', 'time', 'marks'].includes(name) || !Array.isArray(data)) return;
+      taskNames.push(name);
+      cpu[name] = data;
+    });
+    Object.entries(json.regions || {}).forEach(([name, data]) => cpu[`[${name}]`] = data);
+    Object.entries(json.isr || {}).forEach(([name, data]) => cpu[isrLabels[name] || name] = data);
+
+    // the busiest tasks changed, or the esp32 restarted - start again with everything
+    const known = cpuChart.series.filter(s => s.task).map(s => s.label);
+    if (!full && (json.newest < lastTime || taskNames.length !== known.length || taskNames.some(n => !known.includes(n)))) {
+      lastTime = 0;
+      updating = false;
+      return updateChartData();
+    }
+
+    let n = cpuChart.series.length;
+    taskNames.forEach(name => cpuChart.set(name, { task: true, color: cpuChart.series.find(s => s.label === name)?.color || `hsl(${n++ * 70 % 360}, 70%, 50%)` }));
+    Object.keys(json.regions || {}).forEach((name, i) => cpuChart.set(`[${name}]`, { color: `hsl(${(i * 70 + 200) % 360}, 60%, 35%)`, dash: [4, 3] }));
+    Object.keys(json.isr || {}).forEach((name, i) => cpuChart.set(isrLabels[name] || name, { color: `hsl(${i * 40}, 80%, 30%)`, dash: [1, 2] }));
+
+    // ---- Memory ----
+    const mem = { 'free RAM': json.ram, 'free PSRAM': json.psram, 'largest block': json.largest };
+
+    // ---- Queues as % full, mutexes as ms waited per sample ----
+    const ipc = {};
+    Object.entries(json.ipc || {}).forEach(([name, o], i) => {
+      const label = o.kind === 'queue' ? `${name} % full` : `${name} wait ms`;
+      ipc[label] = o.kind === 'queue' ? o.v.map(v => o.cap ? Math.round(v * 100 / o.cap) : 0) : o.v;
+      ipcChart.set(label, { color: `hsl(${(i * 70 + 35) % 360}, 70%, 40%)`, axis: o.kind === 'queue' ? 'left' : 'right', dash: o.kind === 'queue' ? [] : [4, 3] });
+    });
+    if (Object.keys(ipc).length) document.getElementById('ipcChart').style.display = '';
+
+    // ---- Counters as a rate, gauges as they are ----
+    const metrics = {};
+    Object.entries(json.metrics || {}).forEach(([name, o], i) => {
+      const label = o.kind === 'rate' ? `${name} /s` : name;
+      metrics[label] = o.v;
+      metricsChart.set(label, { color: `hsl(${(i * 70 + 15) % 360}, 70%, 45%)` });
+    });
+    if (Object.keys(metrics).length) document.getElementById('metricsChart').style.display = '';
+
+    if (full) {
+      cpuChart.replace(times, cpu);
+      memChart.replace(times, mem);
+      ipcChart.replace(times, ipc);
+      metricsChart.replace(times, metrics);
+    } else {
+      cpuChart.append(times, cpu);
+      memChart.append(times, mem);
+      ipcChart.append(times, ipc);
+      metricsChart.append(times, metrics);
+    }
+    if (times.length) lastTime = times[times.length - 1];
+
+    // ---- Stacked per-core view, same colours as the cpu lines ----
+    if (json.cores) {
+      drawBars('coreChart', Object.entries(json.cores).map(([name, v]) => {
+        const line = cpuChart.series.find(s => s.label === name);
+        return { label: name, data: v, color: line ? line.color : '#999' };
+      }), true, 'CPU % of each core, newest sample');
+    }
+
+    // ---- Sampler overhead ----
+    if (json.monitor && json.monitor.execUs.length) {
+      const m = json.monitor;
+      const avg = a => a.reduce((x, y) => x + y, 0) / a.length;
+      const maxAbs = a => Math.max(...a.map(Math.abs));
+      document.getElementById('monitorInfo').textContent =
+        `sampler: ${avg(m.execUs).toFixed(0)} us per sample (uxTaskGetSystemState ${avg(m.snapshotUs).toFixed(0)} us), ` +
+        `jitter up to ${(maxAbs(m.jitterUs) / 1000).toFixed(1)} ms, ${m.missedTotal} missed periods since boot`;
+    }
+
+  } catch (err) {
+    console.error('updateChartData failed:', err);
+  }
+    updating = false;
+  setTimeout(updateChartData, 1000); // next tick
+}
+
+let charttimer;
+let tabletimer;
+
+async function startWork() {
+  console.log("Starting work (tab visible)");
+  stopCharts = false;
+  updateChartData();
+  updateTable();
+  
+  tabletimer = setInterval(updateTable, 30000);
+}
+
+function stopWork() {
+  console.log("Stopping work (tab hidden)");
+  //clearInterval(charttimer);
+  stopCharts = true;        // <-- prevents future scheduling
+  clearInterval(tabletimer);
+}
+
+document.addEventListener("visibilitychange", async () => {
+  if (document.visibilityState === "hidden") stopWork();
+  else await startWork();
+});
+
+function init(){
+  createChart();
+  startWork();
+}
+
+window.addEventListener("load", init);
+
+async function updateTable() {
+  try {
+    const res = await fetch('/dataInfo');
+    if (!res.ok) throw new Error("Fetch failed");
+    const json = await res.json();
+    const tbody = document.querySelector('#taskTable tbody');
+    tbody.innerHTML = '';
+    const stateNames = { 0: 'Running', 1: 'Ready', 2: 'Blocked', 3: 'Suspended', 4: 'Deleted' };
+    const alerts = (json._alerts || []).map(a => a.type === 'leak'
+      ? `${a.series} falling ${-a.slopeKBh} KB/hour, ${a.hoursLeft} hours left`
+      : `${a.task} at ${a.pct}% (usually ${a.mean}%, z=${a.z}) ${a.agoS}s ago`);
+    const reg = json._regions;
+    if (reg && Object.keys(reg.regions).length) {
+      document.getElementById('regionTable').style.display = '';
+      document.querySelector('#regionTable tbody').innerHTML = Object.entries(reg.regions).map(([name, r]) =>
+        `<tr><td>${name}</td><td>${r.calls}</td><td>${r.perSec}</td><td>${r.pct}</td><td>${r.avgUs}</td><td>&le;${r.p50Us}</td><td>&le;${r.p99Us}</td><td>${r.maxUs}</td><td>${r.totalMs}</td></tr>`).join('');
+      document.getElementById('regionInfo').textContent = `TASKMAN_SCOPE itself costs ${reg.overheadCycles} cycles at ${reg.mhz}MHz, included in the times above`;
+    }
+    const isrKinds = { isr: 'isr', timer_isr: 'timer, isr', timer: 'timer' };
+    document.getElementById('isrInfo').textContent = Object.entries(json._isr || {}).map(([name, o]) =>
+      `${name} (${isrKinds[o.kind]}): ${o.perSec}/s, ${o.pct}% of a core, avg ${o.avgUs}us, max ${o.maxUs}us`).join(' | ');
+    for (const [name, info] of Object.entries(json)) {
+      if (info && info.starve && info.starve.now) alerts.push(`${name} ready but starved for ${(info.starve.nowMs / 1000).toFixed(1)} s`);
+    }
+    Object.entries(json._ipc || {}).forEach(([name, o]) => {
+      if (o.hint === 'consumer slow') alerts.push(`queue ${name} full ${o.fullPct}% of the time, consumer slow`);
+    });
+    document.getElementById('ipcInfo').textContent = Object.entries(json._ipc || {}).map(([name, o]) => o.kind === 'queue'
+      ? `${name}: ${o.now}/${o.cap}, avg ${o.avg}, full ${o.fullPct}% empty ${o.emptyPct}%${o.hint ? ' - ' + o.hint : ''}`
+      : `${name}: held by ${o.holder || '-'}, ${o.blocked} of ${o.takes} takes waited, ${o.waitMsTotal}ms total, max ${o.waitMsMax}ms, ${o.timeouts} timeouts`).join(' | ');
+    (json._inversions || []).forEach(v => alerts.push(`${v.holder} boosted ${v.base}->${v.prio}` + (v.waiting.length ? `, holding up ${v.waiting.join(', ')}` : '')));
+    document.getElementById('alerts').textContent = alerts.length ? 'Alerts: ' + alerts.join(' - ') : '';
+    const b = json._balance;
+    if (b) {
+      drawBars('balanceChart', [{ label: 'actual', data: b.actual, color: '#999' }, { label: 'projected', data: b.projected, color: '#4a4' }],
+        false, 'CPU % of each core, balance window');
+      const moves = b.moves.map(m => `${m.task} (${m.pct}%) ${m.from < 0 ? 'unpinned' : 'core ' + m.from} -> core ${m.to}`);
+      document.getElementById('balanceInfo').textContent = (moves.length ? 'Suggested: ' + moves.join(', ') : 'Nothing worth moving')
+        + ` - ${b.agoS}s ago` + (moves.length && !b.canApply ? ', taskman_balance_set_apply() to let taskman_balance_apply() make them' : '');
+    }
+    for (const [name, info] of Object.entries(json)) {
+      if (name.startsWith('_')) continue;  // _alerts, _trend, _balance
+      const row = document.createElement('tr');
+      row.innerHTML = `
+        <td>${name}</td>
+        <td>${info.core == 2147483647 ? '-' : info.core}</td>
+        <td>${info.core0 ?? '-'}</td>
+        <td>${info.core1 ?? '-'}</td>
+        <td>${info.win ? info.win.mean : '-'}</td>
+        <td>${info.win ? info.win.std : '-'}</td>
+        <td>${info.win ? info.win.p95 : '-'}</td>
+        <td>${info.win ? info.win.max : '-'}</td>
+        <td>${info.boot ? `${info.boot.mean} / ${info.boot.p95} / ${info.boot.max}` : '-'}</td>
+        <td>${info.mix ? `${info.mix[1]} / ${info.mix[2]}` : '-'}${info.starve && info.starve.now ? ' <b style="color:#b00">starved</b>' : ''}${info.boost && info.boost.now ? ` <b style="color:#b60">boosted ${info.boost.base}->${info.prio}</b>` : ''}</td>
+        <td>${info.prio}</td>
+        <td>${info.stackHW}</td>
+        <td>${stateNames[info.state] ?? info.state}</td>
+      `;
+      tbody.appendChild(row);
+    }
+  } catch (e) {
+    console.error("updateTable error:", e);
+  }
+}
+</script>
+</body>
+</html>
+)rawliteral";
+
+  httpd_resp_send(req, html.c_str(), HTTPD_RESP_USE_STRLEN);
+  return ESP_OK;
+}
+#endif
+
+esp_err_t taskman_handleDataInfo(httpd_req_t* req) {
+  taskman_adaptiveViewed();
+  String json = "{";
+  bool firstTask = true;
+
+  for (int i = 0; i < maxtaskCount; i++) {
+    //if (!tasks[i].active) continue;
+    if (!firstTask) json += ",";
+    firstTask = false;
+
+    json += "\"" + tasks[i].name + "\":{";
+    json += "\"core\":" + String(tasks[i].core);
+    json += ",\"prio\":" + String(tasks[i].currentPrio);
+    json += ",\"stackHW\":" + String(tasks[i].stackHighWater);
+    json += ",\"state\":" + String(tasks[i].state);
+#if TASKMAN_CORE_SPLIT
+    json += ",\"core0\":" + String(tasks[i].corePct[0], 1);
+    json += ",\"core1\":" + String(tasks[i].corePct[1], 1);
+#endif
+#if TASKMAN_TASK_STATS
+    json += "," + taskman_statsJson(i);
+#endif
+#if TASKMAN_STATE_HISTORY
+    json += "," + taskman_stateJson(i);
+#endif
+    json += "}";
+  }
+
+#if TASKMAN_ALERTS
+  if (!firstTask) json += ",";
+  json += taskman_alertsJson();
+#endif
+#if TASKMAN_BALANCE
+  if (json.length() > 1) json += ",";
+  json += taskman_balanceJson();
+#endif
+#if TASKMAN_STATE_HISTORY
+  if (json.length() > 1) json += ",";
+  json += taskman_inversionsJson();
+#endif
+#if TASKMAN_IPC
+  if (json.length() > 1) json += ",";
+  json += taskman_ipcJson();
+#endif
+#if TASKMAN_METRICS
+  if (json.length() > 1) json += ",";
+  json += taskman_metricsJson();
+#endif
+#if TASKMAN_REGIONS
+  if (json.length() > 1) json += ",";
+  json += taskman_regionsJson();
+#endif
+#if TASKMAN_ISR_STATS
+  if (json.length() > 1) json += ",";
+  json += taskman_isrJson();
+#endif
+
+  json += "}";
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_send(req, json.c_str(), json.length());
+  return ESP_OK;
+}
+
+// Read one key from the query string, false if missing
+bool taskman_getQuery(httpd_req_t* req, const char* key, char* val, size_t len) {
+  char query[256];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) return false;
+  return httpd_query_key_value(query, key, val, len) == ESP_OK;
+}
+
+// %20 and + back to spaces etc, in place
+void taskman_urlDecode(char* s) {
+  char* out = s;
+  for (; *s; s++) {
+    if (*s == '+') {
+      *out++ = ' ';
+    } else if (*s == '%' && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2])) {
+      char hex[3] = { s[1], s[2], 0 };
+      *out++ = (char)strtol(hex, nullptr, 16);
+      s += 2;
+    } else {
+      *out++ = *s;
+    }
+  }
+  *out = 0;
+}
+
+// s for inside a quoted csv field, every " doubled - cut short rather than run past size
+char* taskman_csvEscape(const char* s, char* out, size_t size) {
+  size_t n = 0;
+  for (; *s && n + 3 < size; s++) {
+    if (*s == '"') out[n++] = '"';
+    out[n++] = *s;
+  }
+  out[n] = 0;
+  return out;
+}
+
+#include <algorithm>
+
+// ---- /data selection ----
+// With no query the old rule applies - every task that was ever over 2%.
+struct DataQuery {
+  int top = 0;             // keep the busiest N, 0 for all
+  float minPct = -1;       // peak in the window at least this, -1 for the old rule
+  int window = 10;         // newest samples that top and min look at
+  int points = SAMPLE_COUNT;
+  char tasks[192] = "";    // comma separated names, overrides min
+  uint32_t since = 0;      // only samples taken after this uptime in ms, 0 for all
+};
+
+void taskman_parseDataQuery(httpd_req_t* req, DataQuery& q) {
+  char val[16];
+  if (taskman_getQuery(req, "top", val, sizeof(val))) q.top = max(atoi(val), 0);
+  if (taskman_getQuery(req, "min", val, sizeof(val))) q.minPct = atof(val);
+  if (taskman_getQuery(req, "window", val, sizeof(val))) q.window = constrain(atoi(val), 1, SAMPLE_COUNT);
+  if (taskman_getQuery(req, "points", val, sizeof(val))) q.points = constrain(atoi(val), 2, SAMPLE_COUNT);
+  if (taskman_getQuery(req, "tasks", q.tasks, sizeof(q.tasks))) taskman_urlDecode(q.tasks);
+  if (taskman_getQuery(req, "since", val, sizeof(val))) q.since = strtoul(val, nullptr, 10);
+}
+
+// over the time the newest window samples cover, not the sample count
+float taskman_windowAvg(int i, int window) {
+  float sum = 0;
+  uint32_t ms = 0;
+  for (int k = 0; k < window; k++) {
+    uint32_t dt = taskman_sampleMs(k);
+    sum += tasks[i].last(k) * dt;
+    ms += dt;
+  }
+  return ms ? sum / ms : 0;
+}
+
+float taskman_windowMax(int i, int window) {
+  float peak = 0;
+  for (int k = 0; k < window; k++) peak = max(peak, tasks[i].last(k));
+  return peak;
+}
+
+// Slots to send, in slot order so the colours on the graph stay put
+int taskman_selectTasks(const DataQuery& q, int* out) {
+  int count = 0;
+  for (int i = 0; i < maxtaskCount; i++) {
+    bool keep;
+    if (q.tasks[0]) keep = taskman_inList(q.tasks, tasks[i].name);
+    else if (q.minPct >= 0) keep = taskman_windowMax(i, q.window) >= q.minPct;
+    else keep = tasks[i].over2;
+    if (keep) out[count++] = i;
+  }
+
+  if (q.top > 0 && count > q.top) {
+    float score[MAX_TASKS];
+    for (int k = 0; k < count; k++) score[out[k]] = taskman_windowAvg(out[k], q.window);
+    std::partial_sort(out, out + q.top, out + count, [&](int a, int b) { return score[a] > score[b]; });
+    count = q.top;
+    std::sort(out, out + count);
+  }
+  return count;
+}
+
+///
+esp_err_t taskman_handleData(httpd_req_t* req) {
+  httpd_resp_set_type(req, "application/json");
+
+  char buf[1024];
+  size_t off = 0;
+
+// Helper: append and flush when needed
+#define FLUSH_IF_FULL() \
+  if (off >= sizeof(buf) - 64) { \
+    httpd_resp_send_chunk(req, buf, off); \
+    off = 0; \
+  }
+
+// snprintf returns what it wanted to write, off stays inside buf when that was cut short
+#define APPEND(fmt, ...) \
+  do { \
+    off += snprintf(buf + off, sizeof(buf) - off, fmt, ##__VA_ARGS__); \
+    if (off > sizeof(buf) - 1) off = sizeof(buf) - 1; \
+    FLUSH_IF_FULL(); \
+  } while (0)
+
+  DataQuery q;
+  taskman_parseDataQuery(req, q);
+  taskman_adaptiveViewed();
+
+  int selected[MAX_TASKS];
+  int selectedCount = taskman_selectTasks(q, selected);
+
+  // ?since= skips the samples the caller already has, so a graph can just append the new
+  // ones.  An empty slot (time 0) is never after since.
+  int first = 0;
+  if (q.since) {
+    while (first < SAMPLE_COUNT && (int32_t)(sysSamples.timeMs[sysSamples.oldest(first)] - q.since) <= 0) first++;
+  }
+  const int count = SAMPLE_COUNT - first;
+
+  // With ?points= each bucket of samples becomes its min and its max, in the order they
+  // happened, so a one sample spike survives.  Every series has the same length.
+  const int buckets = q.points / 2;
+  const bool decimate = q.points < count;
+
+  // One series, oldest first, get(j) is sample j
+  auto series = [&](const char* fmt, auto get) {
+    if (!decimate) {
+      for (int j = first; j < SAMPLE_COUNT; j++) {
+        APPEND(fmt, get(j));
+        if (j < SAMPLE_COUNT - 1) APPEND(",");
+      }
+      return;
+    }
+    for (int b = 0; b < buckets; b++) {
+      int from = first + b * count / buckets;
+      int to = first + (b + 1) * count / buckets;
+      int lo = from, hi = from;
+      for (int j = from + 1; j < to; j++) {
+        if (get(j) < get(lo)) lo = j;
+        if (get(j) > get(hi)) hi = j;
+      }
+      APPEND(fmt, get(min(lo, hi)));
+      APPEND(",");
+      APPEND(fmt, get(max(lo, hi)));
+      if (b < buckets - 1) APPEND(",");
+    }
+  };
+
+  // Start JSON
+  APPEND("{");
+
+  bool firstItem = true;
+
+  // ---- Per-task CPU history ----
+  for (int k = 0; k < selectedCount; k++) {
+    int i = selected[k];
+
+    if (!firstItem) APPEND(",");
+    firstItem = false;
+
+    // Task name
+    APPEND("\"%.64s\":[", tasks[i].name.c_str());
+
+    // History samples
+    series("%.1f", [&](int j) { return (double)tasks[i].at(j); });
+
+    APPEND("]");
+  }
+
+  // ---- System RAM history ----
+  if (!firstItem) APPEND(",");
+  APPEND("\"ram\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.freeRam[sysSamples.oldest(j)]; });
+  APPEND("],");
+
+  // ---- System PSRAM history ----
+  APPEND("\"psram\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.freePSRam[sysSamples.oldest(j)]; });
+  APPEND("],");
+
+  // ---- Largest free block history ----
+  APPEND("\"largest\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.largestBlock[sysSamples.oldest(j)]; });
+  APPEND("]");
+
+  // ---- Sample times, uptime in ms - the start and end of each bucket when decimated ----
+  APPEND(",\"time\":[");
+
+  if (!decimate) {
+    for (int i = first; i < SAMPLE_COUNT; i++) {
+      APPEND("%u", sysSamples.timeMs[sysSamples.oldest(i)]);
+      if (i < SAMPLE_COUNT - 1) APPEND(",");
+    }
+  } else {
+    for (int b = 0; b < buckets; b++) {
+      int from = first + b * count / buckets;
+      int to = first + (b + 1) * count / buckets;
+      APPEND("%u,%u", sysSamples.timeMs[sysSamples.oldest(from)], sysSamples.timeMs[sysSamples.oldest(to - 1)]);
+      if (b < buckets - 1) APPEND(",");
+    }
+  }
+
+  APPEND("]");
+
+#if TASKMAN_MONITOR_STATS
+  // ---- What the sampler itself costs ----
+  APPEND(",\"monitor\":{\"missedTotal\":%u", sysSamples.mon.missedTotal);
+
+  APPEND(",\"execUs\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.mon.execUs[sysSamples.oldest(j)]; });
+  APPEND("],\"snapshotUs\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.mon.snapshotUs[sysSamples.oldest(j)]; });
+  APPEND("],\"jitterUs\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.mon.jitterUs[sysSamples.oldest(j)]; });
+  APPEND("],\"missed\":[");
+  series("%.0f", [&](int j) { return (double)sysSamples.mon.missed[sysSamples.oldest(j)]; });
+  APPEND("]}");
+#endif
+
+#if TASKMAN_CORE_SPLIT
+  // ---- Newest sample split by core, for the stacked view ----
+  APPEND(",\"cores\":{");
+  for (int k = 0; k < selectedCount; k++) {
+    int i = selected[k];
+    APPEND("%s\"%.64s\":[%.1f,%.1f]", k ? "," : "", tasks[i].name.c_str(), tasks[i].corePct[0], tasks[i].corePct[1]);
+  }
+  APPEND("}");
+#endif
+
+#if TASKMAN_IPC
+  // ---- Watched queues (messages waiting) and mutexes (ms waited) ----
+  APPEND(",\"ipc\":{");
+  for (int k = 0; k < watchedCount; k++) {
+    const Watched& w = watched[k];
+    APPEND("%s\"%s\":{\"kind\":\"%s\",\"cap\":%u,\"v\":[", k ? "," : "", w.name, w.isMutex ? "mutex" : "queue", w.capacity);
+    series("%.0f", [&](int j) { return (double)w.value.oldest(j); });
+    APPEND("]}");
+  }
+  APPEND("}");
+#endif
+
+#if TASKMAN_METRICS
+  // ---- Your counters (per second) and gauges ----
+  APPEND(",\"metrics\":{");
+  for (int k = 0; k < metrics.used; k++) {
+    APPEND("%s\"%s\":{\"kind\":\"%s\",\"v\":[", k ? "," : "", metrics.name[k], metrics.isGauge[k] ? "gauge" : "rate");
+    series("%.6g", [&](int j) { return (double)metrics.value[k].oldest(j); });
+    APPEND("]}");
+  }
+  APPEND("}");
+#endif
+
+#if TASKMAN_REGIONS
+  // ---- TASKMAN_SCOPE regions, % of one core ----
+  APPEND(",\"regions\":{");
+  for (int k = 0; k < regionCount; k++) {
+    APPEND("%s\"%s\":[", k ? "," : "", regions[k].name);
+    series("%.1f", [&](int j) { return (double)SampleCodec<TASKMAN_SAMPLE_TYPE>::decode(regions[k].usage.oldest(j)); });
+    APPEND("]");
+  }
+  APPEND("}");
+#endif
+
+#if TASKMAN_ISR_STATS
+  // ---- Timed interrupts by core, and esp_timer task callbacks, % of one core ----
+  APPEND(",\"isr\":{\"core0\":[");
+  series("%.1f", [&](int j) { return sysSamples.isr.isr[0][sysSamples.oldest(j)] / 10.0; });
+  APPEND("],\"core1\":[");
+  series("%.1f", [&](int j) { return sysSamples.isr.isr[1][sysSamples.oldest(j)] / 10.0; });
+  APPEND("],\"timers\":[");
+  series("%.1f", [&](int j) { return sysSamples.isr.timer[sysSamples.oldest(j)] / 10.0; });
+  APPEND("]}");
+#endif
+
+#if TASKMAN_ANNOTATIONS
+  // ---- Markers inside the window ----
+  APPEND(",\"marks\":[");
+  bool firstMark = true;
+  uint32_t oldestMs = sysSamples.timeMs[sysSamples.oldest(0)];
+  for (int k = 0; k < MAX_ANNOTATIONS; k++) {
+    const Annotation& a = annotations[(nextAnnotation + k) % MAX_ANNOTATIONS];
+    if (!a.timeMs || a.timeMs < oldestMs) continue;
+    if (!firstMark) APPEND(",");
+    firstMark = false;
+    String mark = taskman_annotationJson(a);
+    if (off + mark.length() >= sizeof(buf)) {  // longer than the 64 FLUSH_IF_FULL leaves
+      httpd_resp_send_chunk(req, buf, off);
+      off = 0;
+    }
+    APPEND("%s", mark.c_str());
+  }
+  APPEND("]");
+#endif
+
+  // ---- Sample interval now, the newest sample time so a caller using ?since= can tell the
+  // esp32 restarted, and the oldest so it knows how far back the history goes ----
+  int filled = 0;
+  while (filled < SAMPLE_COUNT - 1 && !sysSamples.timeMs[sysSamples.oldest(filled)]) filled++;
+  APPEND(",\"interval\":%u,\"newest\":%u,\"oldest\":%u", taskman_period_ms, sysSamples.timeMs[sysSamples.newest()],
+         sysSamples.timeMs[sysSamples.oldest(filled)]);
+#if TASKMAN_WALL_CLOCK
+  // wall clock of the newest sample, 0 until SNTP has set it
+  APPEND(",\"epoch\":%llu", (unsigned long long)sysSamples.clock.epochMs[sysSamples.newest()]);
+#endif
+
+  // End JSON
+  APPEND("}");
+
+  // Flush leftover
+  if (off) httpd_resp_send_chunk(req, buf, off);
+
+  // Terminate chunks
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  return ESP_OK;
+}
+
+#if TASKMAN_CSV_EXPORT
+// the utc column, empty while the clock wasn't set
+static const char* taskman_csvUtc(uint64_t epochMs, char* out, size_t size) {
+  out[0] = 0;
+  if (!epochMs) return out;
+  time_t s = epochMs / 1000;
+  struct tm tm;
+  gmtime_r(&s, &tm);
+  snprintf(out, size, "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
+           tm.tm_min, tm.tm_sec, (unsigned)(epochMs % 1000));
+  return out;
+}
+
+#if TASKMAN_PERSIST
+// /export.csv?flash=1 - the flash history instead, every boot, a row per rollup record
+esp_err_t taskman_handleExportFlashCsv(httpd_req_t* req) {
+  if (!persist.io) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no taskman partition");
+    return ESP_FAIL;
+  }
+  httpd_resp_set_type(req, "text/csv");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"taskman_history.csv\"");
+
+  char buf[1024];
+  size_t off = 0;
+  char utc[32], name[sizeof(PersistTop::name) + 1], q[2 * sizeof(PersistTop::name) + 1];
+
+  APPEND("seq,boot,uptime_s,epoch,utc,samples,interval_ms,ram_min_kb,psram_min_kb,largest_min_kb,core0_busy,core1_busy");
+  for (int k = 1; k <= 3; k++) APPEND(",top%d,top%d_avg,top%d_max", k, k, k);
+  APPEND("\n");
+
+  PersistRecord r;
+  for (uint32_t i = 0; i < persist.slots + persist.batchCount; i++) {
+    if (!taskman_persistRecord(i, r)) continue;
+    APPEND("%u,%u,%u,%u,%s", r.seq, r.boot, r.uptimeS, r.epoch, taskman_csvUtc(r.epoch * 1000ULL, utc, sizeof(utc)));
+    APPEND(",%u,%u,%u,%u,%u,%u,%u", r.samples, r.intervalMs, r.ramMinKB, r.psramMinKB, r.largestMinKB, r.coreBusy[0], r.coreBusy[1]);
+    for (int k = 0; k < 3; k++) {
+      if (!r.top[k].name[0]) {
+        APPEND(",,,");
+        continue;
+      }
+      memcpy(name, r.top[k].name, sizeof(r.top[k].name));  // 8 chars, no room for the NUL
+      name[sizeof(r.top[k].name)] = 0;
+      APPEND(",\"%s\",%.1f,%.1f", taskman_csvEscape(name, q, sizeof(q)), r.top[k].avg2 / 2.0f, r.top[k].max2 / 2.0f);
+    }
+    APPEND("\n");
+  }
+
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
+
+// /export.csv - the whole history a row per sample, oldest first: uptime, wall clock, memory,
+// every task, then your queues, mutexes, counters, regions and interrupt time.  Sent a row at
+// a time through one chunk buffer, so it costs the same however long the history is.
+// Names are quoted with any " doubled.
+esp_err_t taskman_handleExportCsv(httpd_req_t* req) {
+#if TASKMAN_PERSIST
+  char val[8];
+  if (taskman_getQuery(req, "flash", val, sizeof(val)) && atoi(val)) return taskman_handleExportFlashCsv(req);
+#endif
+  httpd_resp_set_type(req, "text/csv");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"taskman.csv\"");
+  taskman_adaptiveViewed();
+
+  char buf[1024];
+  size_t off = 0;
+  char utc[32], q[2 * 24 + 1];  // the longest name, a region's, with every character a quote
+
+  // tasks seen after the header was sent aren't in this file
+  const int taskCount = maxtaskCount;
+
+  // ---- Header ----
+  APPEND("uptime_ms,epoch_ms,utc,free_ram_kb,free_psram_kb,largest_block_kb");
+  for (int i = 0; i < taskCount; i++) APPEND(",\"%s\"", taskman_csvEscape(tasks[i].name.c_str(), q, sizeof(q)));
+#if TASKMAN_IPC
+  for (int k = 0; k < watchedCount; k++)
+    APPEND(",\"%s %s\"", taskman_csvEscape(watched[k].name, q, sizeof(q)), watched[k].isMutex ? "wait ms" : "waiting");
+#endif
+#if TASKMAN_METRICS
+  for (int k = 0; k < metrics.used; k++) APPEND(",\"%s%s\"", taskman_csvEscape(metrics.name[k], q, sizeof(q)), metrics.isGauge[k] ? "" : " /s");
+#endif
+#if TASKMAN_REGIONS
+  for (int k = 0; k < regionCount; k++) APPEND(",\"[%s]\"", taskman_csvEscape(regions[k].name, q, sizeof(q)));
+#endif
+#if TASKMAN_ISR_STATS
+  APPEND(",isr core 0,isr core 1,esp_timer callbacks");
+#endif
+  APPEND("\n");
+
+  // ---- A row per sample ----
+  const int startIndex = sysSamples.index;
+  for (int j = 0; j < SAMPLE_COUNT; j++) {
+    // samples taken while this is sent push the history along, follow the same sample
+    int k = j - (sysSamples.index - startIndex + SAMPLE_COUNT) % SAMPLE_COUNT;
+    if (k < 0) continue;  // already overwritten
+    int pos = sysSamples.oldest(k);
+    if (!sysSamples.timeMs[pos]) continue;  // not filled since boot or a rate change
+
+    APPEND("%u,", sysSamples.timeMs[pos]);
+    uint64_t epochMs = 0;
+    if constexpr (sysSamples.clock.enabled) epochMs = sysSamples.clock.epochMs[pos];
+    if (epochMs) APPEND("%llu", (unsigned long long)epochMs);
+    APPEND(",%s", taskman_csvUtc(epochMs, utc, sizeof(utc)));
+    APPEND(",%u,%u,%u", sysSamples.freeRam[pos], sysSamples.freePSRam[pos], sysSamples.largestBlock[pos]);
+
+    for (int i = 0; i < taskCount; i++) APPEND(",%.1f", (double)tasks[i].at(k));
+#if TASKMAN_IPC
+    for (int w = 0; w < watchedCount; w++) APPEND(",%u", (unsigned)watched[w].value.oldest(k));
+#endif
+#if TASKMAN_METRICS
+    for (int m = 0; m < metrics.used; m++) APPEND(",%.6g", (double)metrics.value[m].oldest(k));
+#endif
+#if TASKMAN_REGIONS
+    for (int r = 0; r < regionCount; r++) APPEND(",%.1f", (double)SampleCodec<TASKMAN_SAMPLE_TYPE>::decode(regions[r].usage.oldest(k)));
+#endif
+#if TASKMAN_ISR_STATS
+    APPEND(",%.1f,%.1f,%.1f", sysSamples.isr.isr[0][pos] / 10.0, sysSamples.isr.isr[1][pos] / 10.0, sysSamples.isr.timer[pos] / 10.0);
+#endif
+    APPEND("\n");
+  }
+
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
+
+// /config?interval=250  or  /config?rate=4  changes the sampling rate and resets the graphs
+// /config?adaptive=1&fast=250&base=2000&idle=10000  samples faster while things change
+// /config?adaptive=0  back to the fixed interval
+esp_err_t taskman_handleConfig(httpd_req_t* req) {
+  char val[16];
+  bool ok = true;
+
+  if (taskman_getQuery(req, "interval", val, sizeof(val))) {
+    ok = taskman_set_sample_interval(atoi(val));
+  } else if (taskman_getQuery(req, "rate", val, sizeof(val))) {
+    float hz = atof(val);
+    ok = (hz > 0) && taskman_set_sample_interval((uint32_t)(1000.0f / hz));
+  }
+#if TASKMAN_ADAPTIVE
+  if (taskman_getQuery(req, "adaptive", val, sizeof(val))) {
+    if (atoi(val)) {
+      uint32_t fast = taskman_getQuery(req, "fast", val, sizeof(val)) ? atoi(val) : adaptive.fastMs;
+      uint32_t base = taskman_getQuery(req, "base", val, sizeof(val)) ? atoi(val) : adaptive.baseMs;
+      uint32_t idle = taskman_getQuery(req, "idle", val, sizeof(val)) ? atoi(val) : adaptive.idleMs;
+      ok = taskman_set_adaptive(fast, base, idle);
+    } else {
+      taskman_adaptive_off();
+    }
+  }
+#endif
+
+  uint32_t interval = taskman_pending_interval_ms ? taskman_pending_interval_ms : taskman_sample_interval_ms;
+
+  char json[320];
+  int n = snprintf(json, sizeof(json),
+                   "{\"ok\":%s,\"interval\":%u,\"rate\":%.2f,\"period\":%u,\"samples\":%d,\"burstMax\":%d",
+                   ok ? "true" : "false", interval, 1000.0f / interval, taskman_period_ms, SAMPLE_COUNT, TASKMAN_BURST ? BURST_MAX_SAMPLES : 0);
+#if TASKMAN_ADAPTIVE
+  n += snprintf(json + n, sizeof(json) - n,
+                ",\"adaptive\":{\"on\":%s,\"fast\":%u,\"base\":%u,\"idle\":%u,\"watched\":%s,\"changes\":%u}",
+                adaptive.enabled ? "true" : "false", adaptive.fastMs, adaptive.baseMs, adaptive.idleMs,
+                taskman_adaptiveWatched() ? "true" : "false", adaptive.changes);
+#endif
+  snprintf(json + n, sizeof(json) - n, "}");
+
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, json);
+}
+
+#if TASKMAN_BURST
+// /burst?hz=100&ms=2000 starts a burst, /burst returns the last one
+esp_err_t taskman_handleBurst(httpd_req_t* req) {
+  httpd_resp_set_type(req, "application/json");
+
+  char hzStr[8], msStr[8];
+  if (taskman_getQuery(req, "hz", hzStr, sizeof(hzStr))) {
+    uint32_t ms = taskman_getQuery(req, "ms", msStr, sizeof(msStr)) ? atoi(msStr) : 2000;
+    bool ok = taskman_start_burst(atoi(hzStr), ms);
+    return httpd_resp_sendstr(req, ok ? "{\"started\":true}" : "{\"started\":false}");
+  }
+
+  char buf[1024];
+  size_t off = 0;
+
+  const char* state = burst.running || burst.requested ? "running" : (burst.ready ? "ready" : "idle");
+  APPEND("{\"state\":\"%s\",\"interval\":%u,\"count\":%d", state, burst.intervalMs, burst.count);
+
+  if (burst.ready) {
+    APPEND(",\"startUs\":%llu,\"tasks\":{", (unsigned long long)burst.startUs);
+
+    bool firstItem = true;
+    for (int i = 0; i < maxtaskCount; i++) {
+      bool any = false;
+      for (int j = 0; j < burst.count && !any; j++) any = burst.usage[j * MAX_TASKS + i] != 0;
+      if (!any) continue;
 
-  // === Memory Chart ===
-  const memCtx = document.getElementById('memChart').getContext('2d');
-  memChart = new Chart(memCtx, {
-    type: 'line',
-    data: {
-      labels: Array.from({ length: sampleCount }, (_, i) => i - sampleCount + 1),
-      datasets: [
-        {
-          label: 'free RAM',
-          yAxisID: 'yRam',
-          borderColor: 'rgb(54, 162, 235)',
-          backgroundColor: 'rgba(54, 162, 235, 0.2)',
-          data: Array(sampleCount).fill(null),
-          pointRadius: 0,       // <-- no points
-          tension: 0.4      // <-- add this for smooth curves
-        },
-        {
-          label: 'free PSRAM',
-          yAxisID: 'yPsram',
-          borderColor: 'rgb(255, 99, 132)',
-          backgroundColor: 'rgba(255, 99, 132, 0.2)',
-          data: Array(sampleCount).fill(null),
-          pointRadius: 0,
-          tension: 0.4      // <-- add this for smooth curves
-        }
-      ]
-    },
-    options: {
-      animation: false,
-      responsive: true,
-      layout: {
-      padding: {
-        right: 0   
-      }
-    },
-        
-  interaction: {
-    mode: 'nearest',    // hover on nearest point, not just direct hit
-    intersect: false,   // don't require pointer to be exactly on a line
-    axis: 'x'           // hover works along x-axis
-  },
-      scales: {
-        x: { position: 'top',
-        title: { display: true, text: 'Seconds Ago' } },
-        yRam: {
-          type: 'linear',
-          position: 'left',
-          beginAtZero: true,
-          max: 300, // KB
-          title: { display: true, text: 'RAM (KB)' }
-        },
-        yPsram: {
-          type: 'linear',
-          position: 'right',
-          beginAtZero: true,
-          max: 5000, 
-          title: { display: true, text: 'PSRAM (KB)' },
-          grid: { drawOnChartArea: false } // keep right axis separate
-        }
-      },
-      plugins: {
-        legend: { position: 'top', labels: { boxWidth: 12 } }
+      if (!firstItem) APPEND(",");
+      firstItem = false;
+
+      APPEND("\"%.64s\":[", tasks[i].name.c_str());
+      for (int j = 0; j < burst.count; j++) {
+        APPEND("%.1f", burst.usage[j * MAX_TASKS + i] / 10.0f);
+        if (j < burst.count - 1) APPEND(",");
       }
+      APPEND("]");
     }
-  });
+    APPEND("}");
+  }
+
+  APPEND("}");
+
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
 }
+#endif
 
-let updating = false;
-let stopCharts = false;
+#if TASKMAN_PROFILER
+// /profile?start=1&hz=997  /profile?stop=1  /profile?reset=1
+// /profile on its own is the counts as text for tools/taskman_profile.cpp, a line per pc,
+// task and core, tab separated
+esp_err_t taskman_handleProfile(httpd_req_t* req) {
+  char val[16];
+  if (taskman_getQuery(req, "start", val, sizeof(val))) {
+    uint32_t hz = taskman_getQuery(req, "hz", val, sizeof(val)) ? atoi(val) : PROFILE_HZ;
+    taskman_profile_reset();
+    bool ok = taskman_profile_start(hz);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_sendstr(req, ok ? "{\"started\":true}" : "{\"started\":false}");
+  }
+  if (taskman_getQuery(req, "stop", val, sizeof(val))) taskman_profile_stop();
+  if (taskman_getQuery(req, "reset", val, sizeof(val))) taskman_profile_reset();
 
-async function updateChartData() {
-    if (updating) {
-    //setTimeout(updateChartData, 1000);
-    return;
+  httpd_resp_set_type(req, "text/plain");
+  char buf[1024];
+  size_t off = 0;
+
+  // a reset not done yet is shown as done
+  bool cleared = profiler.resetPending;
+  uint32_t dropped = profiler.ring && !cleared ? profiler.ring[0].dropped + profiler.ring[1].dropped : 0;
+  APPEND("# taskman profile %s hz=%u running=%d seconds=%u samples=%u overflow=%u dropped=%u\n", getProgramName().c_str(),
+         profiler.hz, profiler.running, cleared ? 0 : (unsigned)((millis() - profiler.startMs) / 1000),
+         cleared ? 0 : profiler.samples, cleared ? 0 : profiler.overflow, dropped);
+  APPEND("# pc\ttask\tcore\tcount\n");
+  for (int i = 0; profiler.slots && !cleared && i < PROFILE_SLOTS; i++) {
+    const ProfileSlot& s = profiler.slots[i];
+    if (!s.pc) continue;
+    APPEND("0x%08x\t%.16s\t%u\t%u\n", (unsigned)s.pc, s.task < maxtaskCount ? tasks[s.task].name.c_str() : "?", s.core, (unsigned)s.count);
   }
 
-  if (stopCharts) return;      // <-- Do not run if stopped
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
 
-  updating = true;
-  
-  try {
-    const res = await fetch('/data');
-    const json = await res.json();
+#if TASKMAN_FAKE_LOAD
+// /scenario?run=1&ms=20000&url=http://...  starts the calibration scenario, /scenario on its
+// own has the last result - expected and measured cpu per task, and ops/s per workload
+esp_err_t taskman_handleScenario(httpd_req_t* req) {
+  char val[16], url[96] = "";
+  bool ok = true;
+  if (taskman_getQuery(req, "run", val, sizeof(val))) {
+    uint32_t ms = taskman_getQuery(req, "ms", val, sizeof(val)) ? atoi(val) : 20000;
+    taskman_getQuery(req, "url", url, sizeof(url));
+    ok = taskman_scenario_calibrate(ms, url);
+  }
 
-    if (!cpuChart || !memChart) return;
-
-    // ---- Update CPU chart ----
-    Object.entries(json).forEach(([name, data], i) => {
-      if (name === 'ram' || name === 'psram') return; // skip memory for now
-
-      let ds = cpuChart.data.datasets.find(d => d.label === name);
-      if (!ds) {
-        ds = {
-          label: name,
-          data: data,
-          borderColor: `hsl(${i * 70 % 360}, 70%, 50%)`,
-          borderWidth: 1.5,
-          fill: false,
-          tension: 0.4,
-          pointRadius: 0  
-        };
-        cpuChart.data.datasets.push(ds);
-      } else {
-        ds.data = data;
+  const Scenario& s = scenario;
+  char item[192];
+  snprintf(item, sizeof(item), "{\"ok\":%s,\"name\":\"%s\",\"running\":%s,\"done\":%s,\"warmupMs\":%u,\"measureMs\":%u,\"interval\":%u",
+           ok ? "true" : "false", s.name, s.running ? "true" : "false", s.done ? "true" : "false", (unsigned)s.warmupMs,
+           (unsigned)s.measureMs, (unsigned)taskman_sample_interval_ms);
+  String json = item;
+  if (s.done) {
+    float maxErr = 0, sumErr = 0;
+    int n = 0;
+    json += ",\"tasks\":[";
+    for (int i = 0; i < s.rowCount; i++) {
+      const ScenarioRow& r = s.rows[i];
+      if (r.expected >= 0) {
+        maxErr = max(maxErr, fabsf(r.measured - r.expected));
+        sumErr += fabsf(r.measured - r.expected);
+        n++;
       }
-    });
-    cpuChart.update('none');
-
-    // ---- Update memory chart ----
-    if (json.ram && json.psram) {
-      memChart.data.datasets[0].data = json.ram;
-      memChart.data.datasets[1].data = json.psram;
-      memChart.update('none');
+      snprintf(item, sizeof(item), "%s{\"task\":\"%s\",\"expected\":%.1f,\"measured\":%.2f}", i ? "," : "", r.task, r.expected, r.measured);
+      json += item;
     }
-
-  } catch (err) {
-    console.error('updateChartData failed:', err);
+    json += "],\"workloads\":[";
+    for (int i = 0; i < s.count; i++) {
+      const TaskmanWorkload& w = s.list[i];
+      snprintf(item, sizeof(item), "%s{\"name\":\"%s\",\"kind\":\"%s\",\"opsPerSec\":%.2f,\"expectedPerSec\":%.2f,\"failures\":%u}",
+               i ? "," : "", w.name, workKindNames[w.kind], s.ops[i] * 1000.0f / s.measureMs, 1000.0f / w.periodMs, (unsigned)s.failures[i]);
+      json += item;
+    }
+    snprintf(item, sizeof(item), "],\"maxErr\":%.2f,\"meanErr\":%.2f,\"heapUsedKB\":%.1f,\"agoS\":%u", maxErr, n ? sumErr / n : 0,
+             s.heapUsedKB, (unsigned)((millis() - s.finishedMs) / 1000));
+    json += item;
   }
-    updating = false;
-  setTimeout(updateChartData, 1000); // next tick
+  json += "}";
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_send(req, json.c_str(), json.length());
+  return ESP_OK;
 }
+#endif
 
+#if TASKMAN_TRIGGERS
+// /trigger?task=loopTask&above=80  /trigger?heap=40  /trigger?largest=16  &post=20  /trigger?clear=1
+// /trigger on its own lists the triggers and the captures
+esp_err_t taskman_handleTrigger(httpd_req_t* req) {
+  char val[24], task[16];
+  bool ok = true;
+
+  if (taskman_getQuery(req, "post", val, sizeof(val))) taskman_set_capture_post(atoi(val));
+
+  if (taskman_getQuery(req, "clear", val, sizeof(val))) {
+    taskman_disarm_triggers();
+  } else if (taskman_getQuery(req, "task", task, sizeof(task)) && taskman_getQuery(req, "above", val, sizeof(val))) {
+    ok = taskman_arm_task_trigger(task, atof(val));
+  } else if (taskman_getQuery(req, "heap", val, sizeof(val))) {
+    ok = taskman_arm_heap_trigger(atoi(val));
+  } else if (taskman_getQuery(req, "largest", val, sizeof(val))) {
+    ok = taskman_arm_largest_trigger(atoi(val));
+  }
 
-let charttimer;
-let tabletimer;
+  const char* typeNames[] = { "none", "task", "heap", "largest" };
+  char esc[6 * 48 + 1];
+
+  String json = "{\"ok\":" + String(ok ? "true" : "false");
+  json += ",\"post\":" + String(capturePost);
+  json += ",\"triggers\":[";
+  bool first = true;
+  for (int i = 0; i < MAX_TRIGGERS; i++) {
+    if (!triggers[i].armed) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"type\":\"" + String(typeNames[triggers[i].type]) + "\"";
+    if (triggers[i].type == TRIG_TASK_ABOVE) json += ",\"task\":\"" + String(taskman_jsonEscape(triggers[i].task, esc, sizeof(esc))) + "\"";
+    json += ",\"threshold\":" + String(triggers[i].threshold, 1) + "}";
+  }
+  json += "],\"captures\":[";
+  first = true;
+  for (int c = 0; c < MAX_CAPTURES; c++) {
+    if (!captures[c].used) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"n\":" + String(c);
+    json += ",\"reason\":\"" + String(taskman_jsonEscape(captures[c].reason, esc, sizeof(esc))) + "\"";
+    json += ",\"uptimeMs\":" + String((uint32_t)(captures[c].timeUs / 1000));
+    json += ",\"epoch\":" + String((uint32_t)captures[c].epoch);
+    json += ",\"complete\":" + String(captures[c].complete ? "true" : "false") + "}";
+  }
+  json += "]}";
 
-async function startWork() {
-  console.log("Starting work (tab visible)");
-  stopCharts = false;
-  updateChartData();
-  updateTable();
-  
-  tabletimer = setInterval(updateTable, 30000);
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, json.c_str());
 }
 
-function stopWork() {
-  console.log("Stopping work (tab hidden)");
-  //clearInterval(charttimer);
-  stopCharts = true;        // <-- prevents future scheduling
-  clearInterval(tabletimer);
-}
+// /capture?n=0 downloads one frozen capture
+esp_err_t taskman_handleCapture(httpd_req_t* req) {
+  char val[8];
+  int n = taskman_getQuery(req, "n", val, sizeof(val)) ? atoi(val) : 0;
+  if (n < 0 || n >= MAX_CAPTURES || !captures[n].used) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such capture");
+    return ESP_FAIL;
+  }
+  const Capture& c = captures[n];
 
-document.addEventListener("visibilitychange", async () => {
-  if (document.visibilityState === "hidden") stopWork();
-  else await startWork();
-});
+  httpd_resp_set_type(req, "application/json");
 
-function init(){
-  createChart();
-  startWork();
-}
+  char buf[1024];
+  size_t off = 0;
+  char esc[6 * 48 + 1];
 
-window.addEventListener("load", init);
+  APPEND("{\"reason\":\"%s\",\"uptimeMs\":%u,\"epoch\":%u,\"interval\":%u,\"pre\":%d,\"count\":%d,\"complete\":%s,\"tasks\":{",
+         taskman_jsonEscape(c.reason, esc, sizeof(esc)), (uint32_t)(c.timeUs / 1000), (uint32_t)c.epoch, c.intervalMs, c.pre, c.count, c.complete ? "true" : "false");
 
-async function updateTable() {
-  try {
-    const res = await fetch('/dataInfo');
-    if (!res.ok) throw new Error("Fetch failed");
-    const json = await res.json();
-    const tbody = document.querySelector('#taskTable tbody');
-    tbody.innerHTML = '';
-    const stateNames = { 0: 'Running', 1: 'Ready', 2: 'Blocked', 3: 'Suspended', 4: 'Deleted' };
-    for (const [name, info] of Object.entries(json)) {
-      const row = document.createElement('tr');
-      row.innerHTML = `
-        <td>${name}</td>
-        <td>${info.core == 2147483647 ? '-' : info.core}</td>
-        <td>${info.prio}</td>
-        <td>${info.stackHW}</td>
-        <td>${stateNames[info.state] ?? info.state}</td>
-      `;
-      tbody.appendChild(row);
+  bool firstItem = true;
+  for (int i = 0; i < MAX_TASKS; i++) {
+    if (!c.names[i][0]) continue;
+
+    if (!firstItem) APPEND(",");
+    firstItem = false;
+
+    APPEND("\"%s\":[", taskman_jsonEscape(c.names[i], esc, sizeof(esc)));
+    for (int j = 0; j < c.count; j++) {
+      APPEND("%.1f", c.usage[j * MAX_TASKS + i] / 10.0f);
+      if (j < c.count - 1) APPEND(",");
     }
-  } catch (e) {
-    console.error("updateTable error:", e);
+    APPEND("]");
   }
-}
-</script>
-</body>
-</html>
-)rawliteral";
+  APPEND("}");
 
-  httpd_resp_send(req, html.c_str(), HTTPD_RESP_USE_STRLEN);
-  return ESP_OK;
-}
+  const char* memNames[] = { "ram", "psram", "largest" };
+  for (int m = 0; m < 3; m++) {
+    APPEND(",\"%s\":[", memNames[m]);
+    for (int j = 0; j < c.count; j++) {
+      APPEND("%u", c.mem[j * 3 + m]);
+      if (j < c.count - 1) APPEND(",");
+    }
+    APPEND("]");
+  }
 
-esp_err_t taskman_handleDataInfo(httpd_req_t* req) {
-  String json = "{";
-  bool firstTask = true;
+  APPEND("}");
 
-  for (int i = 0; i < maxtaskCount; i++) {
-    //if (!tasks[i].active) continue;
-    if (!firstTask) json += ",";
-    firstTask = false;
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
 
-    json += "\"" + tasks[i].name + "\":{";
-    json += "\"core\":" + String(tasks[i].core);
-    json += ",\"prio\":" + String(tasks[i].currentPrio);
-    json += ",\"stackHW\":" + String(tasks[i].stackHighWater);
-    json += ",\"state\":" + String(tasks[i].state);
-    json += "}";
+#if TASKMAN_PERSIST
+// /history is the previous boot, /history?boot=all everything, /history?boot=12 one boot
+esp_err_t taskman_handleHistory(httpd_req_t* req) {
+  if (!persist.io) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no taskman partition");
+    return ESP_FAIL;
   }
 
-  json += "}";
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_send(req, json.c_str(), json.length());
-  return ESP_OK;
-}
+  char val[8];
+  bool all = false;
+  uint16_t boot = persist.boot - 1;
+  if (taskman_getQuery(req, "boot", val, sizeof(val))) {
+    if (strcmp(val, "all") == 0) all = true;
+    else boot = atoi(val);
+  }
 
-///
-esp_err_t taskman_handleData(httpd_req_t* req) {
   httpd_resp_set_type(req, "application/json");
 
   char buf[1024];
   size_t off = 0;
 
-// Helper: append and flush when needed
-#define FLUSH_IF_FULL() \
-  if (off >= sizeof(buf) - 64) { \
-    httpd_resp_send_chunk(req, buf, off); \
-    off = 0; \
-  }
-
-#define APPEND(fmt, ...) \
-  do { \
-    off += snprintf(buf + off, sizeof(buf) - off, fmt, ##__VA_ARGS__); \
-    FLUSH_IF_FULL(); \
-  } while (0)
-
-  // Start JSON
-  APPEND("{");
+  APPEND("{\"currentBoot\":%u,\"rollup\":%d,\"records\":[", persist.boot, PERSIST_ROLLUP);
 
   bool firstItem = true;
-
-  // ---- Per-task CPU history ----
-  for (int i = 0; i < maxtaskCount; i++) {
-    if (!tasks[i].over2) continue;
+  PersistRecord r;
+  for (uint32_t i = 0; i < persist.slots + persist.batchCount; i++) {
+    if (!taskman_persistRecord(i, r)) continue;
+    if (!all && r.boot != boot) continue;
 
     if (!firstItem) APPEND(",");
     firstItem = false;
 
-    // Task name
-    APPEND("\"%.64s\":[", tasks[i].name);
-
-    // History samples
-    int pos = tasks[i].index;
-    for (int j = 0; j < SAMPLE_COUNT; j++) {
-      APPEND("%.1f", tasks[i].usage[pos]);
-      if (j < SAMPLE_COUNT - 1) APPEND(",");
-      pos = (pos + 1) % SAMPLE_COUNT;
+    APPEND("{\"seq\":%u,\"boot\":%u,\"uptime\":%u,\"epoch\":%u,\"samples\":%u,\"interval\":%u,"
+           "\"ram\":%u,\"psram\":%u,\"largest\":%u,\"core0\":%u,\"core1\":%u,\"top\":[",
+           r.seq, r.boot, r.uptimeS, r.epoch, r.samples, r.intervalMs,
+           r.ramMinKB, r.psramMinKB, r.largestMinKB, r.coreBusy[0], r.coreBusy[1]);
+    for (int k = 0; k < 3 && r.top[k].name[0]; k++) {
+      APPEND("%s[\"%.8s\",%.1f,%.1f]", k ? "," : "", r.top[k].name, r.top[k].avg2 / 2.0f, r.top[k].max2 / 2.0f);
     }
-
-    APPEND("]");
+    APPEND("]}");
   }
 
-  // ---- System RAM history ----
-  if (!firstItem) APPEND(",");
-  APPEND("\"ram\":[");
+  APPEND("]}");
 
-  for (int i = 0; i < SAMPLE_COUNT; i++) {
-    int pos = (sysSamples.index + i) % SAMPLE_COUNT;
-    APPEND("%u", sysSamples.freeRam[pos]);
-    if (i < SAMPLE_COUNT - 1) APPEND(",");
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
+
+#if TASKMAN_LASTGASP
+// /lastboot - the final samples before the previous reset
+esp_err_t taskman_handleLastBoot(httpd_req_t* req) {
+  httpd_resp_set_type(req, "application/json");
+
+  char buf[1024];
+  size_t off = 0;
+
+  APPEND("{\"reason\":\"%s\",\"valid\":%s,\"samples\":[",
+         taskman_resetReasonName(prevBoot.reason), prevBoot.valid ? "true" : "false");
+
+  for (int i = 0; i < prevBoot.count; i++) {
+    const LastGaspEntry& e = prevBoot.e[i];
+    APPEND("%s{\"uptimeMs\":%u,\"ram\":%u,\"psram\":%u,\"largest\":%u,\"top\":[",
+           i ? "," : "", e.uptimeMs, e.ramKB, e.psramKB, e.largestKB);
+    for (int k = 0; k < 3 && e.pct2[k]; k++) {
+      APPEND("%s[\"%s\",%.1f]", k ? "," : "", prevBoot.names[e.slot[k] % MAX_TASKS], e.pct2[k] / 2.0f);
+    }
+    APPEND("]}");
   }
 
-  APPEND("],");
+  APPEND("]}");
 
-  // ---- System PSRAM history ----
-  APPEND("\"psram\":[");
+  if (off) httpd_resp_send_chunk(req, buf, off);
+  httpd_resp_send_chunk(req, NULL, 0);
+  return ESP_OK;
+}
+#endif
 
-  for (int i = 0; i < SAMPLE_COUNT; i++) {
-    int pos = (sysSamples.index + i) % SAMPLE_COUNT;
-    APPEND("%u", sysSamples.freePSRam[pos]);
-    if (i < SAMPLE_COUNT - 1) APPEND(",");
+#if TASKMAN_ANNOTATIONS
+#ifdef TASKMAN_CONTROL_TOKEN
+// compares every byte so the time taken doesn't give the token away
+// The same work for any given token of any length, and nothing read past its NUL
+bool taskman_tokenOk(const char* given) {
+  const char* want = TASKMAN_CONTROL_TOKEN;
+  size_t n = strlen(want), m = strlen(given);
+  uint8_t diff = m != n;
+  for (size_t i = 0; i < n; i++) diff |= want[i] ^ given[min(i, m)];
+  return diff == 0;
+}
+
+// POST /control  body: token=...&task=12&prio=5  or  &suspend=1  or  &resume=1
+// task is the xTaskNumber from GET /control
+esp_err_t taskman_handleControlPost(httpd_req_t* req) {
+  char body[256];
+  int len = httpd_req_recv(req, body, min(req->content_len, sizeof(body) - 1));
+  if (len <= 0) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "no body");
+    return ESP_FAIL;
+  }
+  body[len] = 0;
+
+  char token[64] = "", val[16];
+  httpd_query_key_value(body, "token", token, sizeof(token));
+  taskman_urlDecode(token);
+  if (!taskman_tokenOk(token)) {
+    httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "bad token");
+    return ESP_FAIL;
   }
 
-  APPEND("]");
+  int slot = -1;
+  if (httpd_query_key_value(body, "task", val, sizeof(val)) == ESP_OK) {
+    UBaseType_t number = atoi(val);
+    for (int i = 0; i < maxtaskCount; i++) {
+      if (tasks[i].taskNumber == number) slot = i;
+    }
+  }
+  if (slot < 0) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no such task number");
+    return ESP_FAIL;
+  }
+  if (!taskman_inList(TASKMAN_CONTROL_ALLOW, tasks[slot].name)) {
+    httpd_resp_send_err(req, HTTPD_403_FORBIDDEN, "task not in TASKMAN_CONTROL_ALLOW");
+    return ESP_FAIL;
+  }
+  TaskHandle_t h = taskman_handleForNumber(tasks[slot].taskNumber);
+  if (!h) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "task has gone");
+    return ESP_FAIL;
+  }
 
-  // End JSON
-  APPEND("}");
+  char text[48];
+  if (httpd_query_key_value(body, "prio", val, sizeof(val)) == ESP_OK) {
+    int prio = atoi(val);
+    if (prio < 0 || prio >= configMAX_PRIORITIES) {
+      httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "prio out of range");
+      return ESP_FAIL;
+    }
+    snprintf(text, sizeof(text), "%.16s prio %u->%d", tasks[slot].name.c_str(), uxTaskPriorityGet(h), prio);
+    vTaskPrioritySet(h, prio);
+  } else if (httpd_query_key_value(body, "suspend", val, sizeof(val)) == ESP_OK) {
+    snprintf(text, sizeof(text), "%.16s suspended", tasks[slot].name.c_str());
+    vTaskSuspend(h);
+  } else if (httpd_query_key_value(body, "resume", val, sizeof(val)) == ESP_OK) {
+    snprintf(text, sizeof(text), "%.16s resumed", tasks[slot].name.c_str());
+    vTaskResume(h);
+  } else {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "need prio, suspend or resume");
+    return ESP_FAIL;
+  }
 
-  // Flush leftover
-  if (off) httpd_resp_send_chunk(req, buf, off);
+  taskman_annotateSlot(text, slot);
+  Serial.printf("taskman control: %s\n", text);
 
-  // Terminate chunks
-  httpd_resp_send_chunk(req, NULL, 0);
+  char esc[sizeof(text) * 6];
+  String json = "{\"ok\":true,\"text\":\"" + String(taskman_jsonEscape(text, esc, sizeof(esc))) + "\"}";
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, json.c_str());
+}
+#endif
 
-  return ESP_OK;
+// GET /control - the tasks that can be controlled and the markers with their before/after
+esp_err_t taskman_handleControl(httpd_req_t* req) {
+#ifdef TASKMAN_CONTROL_TOKEN
+  const char* allow = TASKMAN_CONTROL_ALLOW;
+#else
+  const char* allow = "";
+#endif
+  String json = "{\"enabled\":" + String(allow[0] ? "true" : "false") + ",\"tasks\":[";
+  char esc[64];
+  bool first = true;
+  for (int i = 0; i < maxtaskCount; i++) {
+    if (!allow[0] || !taskman_inList(allow, tasks[i].name)) continue;
+    if (!first) json += ",";
+    first = false;
+    json += "{\"task\":" + String(tasks[i].taskNumber) + ",\"name\":\"" + String(taskman_jsonEscape(tasks[i].name.c_str(), esc, sizeof(esc))) + "\",\"prio\":" + String(tasks[i].currentPrio) +
+            ",\"state\":" + String(tasks[i].state) + "}";
+  }
+  json += "],\"annotations\":[";
+  first = true;
+  for (int k = 0; k < MAX_ANNOTATIONS; k++) {
+    const Annotation& a = annotations[(nextAnnotation + k) % MAX_ANNOTATIONS];
+    if (!a.timeMs) continue;
+    if (!first) json += ",";
+    first = false;
+    json += taskman_annotationJson(a);
+  }
+  json += "]}";
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req, json.c_str());
 }
+#endif
 
 /////////////
 void printTopTasksOneLine() {
@@ -1463,8 +6163,7 @@ void printTopTasksOneLine() {
     // ✅ Skip IDLE tasks
     if (tasks[i].name == "IDLE0" || tasks[i].name == "IDLE1") continue;
 
-    int pos = (tasks[i].index - 1 + SAMPLE_COUNT) % SAMPLE_COUNT;
-    float u = tasks[i].usage[pos];
+    float u = tasks[i].last();
 
     list[count].name = tasks[i].name.c_str();
     list[count].usage = u;
@@ -1472,16 +6171,9 @@ void printTopTasksOneLine() {
     count++;
   }
 
-  // ---- Sort by usage descending ----
-  for (int i = 0; i < count - 1; i++) {
-    for (int j = i + 1; j < count; j++) {
-      if (list[j].usage > list[i].usage) {
-        Item tmp = list[i];
-        list[i] = list[j];
-        list[j] = tmp;
-      }
-    }
-  }
+  // ---- Only the 4 busiest need to be in order ----
+  int limit = (count < 4) ? count : 4;
+  std::partial_sort(list, list + limit, list + count, [](const Item& a, const Item& b) { return a.usage > b.usage; });
 
   // ---- Free RAM ----
   uint32_t ramKB = ESP.getFreeHeap() / 1024;
@@ -1490,19 +6182,31 @@ void printTopTasksOneLine() {
   // ---- Print single line ----
   Serial.printf("RAM=%uKB PSRAM=%uKB | ", ramKB, psramKB);
 
-  int limit = (count < 4) ? count : 4;
   for (int i = 0; i < limit; i++) {
     if (list[i].usage <= 1.0) continue;
     Serial.printf("%s:%.1f[%d]", list[i].name, list[i].usage, list[i].core);
     if (i < limit - 1) Serial.print(", ");
   }
 
+#if TASKMAN_ALERTS
+  Serial.print(taskman_alertsLine());
+#endif
+
   Serial.println();
 }
 
 void taskman_setup() {
   int start_free = ESP.getFreeHeap();
-  xTaskCreatePinnedToCore(cpuMonitorTask, "CPU_Monitor", 1000, nullptr, 7, nullptr, 0);
+#if TASKMAN_LASTGASP
+  taskman_lastGaspBegin();
+#endif
+#if TASKMAN_PERSIST
+  taskman_persist_begin();
+#endif
+#if TASKMAN_CORE_SPLIT
+  taskman_coreSplitBegin();
+#endif
+  xTaskCreatePinnedToCore(cpuMonitorTask, "CPU_Monitor", 2048, nullptr, 7, nullptr, 0);  // 2048 for the burst capture
   vTaskDelay(pdMS_TO_TICKS(10));
 
   Serial.println("\nhttps://github.com/jameszah/ESP32-Task-Manager\n");
@@ -1522,6 +6226,7 @@ void taskman_server_setup(httpd_handle_t existing_server = nullptr) {
     config.stack_size = 6 * 1024;    // optional tweak
     config.lru_purge_enable = true;  // auto-clean old sockets
     config.max_open_sockets = 8;     // safer defaults
+    config.max_uri_handlers = TASKMAN_URI_HANDLERS;  // the default 8 is less than taskman registers
     config.recv_wait_timeout = 5;
     config.send_wait_timeout = 5;
 
@@ -1541,27 +6246,87 @@ void taskman_server_setup(httpd_handle_t existing_server = nullptr) {
   httpd_register_uri_handler(server, &uri_data);
 */
 
-#define REGISTER_TRACKED(uri_str, fn) \
+  int unregistered = 0;
+
+#if TASKMAN_SESSIONS
+#define REGISTER_TRACKED_METHOD(uri_str, http_method, fn) \
   do { \
     static httpd_uri_t u = { \
       .uri = uri_str, \
-      .method = HTTP_GET, \
+      .method = http_method, \
       .handler = tracked_handler, \
       .user_ctx = (void*)fn \
     }; \
-    httpd_register_uri_handler(server, &u); \
+    if (httpd_register_uri_handler(server, &u) != ESP_OK) { \
+      Serial.printf("taskman: %s not registered, raise max_uri_handlers\n", uri_str); \
+      unregistered++; \
+    } \
+  } while (0)
+#else
+#define REGISTER_TRACKED_METHOD(uri_str, http_method, fn) \
+  do { \
+    static httpd_uri_t u = { \
+      .uri = uri_str, \
+      .method = http_method, \
+      .handler = fn, \
+      .user_ctx = nullptr \
+    }; \
+    if (httpd_register_uri_handler(server, &u) != ESP_OK) { \
+      Serial.printf("taskman: %s not registered, raise max_uri_handlers\n", uri_str); \
+      unregistered++; \
+    } \
   } while (0)
+#endif
+#define REGISTER_TRACKED(uri_str, fn) REGISTER_TRACKED_METHOD(uri_str, HTTP_GET, fn)
 
+#if TASKMAN_NETWORK_PAGE
   REGISTER_TRACKED("/network", taskman_handleNetwork);
+#endif
   REGISTER_TRACKED("/data", taskman_handleData);
+#if TASKMAN_DASHBOARD
   REGISTER_TRACKED("/taskman", taskman_handleRoot);
+#endif
   REGISTER_TRACKED("/dataInfo", taskman_handleDataInfo);
+  REGISTER_TRACKED("/config", taskman_handleConfig);
+#if TASKMAN_BURST
+  REGISTER_TRACKED("/burst", taskman_handleBurst);
+#endif
+#if TASKMAN_TRIGGERS
+  REGISTER_TRACKED("/trigger", taskman_handleTrigger);
+  REGISTER_TRACKED("/capture", taskman_handleCapture);
+#endif
+#if TASKMAN_LASTGASP
+  REGISTER_TRACKED("/lastboot", taskman_handleLastBoot);
+#endif
+#if TASKMAN_ANNOTATIONS
+  REGISTER_TRACKED("/control", taskman_handleControl);
+#ifdef TASKMAN_CONTROL_TOKEN
+  REGISTER_TRACKED_METHOD("/control", HTTP_POST, taskman_handleControlPost);
+#endif
+#endif
+#if TASKMAN_PERSIST
+  REGISTER_TRACKED("/history", taskman_handleHistory);
+#endif
+#if TASKMAN_PROFILER
+  REGISTER_TRACKED("/profile", taskman_handleProfile);
+#endif
+#if TASKMAN_FAKE_LOAD
+  REGISTER_TRACKED("/scenario", taskman_handleScenario);
+#endif
+#if TASKMAN_CSV_EXPORT
+  REGISTER_TRACKED("/export.csv", taskman_handleExportCsv);
+#endif
 
 /*
 httpd_uri_t uri_data = {.uri = "/data",  .method = HTTP_GET, .handler = tracked_handler, .user_ctx = (void*)taskman_handleData };
 httpd_register_uri_handler(server, &uri_data);
 */
 
+  if (unregistered) {
+    Serial.printf("taskman: %d of %d endpoints missing - the server needs max_uri_handlers = TASKMAN_URI_HANDLERS (%d) plus your own\n",
+                  unregistered, TASKMAN_URI_HANDLERS, TASKMAN_URI_HANDLERS);
+  }
+
   // --- Save or return handle ---
   taskman_server = server;
 
@@ -1569,18 +6334,23 @@ httpd_register_uri_handler(server, &uri_data);
                 start_free - ESP.getFreeHeap(), ESP.getFreeHeap());
 }
 
+// With TASKMAN_FAKE_LOAD 0 these stay as no-ops so the example sketch still builds
 void taskman_setup_fake_load_tasks() {
+#if TASKMAN_FAKE_LOAD
   int start_free = ESP.getFreeHeap();
   xTaskCreatePinnedToCore(FakeLoad1, "FakeLoad1", 2000, nullptr, 1, nullptr, 1);
   xTaskCreatePinnedToCore(FakeLoad0, "FakeLoad0", 2500, nullptr, 1, nullptr, 0);
   Serial.printf("Fake load tasks setup complete, used %d bytes of ram, current free %d\n", start_free - ESP.getFreeHeap(), ESP.getFreeHeap());
+#endif
 }
 
 void taskman_fake_loop_load() {
+#if TASKMAN_FAKE_LOAD
   int j = 0;
   for (int i = 0; i < 500; i++) {
     j = j + 1;
   }
   if (j < 0) Serial.println("fake load loop!");
   vTaskDelay(pdMS_TO_TICKS(1));
+#endif
 }
\ No newline at end of file
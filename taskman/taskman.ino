@@ -79,6 +79,7 @@ void setup() {
   config.stack_size = 6 * 1024;    // optional tweak
   config.lru_purge_enable = true;  // auto-clean old sockets
   config.max_open_sockets = 8;     // safer defaults
+  config.max_uri_handlers = TASKMAN_URI_HANDLERS + 8;  // taskman's endpoints and 8 of your own
   config.recv_wait_timeout = 5;
   config.send_wait_timeout = 5;
 
@@ -0,0 +1,200 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - the flash history record, its crc, and the ring of records: finding the head at boot and writing a batch
+  - no Arduino or esp-idf in here, so tools/taskman_persist_test.cpp runs the same code on linux against a file
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+*/
+
+#ifndef TASKMAN_PERSIST_H
+#define TASKMAN_PERSIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// The partition is a ring of 64 byte records written in batches.  Erased flash reads 0xFF,
+// so an empty slot has magic 0xFFFFFFFF.  At boot the highest seq is the head, and the
+// sector in front of the head is erased just before it is written, so every sector
+// gets the same number of erase cycles.  Everything goes through TaskmanFlash, so the
+// ring can be the partition, a file or a buffer.
+
+#define PERSIST_MAGIC 0x31484D54  // "TMH1"
+
+struct PersistTop {
+  char name[8];
+  uint8_t avg2;  // average, half percent steps
+  uint8_t max2;  // peak, half percent steps
+};
+
+struct PersistRecord {
+  uint32_t magic;
+  uint32_t seq;       // increases across boots, finds the head after a reset
+  uint16_t boot;      // boot counter
+  uint16_t samples;   // samples rolled into this record
+  uint32_t uptimeS;
+  uint32_t epoch;     // 0 if the clock wasn't set
+  uint16_t ramMinKB;
+  uint16_t psramMinKB;
+  uint16_t largestMinKB;
+  uint8_t coreBusy[2];  // average busy % per core (100 - IDLE)
+  PersistTop top[3];    // busiest tasks, IDLE excluded
+  uint16_t intervalMs;  // average sample interval over the record
+  uint32_t crc;
+};
+static_assert(sizeof(PersistRecord) == 64, "PersistRecord must be 64 bytes");
+
+struct TaskmanFlash {
+  uint32_t size;
+  uint32_t sectorSize;
+  bool (*read)(uint32_t off, void* dst, size_t len);
+  bool (*write)(uint32_t off, const void* src, size_t len);
+  bool (*erase)(uint32_t off, size_t len);
+};
+
+inline uint32_t taskman_crc32(const uint8_t* data, size_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+inline bool taskman_recordValid(const PersistRecord& r) {
+  return r.magic == PERSIST_MAGIC && r.crc == taskman_crc32((const uint8_t*)&r, offsetof(PersistRecord, crc));
+}
+
+// Where the ring is and where the next batch goes
+struct TaskmanPersistLog {
+  const TaskmanFlash* io = nullptr;
+  uint32_t slots = 0;      // records in the partition
+  uint32_t head = 0;       // next slot to write
+  uint32_t seq = 0;        // next seq
+  uint16_t boot = 0;       // this boot
+  int batch = 8;           // records per write, a sector holds a whole number of batches
+};
+
+// true if len bytes at off still read as erased flash
+inline bool taskman_persistBlank(const TaskmanFlash* io, uint32_t off, uint32_t len) {
+  uint8_t buf[64];
+  while (len) {
+    uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+    if (!io->read(off, buf, n)) return false;
+    for (uint32_t i = 0; i < n; i++)
+      if (buf[i] != 0xFF) return false;
+    off += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Scan the ring for the head, the next seq and the boot counter.  False if a sector
+// doesn't hold a whole number of batches or there are fewer than 2 sectors.
+inline bool taskman_persistScan(TaskmanPersistLog& log, const TaskmanFlash* io, int batch) {
+  uint32_t perSector = io->sectorSize / sizeof(PersistRecord);
+  if (batch <= 0 || perSector % batch != 0 || io->size < 2 * io->sectorSize) return false;
+
+  log.io = io;
+  log.batch = batch;
+  log.slots = io->size / sizeof(PersistRecord);
+  log.head = log.seq = log.boot = 0;
+
+  // highest valid seq is the newest record
+  bool found = false;
+  uint32_t bestSeq = 0, bestSlot = 0;
+  uint16_t bestBoot = 0;
+  PersistRecord r;
+  for (uint32_t i = 0; i < log.slots; i++) {
+    if (!io->read(i * sizeof(r), &r, sizeof(r))) continue;
+    if (!taskman_recordValid(r)) continue;
+    if (!found || (int32_t)(r.seq - bestSeq) > 0) {
+      found = true;
+      bestSeq = r.seq;
+      bestSlot = i;
+      bestBoot = r.boot;
+    }
+  }
+  if (!found) return true;
+
+  // a half written batch leaves the rest of its slots unwritten, skip to the next batch
+  log.head = (bestSlot / batch + 1) * batch % log.slots;
+  // and a batch with a bad crc (torn, or corrupt) past the newest good record can't be written
+  // over without an erase, so skip those too - the sector start is erased before the write anyway
+  while (log.head % perSector != 0 && !taskman_persistBlank(io, log.head * sizeof(r), batch * sizeof(r))) {
+    log.head = (log.head + batch) % log.slots;
+  }
+  log.seq = bestSeq + 1;
+  log.boot = bestBoot + 1;
+  return true;
+}
+
+// Write n records at the head, erasing the sector first when the head is at its start
+inline void taskman_persistWrite(TaskmanPersistLog& log, const PersistRecord* recs, int n) {
+  if (!log.io || n <= 0) return;
+
+  uint32_t off = log.head * sizeof(PersistRecord);
+  if (off % log.io->sectorSize == 0) log.io->erase(off, log.io->sectorSize);
+
+  // never let a write run off the end of a sector
+  int room = (log.io->sectorSize - off % log.io->sectorSize) / sizeof(PersistRecord);
+  log.io->write(off, recs, (n < room ? n : room) * sizeof(PersistRecord));
+
+  log.head = (log.head + log.batch) % log.slots;
+}
+
+// ---- file backend ----
+// A TaskmanFlash on a file, for a pc, or a LittleFS/SD file on the esp32.  Writes AND
+// into what is there and erase fills with 0xFF, the way NOR flash behaves, so the ring
+// sees the same thing it would on the partition.  One file at a time.
+
+inline FILE* taskmanFlashFile = nullptr;
+
+inline bool taskman_fileRead(uint32_t off, void* dst, size_t len) {
+  return fseek(taskmanFlashFile, off, SEEK_SET) == 0 && fread(dst, 1, len, taskmanFlashFile) == len;
+}
+
+inline bool taskman_fileWrite(uint32_t off, const void* src, size_t len) {
+  uint8_t buf[64];
+  const uint8_t* s = (const uint8_t*)src;
+  while (len) {
+    size_t n = len < sizeof(buf) ? len : sizeof(buf);
+    if (!taskman_fileRead(off, buf, n)) return false;
+    for (size_t i = 0; i < n; i++) buf[i] &= s[i];
+    if (fseek(taskmanFlashFile, off, SEEK_SET) != 0 || fwrite(buf, 1, n, taskmanFlashFile) != n) return false;
+    off += n;
+    s += n;
+    len -= n;
+  }
+  return fflush(taskmanFlashFile) == 0;
+}
+
+inline bool taskman_fileErase(uint32_t off, size_t len) {
+  uint8_t ff[64];
+  memset(ff, 0xFF, sizeof(ff));
+  if (fseek(taskmanFlashFile, off, SEEK_SET) != 0) return false;
+  while (len) {
+    size_t n = len < sizeof(ff) ? len : sizeof(ff);
+    if (fwrite(ff, 1, n, taskmanFlashFile) != n) return false;
+    len -= n;
+  }
+  return fflush(taskmanFlashFile) == 0;
+}
+
+// Open (or create, erased) a file of size bytes as the flash, false if it can't be opened
+inline bool taskman_fileFlash(TaskmanFlash& io, const char* path, uint32_t size, uint32_t sectorSize = 4096) {
+  if (taskmanFlashFile) fclose(taskmanFlashFile);
+  taskmanFlashFile = fopen(path, "r+b");
+  if (!taskmanFlashFile) taskmanFlashFile = fopen(path, "w+b");
+  if (!taskmanFlashFile) return false;
+
+  fseek(taskmanFlashFile, 0, SEEK_END);
+  long have = ftell(taskmanFlashFile);
+  if (have < (long)size && !taskman_fileErase(have, size - have)) return false;
+
+  io = { size, sectorSize, taskman_fileRead, taskman_fileWrite, taskman_fileErase };
+  return true;
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - the table the pc sampling profiler counts into: open addressing on pc, task and core
+  - no Arduino or esp-idf in here, so tools/taskman_profiler_test.cpp runs the same table on linux
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+*/
+
+#ifndef TASKMAN_PROFILER_H
+#define TASKMAN_PROFILER_H
+
+#include <stdint.h>
+
+#define PROFILE_IN_ISR 1  // pc recorded when the timer interrupted another interrupt
+
+struct ProfileSlot {
+  uint32_t pc;    // 0 empty
+  uint8_t task;   // task slot, 255 not known
+  uint8_t core;
+  uint32_t count;
+};
+
+// Count one sample in a table of size slots, looking at most 16 slots on from where the
+// key hashes to - false when those are all taken by other keys, or for pc 0, which marks
+// an empty slot
+inline bool taskman_profileAdd(ProfileSlot* slots, uint32_t size, uint32_t pc, uint8_t task, uint8_t core) {
+  if (!pc) return false;
+  uint32_t h = (pc >> 1) * 2654435761u ^ task ^ (core << 8);
+  for (int probe = 0; probe < 16; probe++) {
+    ProfileSlot& s = slots[(h + probe) % size];
+    if (s.pc == pc && s.task == task && s.core == core) {
+      s.count++;
+      return true;
+    }
+    if (s.pc == 0) {
+      s.pc = pc;
+      s.task = task;
+      s.core = core;
+      s.count = 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - what TASKMAN_SCOPE adds up per code region: calls, cycles, the longest call and a histogram
+  - no Arduino or esp-idf in here, so tools/taskman_scope_bench.cpp runs the same scope on linux
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+*/
+
+#ifndef TASKMAN_REGIONS_H
+#define TASKMAN_REGIONS_H
+
+#include <stdint.h>
+
+// The cycle counter and the core come from whoever includes this: esp_cpu_get_cycle_count()
+// and xPortGetCoreID() in taskman.h, stubs in the benchmark
+#if !defined(TASKMAN_CYCLES) || !defined(TASKMAN_CORE_ID)
+#error "define TASKMAN_CYCLES() and TASKMAN_CORE_ID() before including taskman_regions.h"
+#endif
+
+#define REGION_BUCKETS 32  // one per power of two cycles
+
+struct TaskmanRegionCounters {
+  volatile uint32_t calls[2];                // since the last sample, by core
+  volatile uint32_t cycles[2];
+  volatile uint32_t hist[REGION_BUCKETS];    // bucket b is 2^b to 2^(b+1) cycles, since boot
+  volatile uint32_t maxCycles;
+};
+
+// Two reads of the cycle counter and three atomic adds.  The cycle counters of the two
+// cores don't agree, so a call that ends on the other core is dropped.
+struct TaskmanScope {
+  TaskmanRegionCounters* region;
+  int core;
+  uint32_t start;
+
+  TaskmanScope(TaskmanRegionCounters* r)
+    : region(r), core(TASKMAN_CORE_ID()), start(TASKMAN_CYCLES()) {}
+
+  ~TaskmanScope() {
+    uint32_t d = TASKMAN_CYCLES() - start;
+    if (!region || TASKMAN_CORE_ID() != core) return;
+    __atomic_fetch_add(&region->calls[core], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&region->cycles[core], d, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&region->hist[d ? 31 - __builtin_clz(d) : 0], 1, __ATOMIC_RELAXED);
+    if (d > region->maxCycles) region->maxCycles = d;  // two cores racing can lose a max, fine
+  }
+};
+
+// Upper end of the bucket the q quantile falls in, in cycles
+inline uint32_t taskman_regionQuantile(const TaskmanRegionCounters& r, float q) {
+  uint64_t total = 0;
+  for (int b = 0; b < REGION_BUCKETS; b++) total += r.hist[b];
+  if (!total) return 0;
+  uint64_t want = total * q, seen = 0;
+  for (int b = 0; b < REGION_BUCKETS; b++) {
+    seen += r.hist[b];
+    if (seen > want) return b >= 31 ? 0xFFFFFFFF : (2u << b) - 1;
+  }
+  return 0xFFFFFFFF;
+}
+
+// What one scope costs - the best of a few runs of empty scopes, so an interrupt in the
+// middle of one doesn't count, and a run the task spent partly on the other core is left out
+inline uint32_t taskman_scopeOverhead(TaskmanRegionCounters& bench) {
+  uint32_t best = 0xFFFFFFFF;
+  for (int run = 0; run < 5; run++) {
+    int core = TASKMAN_CORE_ID();
+    uint32_t t0 = TASKMAN_CYCLES();
+    for (int i = 0; i < 200; i++) {
+      TaskmanScope s(&bench);
+    }
+    uint32_t perScope = (TASKMAN_CYCLES() - t0) / 200;
+    if (TASKMAN_CORE_ID() == core && perScope < best) best = perScope;
+  }
+  return best == 0xFFFFFFFF ? 0 : best;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - the cpu % of every task from two uxTaskGetSystemState() snapshots
+  - no Arduino or FreeRTOS in here, so tools/taskman_accuracy_test.cpp runs the same code on linux
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+*/
+
+#ifndef TASKMAN_RUNTIME_H
+#define TASKMAN_RUNTIME_H
+
+#include <stdint.h>
+
+// How much a task ran in a period, from its run time counter now (curr) and at the last
+// sample (prev), with deltaTotal the length of the period in the same counter units - so
+// nothing depends on the counter frequency.  Unsigned subtraction takes care of the 32 bit
+// wrap.  A counter that went back by less than a period is a stale read from the other
+// core: nothing is counted and prev is kept, so the time shows up in the next sample.  A
+// counter that went back further, jumped ahead by more than two periods, or belongs to a
+// new handle is a task deleted and created again under the same name, counted from its
+// start.  A task can't run longer than the period, so delta is capped at deltaTotal.
+enum TaskmanRunTimeKind : uint8_t { RT_OK, RT_STALE, RT_RESTARTED };
+
+struct TaskmanRunTimeStep {
+  uint32_t delta;
+  uint32_t prev;  // what to keep for the next sample
+  TaskmanRunTimeKind kind;
+};
+
+inline TaskmanRunTimeStep taskman_runTimeStep(uint32_t curr, uint32_t prev, uint32_t deltaTotal, bool sameTask = true) {
+  uint32_t ahead = curr - prev;
+  uint32_t behind = prev - curr;
+  if (sameTask && ahead <= 2 * (uint64_t)deltaTotal) return { ahead < deltaTotal ? ahead : deltaTotal, curr, RT_OK };
+  if (sameTask && behind <= deltaTotal) return { 0, prev, RT_STALE };
+  return { curr <= deltaTotal ? curr : 0, curr, RT_RESTARTED };
+}
+
+// One sample: every task in the snapshot gets the % of one core it ran since the last
+// sample, and every slot that isn't in the snapshot gets a 0, so all the rings move on
+// together.  Status is TaskStatus_t (only pcTaskName, xHandle and ulRunTimeCounter are
+// read).  Slots keeps the per task state:
+//
+//   static constexpr int capacity;
+//   int count();                                  slots in use
+//   int find(const char* name);                   -1 if not seen before
+//   int add(const Status& t);                     new slot with prev run time = the counter, -1 when full
+//   bool sameTask(int idx, const Status& t);      false for a new handle under the same name
+//   uint32_t& prevRunTime(int idx);
+//   void sampled(int idx, const Status& t, float usage, const TaskmanRunTimeStep& step);
+//   void missing(int idx);
+template <class Status, class Slots>
+void taskman_sampleTasks(const Status* list, uint32_t count, uint32_t deltaTotal, Slots& slots) {
+  bool seen[Slots::capacity] = { false };
+
+  for (uint32_t i = 0; i < count; i++) {
+    const Status& t = list[i];
+    if (!t.pcTaskName) continue;
+
+    int idx = slots.find(t.pcTaskName);
+    if (idx < 0) idx = slots.add(t);
+    if (idx < 0) continue;  // no free slot
+    seen[idx] = true;
+
+    // a stale read still gives a sample (of 0), so every ring stays one entry per sample
+    TaskmanRunTimeStep step = taskman_runTimeStep(t.ulRunTimeCounter, slots.prevRunTime(idx), deltaTotal, slots.sameTask(idx, t));
+    slots.prevRunTime(idx) = step.prev;
+    float usage = deltaTotal ? (float)step.delta / deltaTotal * 100.0f : 0.0f;
+    slots.sampled(idx, t, usage, step);
+  }
+
+  for (int j = 0; j < slots.count(); j++) {
+    if (!seen[j]) slots.missing(j);
+  }
+}
+
+#endif
@@ -0,0 +1,475 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - accuracy test for the cpu % taskman works out from uxTaskGetSystemState()
+  - runs taskman_sampleTasks() from taskman/taskman_runtime.h, the same code cpuMonitorTask runs,
+    on scripted snapshots where the right answer is known
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_accuracy_test taskman_accuracy_test.cpp
+    ./taskman_accuracy_test
+
+  Each case prints ok or what went wrong, and the exit code is the number of failed cases.
+
+  The scripted system has a run time counter per task and a total that moves by the period
+  every sample.  Each core hands out exactly one period of time between its tasks, so every
+  task's % is known and all of them add up to 100% times the cores.  On top of that there are
+  counter wraps, reads from the other core that are a little behind, tasks that come, go and
+  come back under the same name, totals that don't add up, counters at 240MHz and a few
+  thousand tasks over a few thousand samples.
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../taskman/taskman_runtime.h"
+
+// the fields of TaskStatus_t that taskman_sampleTasks() reads
+struct Status {
+  const char* pcTaskName;
+  void* xHandle;
+  uint32_t ulRunTimeCounter;
+};
+
+// ---- What cpuMonitorTask keeps per task slot, with every sample recorded ----
+template <int Capacity>
+struct HostSlots {
+  static constexpr int capacity = Capacity;
+
+  struct Slot {
+    std::string name;
+    void* handle = nullptr;
+    uint32_t prevRunTime = 0;
+    std::vector<float> usage;  // one entry per sample, like the ring
+    TaskmanRunTimeKind kind = RT_OK;
+  };
+  std::vector<Slot> slot;
+  std::unordered_map<std::string, int> byName;
+  int samples = 0;
+
+  int count() { return (int)slot.size(); }
+  int find(const char* name) {
+    auto it = byName.find(name);
+    return it == byName.end() ? -1 : it->second;
+  }
+  int add(const Status& t) {
+    if ((int)slot.size() >= Capacity) return -1;
+    Slot s;
+    s.name = t.pcTaskName;
+    s.prevRunTime = t.ulRunTimeCounter;
+    s.usage.assign(samples, 0.0f);  // the ring of a new slot starts empty
+    slot.push_back(s);
+    byName[s.name] = (int)slot.size() - 1;
+    return (int)slot.size() - 1;
+  }
+  bool sameTask(int idx, const Status& t) { return !slot[idx].handle || slot[idx].handle == t.xHandle; }
+  uint32_t& prevRunTime(int idx) { return slot[idx].prevRunTime; }
+  void sampled(int idx, const Status& t, float usage, const TaskmanRunTimeStep& step) {
+    slot[idx].usage.push_back(usage);
+    slot[idx].handle = t.xHandle;
+    slot[idx].kind = step.kind;
+  }
+  void missing(int idx) { slot[idx].usage.push_back(0.0f); }
+
+  float last(const char* name) {
+    int idx = find(name);
+    return idx < 0 ? -1 : slot[idx].usage.back();
+  }
+};
+
+// ---- A scripted system: tasks on cores, each given a number of counter ticks per period ----
+struct SimTask {
+  std::string name;
+  int core = 0;
+  uint32_t ticks = 0;    // run time each period
+  uint32_t counter = 0;  // the real run time counter
+  uintptr_t handle = 0;
+  bool alive = true;
+  int32_t readLag = 0;   // the snapshot sees counter - readLag, a read from the other core
+};
+
+struct Sim {
+  uint32_t period;
+  uint32_t total;  // the total run time counter, one period per sample
+  std::vector<SimTask> tasks;
+  uintptr_t nextHandle = 0x3ffb0000;
+  std::vector<Status> list;
+
+  Sim(uint32_t periodTicks, uint32_t start = 0) : period(periodTicks), total(start) {}
+
+  SimTask& add(const char* name, int core, uint32_t ticks, uint32_t counter = 0) {
+    SimTask t;
+    t.name = name;
+    t.core = core;
+    t.ticks = ticks;
+    t.counter = counter;
+    t.handle = nextHandle += 0x160;
+    tasks.push_back(t);
+    return tasks.back();
+  }
+  SimTask* get(const char* name) {
+    for (auto& t : tasks)
+      if (t.name == name) return &t;
+    return nullptr;
+  }
+
+  // one period passes, then the snapshot
+  template <class Slots>
+  void step(Slots& slots, uint32_t totalDelta = 0) {
+    total += totalDelta ? totalDelta : period;
+    for (auto& t : tasks)
+      if (t.alive) t.counter += t.ticks;
+    list.clear();
+    for (auto& t : tasks) {
+      if (t.alive) list.push_back({ t.name.c_str(), (void*)t.handle, t.counter - (uint32_t)t.readLag });
+    }
+    sampleAt(slots, totalDelta ? totalDelta : period);
+  }
+
+  template <class Slots>
+  void sampleAt(Slots& slots, uint32_t deltaTotal) {
+    taskman_sampleTasks(list.data(), (uint32_t)list.size(), deltaTotal, slots);
+    slots.samples++;
+  }
+};
+
+// the first snapshot only sets the starting counters
+template <class Slots>
+void start(Sim& sim, Slots& slots) {
+  sim.list.clear();
+  for (auto& t : sim.tasks) sim.list.push_back({ t.name.c_str(), (void*)t.handle, t.counter });
+  sim.sampleAt(slots, sim.period);
+}
+
+// ---- Checks ----
+static int failed = 0;
+static bool caseOk = true;
+static const char* caseName = "";
+
+static void begin(const char* name) {
+  caseName = name;
+  caseOk = true;
+}
+static void end() {
+  printf("%s %s\n", caseOk ? "ok  " : "FAIL", caseName);
+  if (!caseOk) failed++;
+}
+static void expectNear(double got, double want, double tol, const char* what) {
+  if (fabs(got - want) <= tol) return;
+  if (caseOk) printf("     %s: got %.6f want %.6f\n", what, got, want);
+  caseOk = false;
+}
+static void expect(bool cond, const char* what) {
+  if (cond) return;
+  if (caseOk) printf("     %s\n", what);
+  caseOk = false;
+}
+
+template <class Slots>
+double sumLast(Slots& slots) {
+  double sum = 0;
+  for (auto& s : slots.slot) sum += s.usage.back();
+  return sum;
+}
+
+// every slot has exactly one entry per sample, so the rings stay lined up
+template <class Slots>
+bool aligned(Slots& slots) {
+  for (auto& s : slots.slot)
+    if ((int)s.usage.size() != slots.samples) return false;
+  return true;
+}
+
+// two cores, 1000000 ticks a period: 25% + 12.5% + idle on core 0, 60% + idle on core 1
+static void twoCores(Sim& sim) {
+  sim.add("loopTask", 1, 600000);
+  sim.add("IDLE1", 1, 400000);
+  sim.add("wifi", 0, 250000);
+  sim.add("tiT", 0, 125000);
+  sim.add("IDLE0", 0, 625000);
+}
+
+static void testExact() {
+  begin("exact usage, sums to 200% on two cores");
+  Sim sim(1000000);
+  twoCores(sim);
+  HostSlots<16> slots;
+  start(sim, slots);
+  for (int k = 0; k < 10; k++) {
+    sim.step(slots);
+    expectNear(slots.last("loopTask"), 60.0, 1e-4, "loopTask");
+    expectNear(slots.last("wifi"), 25.0, 1e-4, "wifi");
+    expectNear(slots.last("tiT"), 12.5, 1e-4, "tiT");
+    expectNear(slots.last("IDLE0"), 62.5, 1e-4, "IDLE0");
+    expectNear(sumLast(slots), 200.0, 1e-3, "sum");
+  }
+  expect(aligned(slots), "rings not aligned");
+  end();
+}
+
+static void testWrap() {
+  begin("32 bit wrap of the task counters and the total");
+  Sim sim(1000000, 0xFFFFFFFF - 1500000);
+  twoCores(sim);
+  for (auto& t : sim.tasks) t.counter = 0xFFFFFFFF - t.ticks - 1000;  // each wraps in the first or second period
+  HostSlots<16> slots;
+  start(sim, slots);
+  for (int k = 0; k < 5; k++) {
+    sim.step(slots);
+    expectNear(slots.last("loopTask"), 60.0, 1e-4, "loopTask");
+    expectNear(slots.last("tiT"), 12.5, 1e-4, "tiT");
+    expectNear(sumLast(slots), 200.0, 1e-3, "sum");
+  }
+  end();
+}
+
+static void testSkew() {
+  begin("read from the other core a little behind, the time turns up next sample");
+  Sim sim(1000000);
+  twoCores(sim);
+  HostSlots<16> slots;
+  start(sim, slots);
+  sim.step(slots);
+
+  // behind the true counter but still ahead of the last read: less now, more next time
+  sim.get("loopTask")->readLag = 200000;
+  sim.step(slots);
+  expectNear(slots.last("loopTask"), 40.0, 1e-4, "lagging read");
+  sim.get("loopTask")->readLag = 0;
+  sim.step(slots);
+  expectNear(slots.last("loopTask"), 80.0, 1e-4, "catch up");
+
+  // behind the last read: a stale value, 0 this sample, nothing lost
+  sim.get("wifi")->readLag = 300000;
+  sim.step(slots);
+  expectNear(slots.last("wifi"), 0.0, 1e-6, "stale read");
+  expect(slots.slot[slots.find("wifi")].kind == RT_STALE, "stale read not seen as stale");
+  sim.get("wifi")->readLag = 0;
+  sim.step(slots);
+  expectNear(slots.last("wifi"), 50.0, 1e-4, "two periods at once");
+
+  // over the samples the task got exactly its share
+  double sum = 0;
+  for (float u : slots.slot[slots.find("loopTask")].usage) sum += u;
+  expectNear(sum, 60.0 * 5, 1e-3, "loopTask over all samples");
+  sum = 0;
+  for (float u : slots.slot[slots.find("wifi")].usage) sum += u;
+  expectNear(sum, 25.0 * 5, 1e-3, "wifi over all samples");
+  end();
+}
+
+static void testLifecycle() {
+  begin("tasks that appear, disappear and are created again");
+  Sim sim(1000000);
+  twoCores(sim);
+  HostSlots<16> slots;
+  start(sim, slots);
+  sim.step(slots);
+
+  // created half way through the period, ran 100000 ticks so far
+  SimTask& worker = sim.add("worker", 1, 300000, 0);
+  worker.counter = 100000 - worker.ticks;  // step() adds this period's ticks
+  sim.get("IDLE1")->ticks -= 300000;
+  sim.step(slots);
+  expectNear(slots.last("worker"), 0.0, 1e-6, "first sample of a new task");
+  expect(aligned(slots), "new slot not aligned");
+  sim.step(slots);
+  expectNear(slots.last("worker"), 30.0, 1e-4, "new task");
+  expectNear(sumLast(slots), 200.0, 1e-3, "sum with the new task");
+
+  // deleted: a 0 for every sample it is gone, the slot is kept
+  sim.get("worker")->alive = false;
+  sim.get("IDLE1")->ticks += 300000;
+  sim.step(slots);
+  sim.step(slots);
+  expectNear(slots.last("worker"), 0.0, 1e-6, "deleted task");
+  expect(aligned(slots), "deleted slot not aligned");
+
+  // created again under the same name - new handle, counter from 0, ran 70000 ticks
+  SimTask* w = sim.get("worker");
+  w->alive = true;
+  w->handle = sim.nextHandle += 0x160;
+  w->counter = 70000 - w->ticks;
+  sim.get("IDLE1")->ticks -= 300000;
+  sim.step(slots);
+  expectNear(slots.last("worker"), 7.0, 1e-4, "recreated, new handle");
+  expect(slots.slot[slots.find("worker")].kind == RT_RESTARTED, "new handle not seen as a restart");
+  sim.step(slots);
+  expectNear(slots.last("worker"), 30.0, 1e-4, "recreated, next sample");
+
+  sim.step(slots);
+  sim.step(slots);
+  sim.step(slots);
+
+  // created again between two samples with the same handle (the memory was reused): the
+  // counter went back by more than a period, counted from its start
+  w->counter = 50000 - w->ticks;
+  sim.step(slots);
+  expectNear(slots.last("worker"), 5.0, 1e-4, "recreated, same handle");
+  expect(slots.slot[slots.find("worker")].kind == RT_RESTARTED, "reused handle not seen as a restart");
+  expectNear(sumLast(slots), 200.0 - 25.0, 1e-3, "sum, the recreated task missed most of the period");
+  expect(aligned(slots), "rings not aligned");
+  end();
+}
+
+static void testTotalsDontSum() {
+  begin("totals that don't add up");
+  Sim sim(1000000);
+  twoCores(sim);
+  HostSlots<16> slots;
+  start(sim, slots);
+  sim.step(slots);
+
+  // the total moved less than the tasks did (counters read at slightly different times):
+  // no task over 100%, each one a share of the shorter period
+  sim.step(slots, 800000);
+  for (auto& s : slots.slot) expect(s.usage.back() <= 100.0f, "task over 100%");
+  expectNear(slots.last("loopTask"), 75.0, 1e-4, "loopTask of a short total");
+  expectNear(slots.last("IDLE0"), 78.125, 1e-4, "IDLE0 of a short total");
+
+  // a task whose counter ran faster than the whole period is held at 100%
+  sim.get("tiT")->ticks = 1500000;
+  sim.step(slots);
+  expectNear(slots.last("tiT"), 100.0, 1e-6, "capped at 100%");
+  sim.get("tiT")->ticks = 125000;
+
+  // time nobody accounts for (a task deleted during the period) is just missing
+  sim.get("IDLE0")->ticks = 525000;
+  sim.step(slots);
+  expectNear(sumLast(slots), 190.0, 1e-3, "sum with time unaccounted");
+  expectNear(slots.last("wifi"), 25.0, 1e-4, "wifi unchanged");
+  end();
+}
+
+static void testHighRate() {
+  begin("240MHz counter, 1s and 7.9s periods, many wraps");
+  const uint32_t hz = 240000000;
+  Sim sim(hz, 0xF0000000);
+  sim.add("busy", 0, hz / 10 * 9);
+  sim.add("IDLE0", 0, hz / 10);
+  sim.add("spin", 1, hz / 3);
+  sim.add("IDLE1", 1, hz - hz / 3);
+  HostSlots<16> slots;
+  start(sim, slots);
+  for (int k = 0; k < 100; k++) {  // 100s, the counter wraps every 17.9s
+    sim.step(slots);
+    expectNear(slots.last("busy"), 90.0, 1e-3, "busy");
+    expectNear(slots.last("spin"), 100.0 / 3, 1e-3, "spin");
+    expectNear(sumLast(slots), 200.0, 1e-3, "sum");
+  }
+
+  // a period close to the 32 bit range: 7.9s at 240MHz
+  const uint32_t longPeriod = 1896000000u;
+  sim.period = longPeriod;
+  for (auto& t : sim.tasks) t.ticks = (uint32_t)((uint64_t)t.ticks * 79 / 10);
+  for (int k = 0; k < 10; k++) {
+    sim.step(slots);
+    expectNear(slots.last("busy"), 90.0, 1e-3, "busy, long period");
+    expectNear(sumLast(slots), 200.0, 1e-3, "sum, long period");
+  }
+  end();
+}
+
+// a few thousand tasks with random shares, some deleted and created again every sample
+static void testScale() {
+  const int taskCount = 4000, samples = 3000, cores = 2;
+  const uint32_t period = 1000000;
+  begin("4000 tasks, 3000 samples, churn every sample");
+
+  Sim sim(period, 0x80000000);
+  std::vector<std::string> names(taskCount);
+  uint32_t seed = 12345;
+  auto rnd = [&]() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+  for (int i = 0; i < taskCount; i++) {
+    names[i] = "task" + std::to_string(i);
+    sim.add(names[i].c_str(), i % cores, 0, rnd());
+  }
+
+  // give each core exactly one period between the live tasks on it
+  auto share = [&]() {
+    for (int c = 0; c < cores; c++) {
+      uint64_t weight = 0;
+      std::vector<uint32_t> w(taskCount, 0);
+      for (int i = c; i < taskCount; i += cores) {
+        if (sim.tasks[i].alive) weight += w[i] = rnd() % 1000 + 1;
+      }
+      uint32_t given = 0;
+      int lastLive = -1;
+      for (int i = c; i < taskCount; i += cores) {
+        sim.tasks[i].ticks = sim.tasks[i].alive ? (uint32_t)(w[i] * period / weight) : 0;
+        given += sim.tasks[i].ticks;
+        if (sim.tasks[i].alive) lastLive = i;
+      }
+      sim.tasks[lastLive].ticks += period - given;
+    }
+  };
+
+  HostSlots<taskCount> slots;
+  start(sim, slots);
+
+  double worst = 0;
+  double sampleSeconds = 0;
+  for (int k = 0; k < samples; k++) {
+    // 1% of the tasks go away, and the ones that went away last time come back with a new handle
+    std::vector<SimTask*> created;
+    for (auto& t : sim.tasks) {
+      if (!t.alive) {
+        t.alive = true;
+        t.handle = sim.nextHandle += 0x160;
+        created.push_back(&t);
+      } else if (rnd() % 100 == 0 && &t != &sim.tasks[0] && &t != &sim.tasks[1]) {
+        t.alive = false;
+      }
+    }
+    share();
+    for (SimTask* t : created) t->counter = 0;  // a new counter, step() adds the period it ran
+
+    auto t0 = std::chrono::steady_clock::now();
+    sim.step(slots);
+    sampleSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    double sum = sumLast(slots);
+    worst = fmax(worst, fabs(sum - 100.0 * cores));
+    if (k % 500 == 0) {
+      // each live task exactly its share, restarted ones included
+      for (auto& t : sim.tasks) {
+        if (!t.alive) continue;
+        expectNear(slots.last(t.name.c_str()), t.ticks * 100.0 / period, 1e-3, "one task at scale");
+      }
+    }
+  }
+  expectNear(worst, 0.0, 0.01, "worst sum off 200%");
+  expect(aligned(slots), "rings not aligned at scale");
+
+  double nsPerTask = sampleSeconds * 1e9 / ((double)samples * taskCount);
+  printf("     %.1f ns per task per sample, worst sum %.6f%% off\n", nsPerTask, worst);
+  expect(nsPerTask < 1000, "slower than 1us per task per sample");
+  end();
+}
+
+int main() {
+  testExact();
+  testWrap();
+  testSkew();
+  testLifecycle();
+  testTotalsDontSum();
+  testHighRate();
+  testScale();
+  printf("%d failed\n", failed);
+  return failed;
+}
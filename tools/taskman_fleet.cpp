@@ -0,0 +1,905 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - fleet collector for linux, polls /data and /dataInfo on many taskman devices at once
+  - stores a compact columnar history per device, and prints a merged fleet view
+    ranked by heap headroom and cpu saturation
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build:
+
+    g++ -O2 -std=c++17 -o taskman_fleet taskman_fleet.cpp
+
+  Run against real devices (host or host:port, port 81 is the taskman default):
+
+    ./taskman_fleet -i 10 -o fleet 192.168.1.111 192.168.1.112:80
+    ./taskman_fleet -f devices.txt          # one host[:port] per line
+
+  Scale benchmark against local stand-in servers that serve the same json as
+  taskman_handleData and taskman_handleDataInfo:
+
+    ./taskman_fleet --emulate 500 --rounds 20
+
+  All the polling is one thread with non-blocking sockets and epoll, at most
+  -c connections in flight (default 128).
+
+  Columnar store, one directory per device, one file per column, one value per poll:
+
+    t.u32          collector unix time, seconds
+    ram.u16        min free ram over the device's window, KB
+    largest.u16    min largest free block over the window, KB
+    psram.u16      last free psram, KB
+    busy0.u8       core 0 busy %, average over the window (100 - IDLE0)
+    busy1.u8       core 1 busy %
+    latency.u16    /data round trip, ms
+    cpu.<task>.u8  last cpu % of each task, half percent steps, 255 = not reported
+
+  Everything is little endian.  A task that first appears later is padded with 255.
+*/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+static uint64_t nowUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+// ─── Minimal json reader ──────────────────────────────────
+// Just enough for the taskman endpoints: objects, arrays of numbers, strings, numbers.
+
+struct JsonReader {
+  const char* p;
+  const char* e;
+
+  void ws() {
+    while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
+  }
+  bool eat(char c) {
+    ws();
+    if (p < e && *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+  bool str(std::string& out) {
+    ws();
+    if (p >= e || *p != '"') return false;
+    p++;
+    out.clear();
+    while (p < e && *p != '"') {
+      if (*p == '\\' && p + 1 < e) p++;
+      out += *p++;
+    }
+    if (p >= e) return false;
+    p++;
+    return true;
+  }
+  bool num(double& v) {
+    ws();
+    char* end;
+    v = strtod(p, &end);
+    if (end == p) {
+      if (e - p >= 4 && strncmp(p, "null", 4) == 0) {
+        p += 4;
+        v = NAN;
+        return true;
+      }
+      return false;
+    }
+    p = end;
+    return true;
+  }
+  // skip any value
+  bool skip() {
+    ws();
+    if (p >= e) return false;
+    if (*p == '"') {
+      std::string s;
+      return str(s);
+    }
+    if (*p == '{' || *p == '[') {
+      char close = *p == '{' ? '}' : ']';
+      bool obj = *p == '{';
+      p++;
+      if (eat(close)) return true;
+      do {
+        if (obj) {
+          std::string k;
+          if (!str(k) || !eat(':')) return false;
+        }
+        if (!skip()) return false;
+      } while (eat(','));
+      return eat(close);
+    }
+    double v;
+    if (num(v)) return true;
+    for (const char* w : { "true", "false" }) {
+      size_t n = strlen(w);
+      if ((size_t)(e - p) >= n && strncmp(p, w, n) == 0) {
+        p += n;
+        return true;
+      }
+    }
+    return false;
+  }
+  bool numArray(std::vector<double>& out) {
+    out.clear();
+    if (!eat('[')) return false;
+    if (eat(']')) return true;
+    do {
+      double v;
+      if (!num(v)) return false;
+      out.push_back(v);
+    } while (eat(','));
+    return eat(']');
+  }
+};
+
+// ─── Device state ─────────────────────────────────────────
+
+struct DataSample {
+  std::map<std::string, std::vector<double>> series;  // tasks plus ram, psram, largest, time
+  double interval = 1000;
+};
+
+struct ColumnStore {
+  std::string dir;
+  uint32_t rows = 0;
+  std::map<std::string, FILE*> files;
+
+  ColumnStore() = default;
+  ColumnStore(const ColumnStore&) = delete;
+  ~ColumnStore() {
+    for (auto& f : files) fclose(f.second);
+  }
+
+  FILE* column(const std::string& name, int width) {
+    auto it = files.find(name);
+    if (it != files.end()) return it->second;
+
+    std::string path = dir + "/" + name;
+    FILE* f = fopen(path.c_str(), "ab");
+    if (!f) return nullptr;
+
+    // a column that starts late is padded so every file has the same number of rows
+    long have = ftell(f) / width;
+    static const uint8_t pad[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    for (long r = have; r < (long)rows; r++) fwrite(pad, width, 1, f);
+
+    files[name] = f;
+    return f;
+  }
+
+  void put(const std::string& name, uint32_t v, int width) {
+    FILE* f = column(name, width);
+    if (!f) return;
+    uint8_t b[4] = { (uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    fwrite(b, width, 1, f);
+  }
+
+  void open(const std::string& d) {
+    dir = d;
+    mkdir(dir.c_str(), 0755);
+    struct stat st;
+    if (stat((dir + "/t.u32").c_str(), &st) == 0) rows = st.st_size / 4;
+  }
+
+  void flush() {
+    for (auto& f : files) fflush(f.second);
+  }
+};
+
+struct Device {
+  std::string name;  // host:port
+  struct sockaddr_in addr;
+
+  // from the last good poll
+  bool ok = false;
+  double ramMin = 0, largestMin = 0, psram = 0;
+  double busy[2] = { 0, 0 };
+  double latencyMs = 0;
+  int taskCount = 0;
+  double stackMin = 0;
+  std::string busiest;
+  double busiestPct = 0;
+  std::map<std::string, double> lastUsage;
+
+  uint32_t polls = 0, errors = 0;
+  uint64_t bytes = 0;
+
+  ColumnStore store;
+};
+
+// ─── Parsing the taskman endpoints ────────────────────────
+
+static bool parseData(const std::string& body, DataSample& out) {
+  JsonReader j{ body.data(), body.data() + body.size() };
+  if (!j.eat('{')) return false;
+  if (j.eat('}')) return true;
+  do {
+    std::string key;
+    if (!j.str(key) || !j.eat(':')) return false;
+    j.ws();
+    if (j.p < j.e && *j.p == '[') {
+      std::vector<double> v;
+      const char* start = j.p;
+      if (!j.numArray(v)) {
+        j.p = start;  // not numbers, skip the whole array
+        if (!j.skip()) return false;
+        continue;
+      }
+      out.series[key] = std::move(v);
+    } else if (key == "interval") {
+      if (!j.num(out.interval)) return false;
+    } else if (!j.skip()) {
+      return false;
+    }
+  } while (j.eat(','));
+  return j.eat('}');
+}
+
+// /dataInfo - task count and the lowest stack high water mark
+static bool parseInfo(const std::string& body, int& tasks, double& stackMin) {
+  JsonReader j{ body.data(), body.data() + body.size() };
+  tasks = 0;
+  stackMin = 1e9;
+  if (!j.eat('{')) return false;
+  if (j.eat('}')) return true;
+  do {
+    std::string name;
+    if (!j.str(name) || !j.eat(':')) return false;
+    if (name[0] == '_') {  // not a task
+      if (!j.skip()) return false;
+      continue;
+    }
+    if (!j.eat('{')) return false;
+    tasks++;
+    if (j.eat('}')) continue;
+    do {
+      std::string key;
+      if (!j.str(key) || !j.eat(':')) return false;
+      double v;
+      if (key == "stackHW" && j.num(v)) {
+        stackMin = std::min(stackMin, v);
+      } else if (!j.skip()) {
+        return false;
+      }
+    } while (j.eat(','));
+    if (!j.eat('}')) return false;
+  } while (j.eat(','));
+  return j.eat('}');
+}
+
+static double lastValid(const std::vector<double>& v) {
+  for (auto it = v.rbegin(); it != v.rend(); ++it)
+    if (!std::isnan(*it)) return *it;
+  return 0;
+}
+
+static double minNonZero(const std::vector<double>& v) {
+  double m = 0;
+  for (double x : v)
+    if (!std::isnan(x) && x > 0 && (m == 0 || x < m)) m = x;
+  return m;
+}
+
+static double mean(const std::vector<double>& v) {
+  double sum = 0;
+  int n = 0;
+  for (double x : v)
+    if (!std::isnan(x)) sum += x, n++;
+  return n ? sum / n : 0;
+}
+
+static void applyData(Device& d, const DataSample& s) {
+  static const std::vector<double> empty;
+  auto get = [&](const char* k) -> const std::vector<double>& {
+    auto it = s.series.find(k);
+    return it == s.series.end() ? empty : it->second;
+  };
+
+  d.ramMin = minNonZero(get("ram"));
+  d.largestMin = minNonZero(get("largest"));
+  d.psram = lastValid(get("psram"));
+  d.busy[0] = s.series.count("IDLE0") ? 100.0 - mean(get("IDLE0")) : 0;
+  d.busy[1] = s.series.count("IDLE1") ? 100.0 - mean(get("IDLE1")) : 0;
+
+  d.lastUsage.clear();
+  d.busiest.clear();
+  d.busiestPct = 0;
+  for (auto& kv : s.series) {
+    const std::string& k = kv.first;
+    if (k == "ram" || k == "psram" || k == "largest" || k == "time") continue;
+    double u = lastValid(kv.second);
+    d.lastUsage[k] = u;
+    if (k.rfind("IDLE", 0) != 0 && u > d.busiestPct) {
+      d.busiest = k;
+      d.busiestPct = u;
+    }
+  }
+}
+
+static void storeRow(Device& d, uint32_t t) {
+  ColumnStore& c = d.store;
+  c.put("t.u32", t, 4);
+  c.put("ram.u16", std::min(65535.0, d.ramMin), 2);
+  c.put("largest.u16", std::min(65535.0, d.largestMin), 2);
+  c.put("psram.u16", std::min(65535.0, d.psram), 2);
+  c.put("busy0.u8", std::min(100.0, std::max(0.0, d.busy[0])), 1);
+  c.put("busy1.u8", std::min(100.0, std::max(0.0, d.busy[1])), 1);
+  c.put("latency.u16", std::min(65535.0, d.latencyMs), 2);
+
+  for (auto& kv : d.lastUsage) {
+    std::string col = "cpu.";
+    for (char ch : kv.first) col += (isalnum((unsigned char)ch) || ch == '_' || ch == '-') ? ch : '_';
+    col += ".u8";
+    c.put(col, std::min(254.0, kv.second * 2.0 + 0.5), 1);
+  }
+  // tasks not reported this time
+  for (auto& f : c.files) {
+    if (f.first.rfind("cpu.", 0) != 0) continue;
+    long have = ftell(f.second);
+    if (have < (long)c.rows + 1) fputc(0xFF, f.second);
+  }
+  c.rows++;
+}
+
+// ─── Non-blocking http client ─────────────────────────────
+
+enum Endpoint { EP_DATA,
+                EP_INFO };
+
+struct Conn {
+  Device* dev;
+  Endpoint ep;
+  int fd = -1;
+  bool connected = false;
+  std::string req;
+  size_t sent = 0;
+  std::string resp;
+  uint64_t startUs = 0;
+};
+
+struct Job {
+  Device* dev;
+  Endpoint ep;
+};
+
+static bool decodeHttp(const std::string& resp, std::string& body) {
+  size_t hdrEnd = resp.find("\r\n\r\n");
+  if (hdrEnd == std::string::npos) return false;
+  if (resp.compare(0, 5, "HTTP/") != 0) return false;
+  size_t sp = resp.find(' ');
+  if (sp == std::string::npos || atoi(resp.c_str() + sp + 1) != 200) return false;
+
+  std::string hdr = resp.substr(0, hdrEnd);
+  std::transform(hdr.begin(), hdr.end(), hdr.begin(), ::tolower);
+  size_t pos = hdrEnd + 4;
+
+  if (hdr.find("transfer-encoding: chunked") == std::string::npos) {
+    body = resp.substr(pos);
+    return true;
+  }
+
+  body.clear();
+  for (;;) {
+    size_t lineEnd = resp.find("\r\n", pos);
+    if (lineEnd == std::string::npos) return false;
+    size_t len = strtoul(resp.c_str() + pos, nullptr, 16);
+    pos = lineEnd + 2;
+    if (len == 0) return true;
+    if (pos + len > resp.size()) return false;
+    body.append(resp, pos, len);
+    pos += len + 2;
+  }
+}
+
+struct Poller {
+  int ep;
+  int maxInflight = 128;
+  int timeoutMs = 5000;
+  std::vector<Job> queue;
+  size_t next = 0;
+  std::map<int, std::unique_ptr<Conn>> inflight;
+  std::vector<double> latencies;
+
+  Poller() { ep = epoll_create1(0); }
+  ~Poller() { close(ep); }
+
+  void start(const Job& job) {
+    auto c = std::make_unique<Conn>();
+    c->dev = job.dev;
+    c->ep = job.ep;
+    c->startUs = nowUs();
+    c->req = std::string("GET ") + (job.ep == EP_DATA ? "/data" : "/dataInfo") + " HTTP/1.1\r\nHost: " + job.dev->name + "\r\nConnection: close\r\n\r\n";
+
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+      job.dev->errors++;
+      return;
+    }
+    int r = connect(c->fd, (struct sockaddr*)&job.dev->addr, sizeof(job.dev->addr));
+    if (r < 0 && errno != EINPROGRESS) {
+      close(c->fd);
+      job.dev->errors++;
+      return;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLIN;
+    ev.data.fd = c->fd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, c->fd, &ev);
+    inflight[c->fd] = std::move(c);
+  }
+
+  void finish(Conn* c, bool ok) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+
+    Device& d = *c->dev;
+    d.bytes += c->resp.size();
+    std::string body;
+    if (ok) ok = decodeHttp(c->resp, body);
+
+    if (ok && c->ep == EP_DATA) {
+      DataSample s;
+      ok = parseData(body, s);
+      if (ok) {
+        d.latencyMs = (nowUs() - c->startUs) / 1000.0;
+        latencies.push_back(d.latencyMs);
+        applyData(d, s);
+        d.polls++;
+      }
+    } else if (ok && c->ep == EP_INFO) {
+      ok = parseInfo(body, d.taskCount, d.stackMin);
+    }
+
+    if (!ok) d.errors++;
+    if (c->ep == EP_DATA) d.ok = ok;
+    inflight.erase(c->fd);
+  }
+
+  void onEvent(Conn* c, uint32_t events) {
+    if (!c->connected && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      if (err) return finish(c, false);
+      c->connected = true;
+    }
+
+    if (c->connected && c->sent < c->req.size() && (events & EPOLLOUT)) {
+      ssize_t n = send(c->fd, c->req.data() + c->sent, c->req.size() - c->sent, MSG_NOSIGNAL);
+      if (n < 0 && errno != EAGAIN) return finish(c, false);
+      if (n > 0) c->sent += n;
+      if (c->sent == c->req.size()) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = c->fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+      }
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP)) {
+      char buf[4096];
+      for (;;) {
+        ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+          c->resp.append(buf, n);
+          continue;
+        }
+        if (n == 0) return finish(c, true);
+        if (errno == EAGAIN) break;
+        return finish(c, false);
+      }
+    }
+  }
+
+  // Run every queued job, maxInflight at a time
+  void run() {
+    next = 0;
+    struct epoll_event events[256];
+
+    while (next < queue.size() || !inflight.empty()) {
+      while (next < queue.size() && (int)inflight.size() < maxInflight) start(queue[next++]);
+
+      int n = epoll_wait(ep, events, 256, 100);
+      for (int i = 0; i < n; i++) {
+        auto it = inflight.find(events[i].data.fd);
+        if (it != inflight.end()) onEvent(it->second.get(), events[i].events);
+      }
+
+      uint64_t now = nowUs();
+      std::vector<Conn*> late;
+      for (auto& kv : inflight)
+        if (now - kv.second->startUs > (uint64_t)timeoutMs * 1000) late.push_back(kv.second.get());
+      for (Conn* c : late) finish(c, false);
+    }
+    queue.clear();
+  }
+};
+
+// ─── Fleet view ───────────────────────────────────────────
+
+static void printFleet(std::vector<Device>& devs, int limit) {
+  std::vector<Device*> order;
+  for (auto& d : devs) order.push_back(&d);
+
+  // least heap headroom first, then the most saturated core
+  std::sort(order.begin(), order.end(), [](const Device* a, const Device* b) {
+    if (a->ok != b->ok) return !a->ok;
+    if (a->ramMin != b->ramMin) return a->ramMin < b->ramMin;
+    return std::max(a->busy[0], a->busy[1]) > std::max(b->busy[0], b->busy[1]);
+  });
+
+  printf("\n%-22s %6s %8s %8s %6s %6s %6s %7s %-16s\n", "device", "ok", "ramMin", "largest", "core0", "core1", "tasks", "ms", "busiest");
+  int shown = 0;
+  for (Device* d : order) {
+    if (limit && shown++ >= limit) break;
+    printf("%-22s %6s %7.0fK %7.0fK %5.0f%% %5.0f%% %6d %7.1f %s %.1f%%\n",
+           d->name.c_str(), d->ok ? "yes" : "NO", d->ramMin, d->largestMin, d->busy[0], d->busy[1],
+           d->taskCount, d->latencyMs, d->busiest.c_str(), d->busiestPct);
+  }
+  fflush(stdout);
+}
+
+// ─── Stand-in servers for the benchmark ───────────────────
+
+// Same layout and number formats as taskman_handleData
+static std::string emulateData(unsigned seed) {
+  srand(seed);
+  const char* names[] = { "loopTask", "IDLE1", "IDLE0", "async_tcp", "wifi", "CPU_Monitor", "FakeLoad0", "FakeLoad1", "httpd" };
+  std::string json = "{";
+  char num[32];
+  double busy[2] = { 0, 0 };
+  bool first = true;
+  for (int t = 0; t < 9; t++) {
+    if (t == 1 || t == 2) continue;  // IDLE after the others
+    if (!first) json += ",";
+    first = false;
+    json += std::string("\"") + names[t] + "\":[";
+    double level = rand() % 40;
+    for (int i = 0; i < 100; i++) {
+      double u = std::max(0.0, level + (rand() % 100) / 10.0 - 5);
+      busy[t % 2] += u;
+      snprintf(num, sizeof(num), "%.1f", u);
+      json += num;
+      if (i < 99) json += ",";
+    }
+    json += "]";
+  }
+  for (int core = 0; core < 2; core++) {
+    json += std::string(",\"IDLE") + char('0' + core) + "\":[";
+    for (int i = 0; i < 100; i++) {
+      snprintf(num, sizeof(num), "%.1f", std::max(0.0, 100.0 - busy[core] / 100));
+      json += num;
+      if (i < 99) json += ",";
+    }
+    json += "]";
+  }
+  const char* mem[] = { "ram", "psram", "largest" };
+  int base[] = { 60 + rand() % 200, 4000 - rand() % 1000, 20 + rand() % 100 };
+  for (int m = 0; m < 3; m++) {
+    json += std::string(",\"") + mem[m] + "\":[";
+    for (int i = 0; i < 100; i++) {
+      snprintf(num, sizeof(num), "%u", (unsigned)(base[m] - rand() % 5));
+      json += num;
+      if (i < 99) json += ",";
+    }
+    json += "]";
+  }
+  json += ",\"time\":[";
+  for (int i = 0; i < 100; i++) {
+    snprintf(num, sizeof(num), "%u", (unsigned)(600000 + i * 1000));
+    json += num;
+    if (i < 99) json += ",";
+  }
+  json += "],\"monitor\":{\"missedTotal\":0";
+  const char* mon[] = { "execUs", "snapshotUs", "jitterUs", "missed" };
+  for (int m = 0; m < 4; m++) {
+    json += std::string(",\"") + mon[m] + "\":[";
+    for (int i = 0; i < 100; i++) {
+      int v = m == 0 ? 300 + rand() % 100 : m == 1 ? 120 + rand() % 20 : m == 2 ? rand() % 2000 - 1000 : 0;
+      json += std::to_string(v);
+      if (i < 99) json += ",";
+    }
+    json += "]";
+  }
+  json += "},\"interval\":1000}";
+  return json;
+}
+
+static std::string emulateInfo() {
+  return "{\"loopTask\":{\"core\":1,\"prio\":1,\"stackHW\":5400,\"state\":0},"
+         "\"IDLE1\":{\"core\":1,\"prio\":0,\"stackHW\":572,\"state\":1},"
+         "\"IDLE0\":{\"core\":0,\"prio\":0,\"stackHW\":464,\"state\":1},"
+         "\"Tmr Svc\":{\"core\":2147483647,\"prio\":1,\"stackHW\":3608,\"state\":2}}";
+}
+
+// esp-idf httpd sends /data in chunks of up to 1024 bytes
+static std::string chunked(const std::string& body) {
+  std::string out = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+  char hdr[16];
+  for (size_t off = 0; off < body.size(); off += 960) {
+    size_t n = std::min((size_t)960, body.size() - off);
+    snprintf(hdr, sizeof(hdr), "%zx\r\n", n);
+    out += hdr;
+    out.append(body, off, n);
+    out += "\r\n";
+  }
+  return out + "0\r\n\r\n";
+}
+
+static std::string plain(const std::string& body) {
+  return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// Child process: n listening ports from basePort, one epoll loop
+static void emulatorMain(int n, int basePort, int readyFd) {
+  int ep = epoll_create1(0);
+  std::map<int, int> listeners;  // fd -> device index
+  std::map<int, std::string> clients;
+  std::vector<std::string> data(n);
+  std::string info = plain(emulateInfo());
+
+  for (int i = 0; i < n; i++) {
+    data[i] = chunked(emulateData(i + 1));
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(basePort + i);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr*)&a, sizeof(a)) < 0 || listen(fd, 64) < 0) {
+      perror("emulator bind");
+      _exit(1);
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    listeners[fd] = i;
+  }
+  std::map<int, int> clientDev;
+  if (write(readyFd, "R", 1) != 1) _exit(1);
+  close(readyFd);
+
+  struct epoll_event events[256];
+  for (;;) {
+    int k = epoll_wait(ep, events, 256, -1);
+    for (int e = 0; e < k; e++) {
+      int fd = events[e].data.fd;
+      auto l = listeners.find(fd);
+      if (l != listeners.end()) {
+        int c;
+        while ((c = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0) {
+          struct epoll_event ev;
+          ev.events = EPOLLIN;
+          ev.data.fd = c;
+          epoll_ctl(ep, EPOLL_CTL_ADD, c, &ev);
+          clients[c].clear();
+          clientDev[c] = l->second;
+        }
+        continue;
+      }
+
+      char buf[1024];
+      ssize_t r = recv(fd, buf, sizeof(buf), 0);
+      if (r > 0) clients[fd].append(buf, r);
+      std::string& req = clients[fd];
+      if (r <= 0 || req.find("\r\n\r\n") != std::string::npos) {
+        if (r > 0) {
+          const std::string& resp = req.compare(0, 13, "GET /dataInfo") == 0 ? info : data[clientDev[fd]];
+          // small responses, a blocking write is fine for the benchmark
+          int flags = fcntl(fd, F_GETFL);
+          fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+          if (send(fd, resp.data(), resp.size(), MSG_NOSIGNAL) < 0) {
+          }
+        }
+        epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        clients.erase(fd);
+        clientDev.erase(fd);
+      }
+    }
+  }
+}
+
+// ─── main ─────────────────────────────────────────────────
+
+static bool resolve(const std::string& spec, Device& d) {
+  std::string host = spec;
+  std::string port = "81";
+  size_t colon = spec.rfind(':');
+  if (colon != std::string::npos) {
+    host = spec.substr(0, colon);
+    port = spec.substr(colon + 1);
+  }
+
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) return false;
+  memcpy(&d.addr, res->ai_addr, sizeof(d.addr));
+  freeaddrinfo(res);
+  d.name = host + ":" + port;
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: taskman_fleet [-i seconds] [-o dir] [-c inflight] [-n show] [-f file] host[:port] ...\n"
+          "       taskman_fleet --emulate N [--rounds R] [-c inflight]\n");
+}
+
+int main(int argc, char** argv) {
+  int interval = 10;
+  int inflight = 128;
+  int show = 30;
+  int emulate = 0;
+  int rounds = 10;
+  std::string outDir = "fleet";
+  std::vector<std::string> specs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    bool more = i + 1 < argc;
+    if (a == "-i" && more) interval = atoi(argv[++i]);
+    else if (a == "-o" && more) outDir = argv[++i];
+    else if (a == "-c" && more) inflight = atoi(argv[++i]);
+    else if (a == "-n" && more) show = atoi(argv[++i]);
+    else if (a == "--emulate" && more) emulate = atoi(argv[++i]);
+    else if (a == "--rounds" && more) rounds = atoi(argv[++i]);
+    else if (a == "-f" && more) {
+      FILE* f = fopen(argv[++i], "r");
+      if (!f) {
+        perror(argv[i]);
+        return 1;
+      }
+      char line[256];
+      while (fgets(line, sizeof(line), f)) {
+        std::string s = line;
+        s.erase(s.find_last_not_of(" \r\n\t") + 1);
+        if (!s.empty() && s[0] != '#') specs.push_back(s);
+      }
+      fclose(f);
+    } else if (a[0] == '-') {
+      usage();
+      return 1;
+    } else {
+      specs.push_back(a);
+    }
+  }
+
+  // one fd per device for the stand-ins, plus the connections in flight
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  pid_t child = 0;
+  if (emulate > 0) {
+    const int basePort = 20000;
+    int pipefd[2];
+    if (pipe(pipefd) < 0) return 1;
+    child = fork();
+    if (child == 0) {
+      close(pipefd[0]);
+      emulatorMain(emulate, basePort, pipefd[1]);
+      _exit(0);
+    }
+    close(pipefd[1]);
+    char c;
+    if (read(pipefd[0], &c, 1) != 1) {
+      fprintf(stderr, "emulator failed to start\n");
+      return 1;
+    }
+    close(pipefd[0]);
+    specs.clear();
+    for (int i = 0; i < emulate; i++) specs.push_back("127.0.0.1:" + std::to_string(basePort + i));
+    outDir = "";  // benchmark only, no store
+  }
+
+  if (specs.empty()) {
+    usage();
+    return 1;
+  }
+
+  std::vector<Device> devs(specs.size());
+  for (size_t i = 0; i < specs.size(); i++) {
+    if (!resolve(specs[i], devs[i])) {
+      fprintf(stderr, "can't resolve %s\n", specs[i].c_str());
+      return 1;
+    }
+  }
+
+  if (!outDir.empty()) {
+    mkdir(outDir.c_str(), 0755);
+    for (auto& d : devs) {
+      std::string dir = d.name;
+      std::replace(dir.begin(), dir.end(), ':', '_');
+      d.store.open(outDir + "/" + dir);
+    }
+  }
+
+  Poller poller;
+  poller.maxInflight = inflight;
+  uint64_t benchUs = 0;
+
+  for (int round = 0; emulate == 0 || round < rounds; round++) {
+    uint64_t t0 = nowUs();
+    for (auto& d : devs) {
+      poller.queue.push_back({ &d, EP_DATA });
+      poller.queue.push_back({ &d, EP_INFO });
+    }
+    poller.run();
+    uint64_t t1 = nowUs();
+    benchUs += t1 - t0;
+
+    if (emulate == 0) {
+      uint32_t now = time(nullptr);
+      for (auto& d : devs) {
+        if (!d.ok) continue;
+        storeRow(d, now);
+        d.store.flush();
+      }
+      printFleet(devs, show);
+      printf("polled %zu devices in %.1f ms\n", devs.size(), (t1 - t0) / 1000.0);
+      int64_t wait = (int64_t)interval * 1000000 - (int64_t)(nowUs() - t0);
+      if (wait > 0) usleep(wait);
+    }
+  }
+
+  if (emulate > 0) {
+    uint64_t polls = 0, errors = 0, bytes = 0;
+    for (auto& d : devs) polls += d.polls, errors += d.errors, bytes += d.bytes;
+    std::vector<double>& l = poller.latencies;
+    std::sort(l.begin(), l.end());
+    double total = 0;
+    for (double x : l) total += x;
+
+    printFleet(devs, 5);
+    printf("\nbenchmark: %d devices x %d rounds, %d in flight\n", emulate, rounds, inflight);
+    printf("  /data polls ok   : %llu, errors %llu\n", (unsigned long long)polls, (unsigned long long)errors);
+    printf("  bytes received   : %llu\n", (unsigned long long)bytes);
+    printf("  wall time        : %.1f ms, %.0f requests/s\n", benchUs / 1000.0, 2.0 * emulate * rounds / (benchUs / 1e6));
+    if (!l.empty()) {
+      printf("  /data latency ms : mean %.2f  p50 %.2f  p99 %.2f  max %.2f\n",
+             total / l.size(), l[l.size() / 2], l[l.size() * 99 / 100], l.back());
+    }
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+  }
+  return 0;
+}
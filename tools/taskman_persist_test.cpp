@@ -0,0 +1,306 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - test of the flash history ring in taskman/taskman_persist.h, on a file instead of the partition
+  - torn batches, the ring wrapping, a corrupt crc, and the head, seq and boot counter found again after each
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_persist_test taskman_persist_test.cpp
+    ./taskman_persist_test [file]     # default /tmp/taskman_persist_test.bin, removed at the start
+
+  Each case prints ok or what went wrong, and the exit code is the number of failed cases.
+
+  The file backend ANDs writes into the file like NOR flash, so a record written over one
+  that wasn't erased comes out corrupt here the same way it would on the esp32.  A "reboot"
+  is a new scan of the file with a fresh TaskmanPersistLog, which is what
+  taskman_persist_begin() does.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../taskman/taskman_persist.h"
+
+static const uint32_t SIZE = 16384, SECTOR = 4096;  // 256 records, 64 per sector
+static const int BATCH = 8;
+static const uint32_t SLOTS = SIZE / sizeof(PersistRecord);
+static const char* path = "/tmp/taskman_persist_test.bin";
+
+static TaskmanFlash fileIo;
+
+// ---- a flash that loses power part way through a write ----
+static long powerLeft = -1;  // bytes before the power goes, -1 for never
+
+static bool tornWrite(uint32_t off, const void* src, size_t len) {
+  if (powerLeft < 0) return taskman_fileWrite(off, src, len);
+  size_t n = (size_t)powerLeft < len ? powerLeft : len;
+  powerLeft -= n;
+  if (n) taskman_fileWrite(off, src, n);
+  return n == len;
+}
+static TaskmanFlash tornIo;
+
+// ---- Checks ----
+static int failed = 0;
+static bool caseOk = true;
+static const char* caseName = "";
+
+static void begin(const char* name) {
+  caseName = name;
+  caseOk = true;
+}
+static void end() {
+  printf("%s %s\n", caseOk ? "ok  " : "FAIL", caseName);
+  if (!caseOk) failed++;
+}
+static void expectEq(long got, long want, const char* what) {
+  if (got == want) return;
+  if (caseOk) printf("     %s: got %ld want %ld\n", what, got, want);
+  caseOk = false;
+}
+
+// ---- helpers ----
+static TaskmanPersistLog boot(const TaskmanFlash* io = &fileIo) {
+  TaskmanPersistLog log;
+  if (!taskman_persistScan(log, io, BATCH)) {
+    printf("     scan refused the geometry\n");
+    caseOk = false;
+  }
+  return log;
+}
+
+static PersistRecord record(TaskmanPersistLog& log) {
+  PersistRecord r;
+  memset(&r, 0, sizeof(r));
+  r.magic = PERSIST_MAGIC;
+  r.seq = log.seq++;
+  r.boot = log.boot;
+  r.samples = 10;
+  r.uptimeS = r.seq * 10;
+  memcpy(r.top[0].name, "loopTask", sizeof(r.top[0].name));  // 8 characters, no nul, like the esp32 writes it
+  r.crc = taskman_crc32((const uint8_t*)&r, offsetof(PersistRecord, crc));
+  return r;
+}
+
+static void writeBatches(TaskmanPersistLog& log, int batches, int perBatch = BATCH) {
+  for (int b = 0; b < batches; b++) {
+    PersistRecord recs[BATCH];
+    for (int k = 0; k < perBatch; k++) recs[k] = record(log);
+    taskman_persistWrite(log, recs, perBatch);
+  }
+}
+
+// the valid records oldest first, the way /history reads them
+static std::vector<PersistRecord> history(const TaskmanPersistLog& log) {
+  std::vector<PersistRecord> out;
+  PersistRecord r;
+  for (uint32_t i = 0; i < log.slots; i++) {
+    if (!log.io->read(((log.head + i) % log.slots) * sizeof(r), &r, sizeof(r))) continue;
+    if (taskman_recordValid(r)) out.push_back(r);
+  }
+  return out;
+}
+
+// seq goes up by one from record to record, none lost in the middle
+static void expectRun(const std::vector<PersistRecord>& h, uint32_t first, uint32_t count, const char* what) {
+  expectEq(h.size(), count, what);
+  for (size_t i = 0; i < h.size() && i < count; i++) {
+    if (h[i].seq != first + i) {
+      expectEq(h[i].seq, first + i, what);
+      return;
+    }
+  }
+}
+
+// clear one bit of the crc, which is what flash that goes bad does
+static void corrupt(uint32_t slot) {
+  for (uint32_t off = offsetof(PersistRecord, crc); off < sizeof(PersistRecord); off++) {
+    uint8_t b;
+    taskman_fileRead(slot * sizeof(PersistRecord) + off, &b, 1);
+    if (!b) continue;
+    b &= b - 1;
+    taskman_fileWrite(slot * sizeof(PersistRecord) + off, &b, 1);
+    return;
+  }
+}
+
+static void freshFile() {
+  remove(path);
+  if (!taskman_fileFlash(fileIo, path, SIZE, SECTOR)) {
+    printf("can't open %s\n", path);
+    exit(1);
+  }
+  tornIo = fileIo;
+  tornIo.write = tornWrite;
+}
+
+// ---- cases ----
+static void testEmpty() {
+  begin("empty flash: head 0, seq 0, boot 0");
+  freshFile();
+  TaskmanPersistLog log = boot();
+  expectEq(log.head, 0, "head");
+  expectEq(log.seq, 0, "seq");
+  expectEq(log.boot, 0, "boot");
+  expectEq(history(log).size(), 0, "records");
+
+  TaskmanPersistLog bad;
+  TaskmanFlash small = fileIo;
+  small.size = SECTOR;
+  expectEq(taskman_persistScan(bad, &small, BATCH), false, "one sector accepted");
+  expectEq(taskman_persistScan(bad, &fileIo, 48), false, "batch that doesn't divide a sector accepted");
+  end();
+}
+
+static void testBoots() {
+  begin("head, seq and boot counter found again over reboots");
+  freshFile();
+  for (int b = 0; b < 5; b++) {
+    TaskmanPersistLog log = boot();
+    expectEq(log.boot, b, "boot");
+    expectEq(log.seq, b * 3 * BATCH, "seq");
+    expectEq(log.head, b * 3 * BATCH, "head");
+    writeBatches(log, 3);
+  }
+  TaskmanPersistLog log = boot();
+  std::vector<PersistRecord> h = history(log);
+  expectRun(h, 0, 5 * 3 * BATCH, "records after 5 boots");
+  expectEq(h.front().boot, 0, "first boot");
+  expectEq(h.back().boot, 4, "last boot");
+  end();
+}
+
+static void testWrap() {
+  begin("ring wraps, oldest sector erased just before it is written");
+  freshFile();
+  TaskmanPersistLog log = boot();
+  int batches = SLOTS / BATCH + 8;  // one and a quarter times round
+  writeBatches(log, batches);
+  uint32_t written = batches * BATCH;
+
+  // the head is at a sector start that hasn't been erased yet, so the ring is full
+  log = boot();
+  expectEq(log.head, written % SLOTS, "head after the wrap");
+  expectEq(log.seq, written, "seq after the wrap");
+  expectEq(log.boot, 1, "boot after the wrap");
+  expectRun(history(log), written - SLOTS, SLOTS, "full ring");
+
+  // the next batch erases a whole sector in front of it
+  writeBatches(log, 1);
+  log = boot();
+  expectRun(history(log), written + BATCH - SLOTS + SECTOR / sizeof(PersistRecord) - BATCH,
+            SLOTS - SECTOR / sizeof(PersistRecord) + BATCH, "ring after a sector erase");
+
+  // many times round, seq past where int32 compares turn over
+  log.seq = 0x7FFFFF00;
+  writeBatches(log, 3 * SLOTS / BATCH + 3);
+  uint32_t next = log.seq;
+  log = boot();
+  expectEq(log.seq, next, "seq over 2^31");
+  expectEq(history(log).back().seq, next - 1, "newest over 2^31");
+  end();
+}
+
+static void testTorn() {
+  begin("torn batches: power lost part way through a write");
+  freshFile();
+  TaskmanPersistLog log = boot();
+  writeBatches(log, 2);
+
+  // the power goes 3.5 records into the third batch
+  log = boot(&tornIo);
+  powerLeft = 3 * sizeof(PersistRecord) + 32;
+  writeBatches(log, 1);
+  powerLeft = -1;
+
+  log = boot();
+  expectEq(log.seq, 2 * BATCH + 3, "seq after the 3 records that made it");
+  expectEq(log.head, 3 * BATCH, "head skips the torn batch");
+  expectEq(log.boot, 2, "boot after the torn batch");
+  writeBatches(log, 2);
+
+  log = boot();
+  std::vector<PersistRecord> h = history(log);
+  expectRun(h, 0, 2 * BATCH + 3 + 2 * BATCH, "records around the torn batch");
+
+  // torn at the very first byte of a sector: nothing made it, the erase happens again
+  freshFile();
+  log = boot();
+  writeBatches(log, SECTOR / sizeof(PersistRecord) / BATCH);  // exactly one sector
+  log = boot(&tornIo);
+  powerLeft = 0;
+  writeBatches(log, 1);
+  powerLeft = -1;
+  log = boot();
+  expectEq(log.head, SECTOR / sizeof(PersistRecord), "head at the sector that got nothing");
+  writeBatches(log, 1);
+  log = boot();
+  expectRun(history(log), 0, SECTOR / sizeof(PersistRecord) + BATCH, "records after a torn sector start");
+
+  // torn in a batch that ends a sector, the next sector must still be erased first
+  freshFile();
+  log = boot();
+  writeBatches(log, SECTOR / sizeof(PersistRecord) / BATCH - 1);
+  log = boot(&tornIo);
+  powerLeft = sizeof(PersistRecord) * 5;
+  writeBatches(log, 1);
+  powerLeft = -1;
+  log = boot();
+  expectEq(log.head, SECTOR / sizeof(PersistRecord), "head after a torn last batch");
+  end();
+}
+
+static void testCorrupt() {
+  begin("corrupt crc: skipped on read, never written over");
+  freshFile();
+  TaskmanPersistLog log = boot();
+  writeBatches(log, 5);  // boot 0, slots 0-39
+
+  // one bad record in the middle, gone from the history and nothing else
+  corrupt(10);
+  log = boot();
+  expectEq(history(log).size(), 5 * BATCH - 1, "one corrupt record");
+  expectEq(log.seq, 5 * BATCH, "seq past a corrupt record in the middle");
+
+  // the newest record corrupt: seq and boot come from the one before, the rest of its batch
+  // is skipped
+  log.boot = 7;
+  writeBatches(log, 1);  // boot 7 in slots 40-47
+  corrupt(47);
+  log = boot();
+  expectEq(log.seq, 6 * BATCH - 1, "seq after a corrupt newest record");
+  expectEq(log.boot, 8, "boot after a corrupt newest record");
+  expectEq(log.head, 6 * BATCH, "head after a corrupt newest record");
+
+  // the whole newest batch corrupt: the newest good record is the batch before, but the
+  // corrupt one is in the way and can't be written over without an erase
+  for (int k = 0; k < BATCH; k++) corrupt(40 + k);
+  log = boot();
+  expectEq(log.seq, 5 * BATCH, "seq after a corrupt batch");
+  expectEq(log.boot, 1, "boot after a corrupt batch");
+  expectEq(log.head, 6 * BATCH, "head skips the corrupt batch");
+  writeBatches(log, 2);
+  log = boot();
+  std::vector<PersistRecord> h = history(log);
+  expectEq(h.size(), 5 * BATCH - 1 + 2 * BATCH, "records after writing past a corrupt batch");
+  expectEq(h.back().seq, 7 * BATCH - 1, "newest after writing past a corrupt batch");
+  expectEq(h.back().boot, 1, "newest boot after writing past a corrupt batch");
+  end();
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) path = argv[1];
+  testEmpty();
+  testBoots();
+  testWrap();
+  testTorn();
+  testCorrupt();
+  remove(path);
+  printf("%d failed\n", failed);
+  return failed;
+}
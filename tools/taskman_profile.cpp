@@ -0,0 +1,231 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - symbolizer for the taskman pc sampling profiler (/profile)
+  - looks every pc in the dump up in the firmware elf with addr2line, and prints the functions
+    and tasks with the most samples, and optionally folded stacks (task;function count) for
+    flamegraph.pl
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_profile taskman_profile.cpp
+
+    curl "http://192.168.1.111:81/profile?start=1"
+    ... let it run ...
+    curl http://192.168.1.111:81/profile > profile.txt
+    ./taskman_profile profile.txt build/sketch.ino.elf --folded profile.folded
+    flamegraph.pl profile.folded > profile.svg
+
+  The elf is the one the Arduino IDE leaves behind with "Export Compiled Binary", or in
+  the build folder shown with verbose compile output.
+
+  Options:
+
+    --addr2line CMD   default xtensa-esp32-elf-addr2line, riscv32-esp-elf-addr2line for C3/C6
+    --top N           functions in the report, default 30
+    --folded FILE     write folded stacks
+
+  With - for the elf the pcs aren't looked up and are reported as they are, and with - for
+  the dump it is read from stdin.  That is enough to check the counting on a pc with
+  made up samples, one line per sample or already counted:
+
+    printf '0x400d1000\tloopTask\t1\t1\n0x400d1000\tloopTask\t1\t2\n0x400d2000\tIDLE0\t0\t5\n' | ./taskman_profile - -
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+static const uint32_t PC_IN_ISR = 1;  // PROFILE_IN_ISR in taskman.h
+
+struct Sample {
+  uint32_t pc;
+  std::string task;
+  uint64_t count;
+};
+
+struct Symbol {
+  std::string function;
+  std::string where;
+};
+
+// "0x400d1234\tloopTask\t1\t532", false for comments and anything else
+static bool parseLine(char* line, Sample& s) {
+  if (line[0] == '#' || line[0] == '\n' || line[0] == 0) return false;
+  char* fields[4];
+  int n = 0;
+  for (char* p = line; n < 4; n++) {
+    fields[n] = p;
+    char* tab = strchr(p, '\t');
+    if (!tab) {
+      n++;
+      break;
+    }
+    *tab = 0;
+    p = tab + 1;
+  }
+  if (n < 4) return false;
+  fields[3][strcspn(fields[3], "\r\n")] = 0;
+  s.pc = strtoul(fields[0], nullptr, 16);
+  s.task = fields[1];
+  s.count = strtoull(fields[3], nullptr, 10);
+  return s.pc != 0;
+}
+
+// addr2line -f -C prints two lines per address: the function, then file:line
+static void symbolize(const std::string& addr2line, const char* elf, const std::vector<uint32_t>& pcs,
+                      std::map<uint32_t, Symbol>& out) {
+  const size_t batch = 200;
+  for (size_t from = 0; from < pcs.size(); from += batch) {
+    std::string cmd = addr2line + " -f -C -e '" + elf + "'";
+    size_t to = std::min(pcs.size(), from + batch);
+    char addr[16];
+    for (size_t i = from; i < to; i++) {
+      snprintf(addr, sizeof(addr), " 0x%08x", pcs[i]);
+      cmd += addr;
+    }
+
+    FILE* p = popen(cmd.c_str(), "r");
+    if (!p) {
+      perror(addr2line.c_str());
+      return;
+    }
+    char function[1024], where[1024];
+    for (size_t i = from; i < to; i++) {
+      if (!fgets(function, sizeof(function), p) || !fgets(where, sizeof(where), p)) break;
+      function[strcspn(function, "\r\n")] = 0;
+      where[strcspn(where, "\r\n")] = 0;
+      const char* slash = strrchr(where, '/');
+      out[pcs[i]] = { function, slash ? slash + 1 : where };
+    }
+    pclose(p);
+  }
+}
+
+static std::string hex(uint32_t pc) {
+  char s[16];
+  snprintf(s, sizeof(s), "0x%08x", pc);
+  return s;
+}
+
+int main(int argc, char** argv) {
+  const char* dumpPath = nullptr;
+  const char* elf = nullptr;
+  const char* foldedPath = nullptr;
+  std::string addr2line = "xtensa-esp32-elf-addr2line";
+  size_t top = 30;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--addr2line") && i + 1 < argc) addr2line = argv[++i];
+    else if (!strcmp(argv[i], "--top") && i + 1 < argc) top = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--folded") && i + 1 < argc) foldedPath = argv[++i];
+    else if (!dumpPath) dumpPath = argv[i];
+    else if (!elf) elf = argv[i];
+  }
+  if (!dumpPath || !elf) {
+    fprintf(stderr, "usage: %s profile.txt firmware.elf [--addr2line CMD] [--top N] [--folded FILE]\n", argv[0]);
+    return 1;
+  }
+
+  FILE* in = strcmp(dumpPath, "-") ? fopen(dumpPath, "r") : stdin;
+  if (!in) {
+    perror(dumpPath);
+    return 1;
+  }
+
+  // the same pc, task and core can come more than once in a hand made dump
+  std::map<std::pair<uint32_t, std::string>, uint64_t> counts;
+  std::string header;
+  uint64_t total = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), in)) {
+    if (!strncmp(line, "# taskman profile", 17)) header = line;
+    Sample s;
+    if (!parseLine(line, s)) continue;
+    counts[{ s.pc, s.task }] += s.count;
+    total += s.count;
+  }
+  if (in != stdin) fclose(in);
+  if (!total) {
+    fprintf(stderr, "no samples in %s\n", dumpPath);
+    return 1;
+  }
+
+  std::vector<uint32_t> pcs;
+  for (auto& c : counts) {
+    if (c.first.first != PC_IN_ISR) pcs.push_back(c.first.first);
+  }
+  pcs.erase(std::unique(pcs.begin(), pcs.end()), pcs.end());
+
+  std::map<uint32_t, Symbol> symbols;
+  if (strcmp(elf, "-")) symbolize(addr2line, elf, pcs, symbols);
+
+  auto functionOf = [&](uint32_t pc) -> Symbol {
+    if (pc == PC_IN_ISR) return { "(another interrupt)", "" };
+    auto it = symbols.find(pc);
+    if (it == symbols.end() || it->second.function == "??") return { hex(pc), "" };
+    return it->second;
+  };
+
+  // ---- Add up by function, by task, and by task and function for the folded stacks ----
+  struct Row {
+    uint64_t count = 0;
+    uint64_t hottest = 0;  // the pc with the most samples in it, for the file:line
+    std::string where;
+  };
+  std::map<std::string, Row> byFunction;
+  std::map<std::string, uint64_t> byTask;
+  std::map<std::string, uint64_t> folded;
+
+  for (auto& c : counts) {
+    Symbol sym = functionOf(c.first.first);
+    Row& r = byFunction[sym.function];
+    r.count += c.second;
+    if (c.second > r.hottest) {
+      r.hottest = c.second;
+      r.where = sym.where;
+    }
+    byTask[c.first.second] += c.second;
+
+    std::string frame = sym.function;
+    std::replace(frame.begin(), frame.end(), ';', ':');
+    folded[c.first.second + ";" + frame] += c.second;
+  }
+
+  if (!header.empty()) printf("%s", header.c_str());
+  printf("%llu samples\n\n", (unsigned long long)total);
+
+  std::vector<std::pair<std::string, Row>> rows(byFunction.begin(), byFunction.end());
+  std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) { return a.second.count > b.second.count; });
+  printf("%7s %9s  %-40s %s\n", "%", "samples", "function", "where");
+  for (size_t i = 0; i < rows.size() && i < top; i++) {
+    printf("%6.1f%% %9llu  %-40s %s\n", rows[i].second.count * 100.0 / total, (unsigned long long)rows[i].second.count,
+           rows[i].first.c_str(), rows[i].second.where.c_str());
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> taskRows(byTask.begin(), byTask.end());
+  std::sort(taskRows.begin(), taskRows.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+  printf("\n%7s %9s  %s\n", "%", "samples", "task");
+  for (auto& t : taskRows) {
+    printf("%6.1f%% %9llu  %s\n", t.second * 100.0 / total, (unsigned long long)t.second, t.first.c_str());
+  }
+
+  if (foldedPath) {
+    FILE* out = fopen(foldedPath, "w");
+    if (!out) {
+      perror(foldedPath);
+      return 1;
+    }
+    for (auto& f : folded) fprintf(out, "%s %llu\n", f.first.c_str(), (unsigned long long)f.second);
+    fclose(out);
+    fprintf(stderr, "folded stacks in %s\n", foldedPath);
+  }
+  return 0;
+}
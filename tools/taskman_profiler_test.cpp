@@ -0,0 +1,236 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - test of the table the pc sampling profiler counts into (taskman_profileAdd() in taskman/taskman_profiler.h)
+  - synthetic pc, task and core streams checked against exact counts, keys that collide,
+    a table that fills up, and the time per sample
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_profiler_test taskman_profiler_test.cpp
+    ./taskman_profiler_test
+
+  Each case prints ok or what went wrong, and the exit code is the number of failed cases.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "../taskman/taskman_profiler.h"
+
+static const uint32_t SLOTS = 512;  // PROFILE_SLOTS in taskman.h
+
+typedef std::tuple<uint32_t, uint8_t, uint8_t> Key;  // pc, task, core
+
+// ---- Checks ----
+static int failed = 0;
+static bool caseOk = true;
+static const char* caseName = "";
+
+static void begin(const char* name) {
+  caseName = name;
+  caseOk = true;
+}
+static void end() {
+  printf("%s %s\n", caseOk ? "ok  " : "FAIL", caseName);
+  if (!caseOk) failed++;
+}
+static void expectEq(unsigned long long got, unsigned long long want, const char* what) {
+  if (got == want) return;
+  if (caseOk) printf("     %s: got %llu want %llu\n", what, got, want);
+  caseOk = false;
+}
+
+// ---- helpers ----
+static uint32_t seed = 2463534242u;
+static uint32_t rnd() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+// what the table holds, as a map
+static std::map<Key, uint64_t> contents(const std::vector<ProfileSlot>& t) {
+  std::map<Key, uint64_t> m;
+  for (const ProfileSlot& s : t) {
+    if (!s.pc) continue;
+    Key k(s.pc, s.task, s.core);
+    if (m.count(k)) {
+      printf("     key in two slots: 0x%08x %u %u\n", (unsigned)s.pc, s.task, s.core);
+      caseOk = false;
+    }
+    m[k] += s.count;
+  }
+  return m;
+}
+
+// where a key starts probing
+static uint32_t home(uint32_t pc, uint8_t task, uint8_t core) {
+  return ((pc >> 1) * 2654435761u ^ task ^ (core << 8)) % SLOTS;
+}
+
+// a code address like the esp32's, 2 byte aligned in flash
+static uint32_t codePc(uint32_t i) {
+  return 0x400d0000 + (i * 2);
+}
+
+// ---- cases ----
+static void testStream() {
+  begin("a synthetic stream counted exactly");
+  std::vector<ProfileSlot> table(SLOTS);
+  memset(table.data(), 0, SLOTS * sizeof(ProfileSlot));
+  std::map<Key, uint64_t> want;
+
+  // 300 hot spots in 12 tasks on 2 cores, a few much hotter than the rest, some samples
+  // in another interrupt and some in a task taskman doesn't know
+  std::vector<Key> keys;
+  for (int i = 0; i < 300; i++) {
+    uint32_t pc = i == 0 ? PROFILE_IN_ISR : codePc(rnd() % 200000);
+    keys.push_back(Key(pc, i % 13 == 12 ? 255 : i % 12, i % 2));
+  }
+  uint64_t overflow = 0;
+  const int samples = 1000000;
+  for (int n = 0; n < samples; n++) {
+    uint32_t r = rnd();
+    const Key& k = keys[(r & 0xFF) < 128 ? r % 8 : r % keys.size()];
+    if (taskman_profileAdd(table.data(), SLOTS, std::get<0>(k), std::get<1>(k), std::get<2>(k))) want[k]++;
+    else overflow++;
+  }
+  expectEq(overflow, 0, "samples that didn't fit");
+  std::map<Key, uint64_t> got = contents(table);
+  expectEq(got.size(), want.size(), "distinct keys");
+  uint64_t total = 0;
+  for (auto& kv : got) total += kv.second;
+  expectEq(total, samples, "samples in the table");
+  if (got != want) {
+    printf("     counts differ from the reference\n");
+    caseOk = false;
+  }
+  end();
+}
+
+static void testCollisions() {
+  begin("keys on the same home slot, probing over the end of the table");
+  std::vector<ProfileSlot> table(SLOTS);
+  memset(table.data(), 0, SLOTS * sizeof(ProfileSlot));
+
+  // 20 keys that all start probing 3 slots from the end, so the probes wrap to slot 0
+  std::vector<Key> keys;
+  for (uint32_t i = 0; keys.size() < 20; i++) {
+    uint32_t pc = codePc(i);
+    uint8_t task = i % 7, core = i % 2;
+    if (home(pc, task, core) == SLOTS - 3) keys.push_back(Key(pc, task, core));
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool ok = taskman_profileAdd(table.data(), SLOTS, std::get<0>(keys[i]), std::get<1>(keys[i]), std::get<2>(keys[i]));
+    expectEq(ok, i < 16, i < 16 ? "key inside the probe window" : "key past the probe window");
+  }
+  // the 16 that fit keep counting, the others keep failing
+  for (int round = 0; round < 5; round++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      bool ok = taskman_profileAdd(table.data(), SLOTS, std::get<0>(keys[i]), std::get<1>(keys[i]), std::get<2>(keys[i]));
+      expectEq(ok, i < 16, "second time round");
+    }
+  }
+  std::map<Key, uint64_t> got = contents(table);
+  expectEq(got.size(), 16, "keys held");
+  for (size_t i = 0; i < 16; i++) expectEq(got[keys[i]], 6, "count of a colliding key");
+  expectEq(table[SLOTS - 3].pc, std::get<0>(keys[0]), "first key at its home slot");
+  expectEq(table[12].pc, std::get<0>(keys[15]), "16th key wrapped to slot 12");
+
+  // the same pc from another task or core is another key
+  ProfileSlot one[SLOTS] = {};
+  taskman_profileAdd(one, SLOTS, codePc(5), 1, 0);
+  taskman_profileAdd(one, SLOTS, codePc(5), 2, 0);
+  taskman_profileAdd(one, SLOTS, codePc(5), 1, 1);
+  taskman_profileAdd(one, SLOTS, codePc(5), 1, 0);
+  std::vector<ProfileSlot> v(one, one + SLOTS);
+  got = contents(v);
+  expectEq(got.size(), 3, "pc split by task and core");
+  expectEq(got[Key(codePc(5), 1, 0)], 2, "count by task and core");
+
+  // pc 0 marks an empty slot and is refused
+  expectEq(taskman_profileAdd(one, SLOTS, 0, 0, 0), false, "pc 0 counted");
+  end();
+}
+
+static void testOverflow() {
+  begin("table overflow: refused samples, nothing counted lost");
+  std::vector<ProfileSlot> table(SLOTS);
+  memset(table.data(), 0, SLOTS * sizeof(ProfileSlot));
+  std::map<Key, uint64_t> want;
+  uint64_t refused = 0, firstRefusalAt = 0;
+
+  // 3 times as many distinct keys as slots, each seen a few times
+  for (int n = 0; n < 3 * (int)SLOTS; n++) {
+    Key k(codePc(rnd() % 1000000), rnd() % 25, rnd() % 2);
+    for (int rep = 0; rep < 3; rep++) {
+      if (taskman_profileAdd(table.data(), SLOTS, std::get<0>(k), std::get<1>(k), std::get<2>(k))) {
+        want[k]++;
+      } else {
+        if (!refused) firstRefusalAt = want.size();
+        refused++;
+      }
+    }
+  }
+  std::map<Key, uint64_t> got = contents(table);
+  if (got != want) {
+    printf("     counts differ from the reference after overflow\n");
+    caseOk = false;
+  }
+  expectEq(got.size() <= SLOTS, true, "more keys than slots");
+  uint64_t total = 0;
+  for (auto& kv : got) total += kv.second;
+  expectEq(total + refused, 3ull * 3 * SLOTS, "counted + refused = fed");
+  printf("     first sample refused with %llu of %u slots used (%.0f%%), %zu used at the end\n",
+         (unsigned long long)firstRefusalAt, SLOTS, firstRefusalAt * 100.0 / SLOTS, got.size());
+  // a 16 slot probe window should fill most of the table before it refuses anything
+  expectEq(firstRefusalAt >= SLOTS / 2, true, "refused before half full");
+  end();
+}
+
+static void testSpeed() {
+  begin("time per sample, 10M samples over 250 keys");
+  std::vector<ProfileSlot> table(SLOTS);
+  memset(table.data(), 0, SLOTS * sizeof(ProfileSlot));
+  std::vector<Key> keys;
+  for (int i = 0; i < 250; i++) keys.push_back(Key(codePc(rnd() % 500000), i % 20, i % 2));
+  std::vector<uint16_t> order(1 << 20);
+  for (auto& o : order) {
+    uint32_t r = rnd();
+    o = (r & 0xFF) < 160 ? r % 16 : r % keys.size();
+  }
+
+  const long samples = 10000000;
+  uint64_t counted = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long n = 0; n < samples; n++) {
+    const Key& k = keys[order[n & (order.size() - 1)]];
+    counted += taskman_profileAdd(table.data(), SLOTS, std::get<0>(k), std::get<1>(k), std::get<2>(k));
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / samples;
+  printf("     %.1f ns per sample\n", ns);
+  expectEq(counted, samples, "samples counted");
+  if (ns > 200) {
+    printf("     over 200 ns per sample\n");
+    caseOk = false;
+  }
+  end();
+}
+
+int main() {
+  testStream();
+  testCollisions();
+  testOverflow();
+  testSpeed();
+  printf("%d failed\n", failed);
+  return failed;
+}
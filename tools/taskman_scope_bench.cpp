@@ -0,0 +1,215 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - benchmark and test of TASKMAN_SCOPE (TaskmanScope in taskman/taskman_regions.h) on linux
+  - the cycle counter and core id are stubs: a scripted counter to check the sums, then
+    steady_clock nanoseconds to time the scope on one "core" and on two racing for the same region
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_scope_bench taskman_scope_bench.cpp
+    ./taskman_scope_bench [calls]     # default 10000000 per thread
+
+  Each case prints ok or what went wrong, and the exit code is the number of failed cases.
+  The times are for the pc, with a clock read that costs far more than the esp32 cycle
+  counter - they catch a scope that got slower, not what it costs on the chip.  On the
+  chip, "_regions" overheadCycles in /dataInfo is the same taskman_scopeOverhead().
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+
+// ---- the stubs ----
+static bool scripted = true;
+static uint32_t scriptStep = 0;        // each read of the scripted counter moves it on by this
+static uint32_t scriptCycles = 0;
+static thread_local int hostCore = 0;  // each thread is a core
+
+static inline uint32_t hostCycles() {
+  if (scripted) return scriptCycles += scriptStep;
+  return (uint32_t)std::chrono::steady_clock::now().time_since_epoch().count();  // ns, a 1GHz counter
+}
+
+#define TASKMAN_CYCLES() hostCycles()
+#define TASKMAN_CORE_ID() hostCore
+#include "../taskman/taskman_regions.h"
+
+// ---- Checks ----
+static int failed = 0;
+static bool caseOk = true;
+static const char* caseName = "";
+
+static void begin(const char* name) {
+  caseName = name;
+  caseOk = true;
+}
+static void end() {
+  printf("%s %s\n", caseOk ? "ok  " : "FAIL", caseName);
+  if (!caseOk) failed++;
+}
+static void expectEq(unsigned long long got, unsigned long long want, const char* what) {
+  if (got == want) return;
+  if (caseOk) printf("     %s: got %llu want %llu\n", what, got, want);
+  caseOk = false;
+}
+
+// one call that takes d cycles on the scripted counter, ending on core endCore
+static void call(TaskmanRegionCounters* r, uint32_t d, int endCore = -1) {
+  TaskmanScope s(r);
+  scriptCycles += d;
+  if (endCore >= 0) hostCore = endCore;
+}
+
+static unsigned long long histTotal(const TaskmanRegionCounters& r) {
+  unsigned long long n = 0;
+  for (int b = 0; b < REGION_BUCKETS; b++) n += r.hist[b];
+  return n;
+}
+
+// ---- cases ----
+static void testSums() {
+  begin("calls, cycles, buckets and max from a scripted counter");
+  scripted = true;
+  scriptStep = 0;
+  TaskmanRegionCounters r = {};
+  hostCore = 0;
+  call(&r, 1000);
+  call(&r, 3000);
+  hostCore = 1;
+  call(&r, 70000);
+  expectEq(r.calls[0], 2, "calls core 0");
+  expectEq(r.calls[1], 1, "calls core 1");
+  expectEq(r.cycles[0], 4000, "cycles core 0");
+  expectEq(r.cycles[1], 70000, "cycles core 1");
+  expectEq(r.hist[9], 1, "1000 in 512-1023");
+  expectEq(r.hist[11], 1, "3000 in 2048-4095");
+  expectEq(r.hist[16], 1, "70000 in 65536-131071");
+  expectEq(r.maxCycles, 70000, "max");
+
+  // a zero length call goes in the first bucket
+  hostCore = 0;
+  call(&r, 0);
+  expectEq(r.hist[0], 1, "0 cycles in bucket 0");
+
+  // the counter wraps inside the call
+  scriptCycles = 0xFFFFFF00;
+  call(&r, 0x300);
+  expectEq(r.cycles[0], 4000 + 0x300, "cycles across the counter wrap");
+  expectEq(r.hist[9], 2, "0x300 in 512-1023");
+  end();
+}
+
+static void testDropped() {
+  begin("a call that ends on the other core is dropped, a null region is ignored");
+  scripted = true;
+  scriptStep = 0;
+  TaskmanRegionCounters r = {};
+  hostCore = 0;
+  call(&r, 500, 1);
+  expectEq(r.calls[0] + r.calls[1], 0, "calls after a core change");
+  expectEq(histTotal(r), 0, "histogram after a core change");
+  call(nullptr, 500);  // all MAX_REGIONS taken
+  end();
+}
+
+static void testQuantiles() {
+  begin("p50 and p99 are the top of their power of two bucket");
+  scripted = true;
+  scriptStep = 0;
+  hostCore = 0;
+  TaskmanRegionCounters r = {};
+  expectEq(taskman_regionQuantile(r, 0.5f), 0, "no calls");
+  for (int i = 0; i < 98; i++) call(&r, 100);
+  call(&r, 5000);
+  call(&r, 100000);
+  expectEq(taskman_regionQuantile(r, 0.5f), 127, "p50");
+  expectEq(taskman_regionQuantile(r, 0.99f), 131071, "p99");
+  expectEq(taskman_regionQuantile(r, 0.0f), 127, "p0");
+
+  call(&r, 0x80000000);
+  expectEq(taskman_regionQuantile(r, 1.0f), 0xFFFFFFFF, "the top bucket");
+  end();
+}
+
+static void testOverhead() {
+  begin("taskman_scopeOverhead counts the two reads of one scope");
+  scripted = true;
+  scriptStep = 7;  // every read of the counter 7 cycles later
+  hostCore = 0;
+  TaskmanRegionCounters bench = {};
+  // the loop reads the counter 2 times per scope, plus once either side of the loop
+  expectEq(taskman_scopeOverhead(bench), 2 * 7, "cycles per scope");
+  expectEq(bench.calls[0], 5 * 200, "scopes run");
+  scriptStep = 0;
+  end();
+}
+
+// ---- timing on the pc ----
+static double nsPerScope(TaskmanRegionCounters* r, long calls, int core) {
+  hostCore = core;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < calls; i++) {
+    TaskmanScope s(r);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / calls;
+}
+
+static void testSpeed(long calls) {
+  begin("scope cost, one core and two cores on one region");
+  scripted = false;
+
+  // the clock read on its own, to take it off
+  auto t0 = std::chrono::steady_clock::now();
+  volatile uint32_t sink = 0;
+  for (long i = 0; i < calls; i++) sink = sink + hostCycles();
+  double clockNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / calls;
+
+  TaskmanRegionCounters one = {};
+  double single = nsPerScope(&one, calls, 0);
+  expectEq(one.calls[0], calls, "calls, one core");
+  expectEq(histTotal(one), calls, "histogram, one core");
+
+  // two threads as core 0 and core 1 on the same region, the atomics fight over the cache line
+  TaskmanRegionCounters two = {};
+  double perThread[2];
+  std::thread a([&] { perThread[0] = nsPerScope(&two, calls, 0); });
+  std::thread b([&] { perThread[1] = nsPerScope(&two, calls, 1); });
+  a.join();
+  b.join();
+  expectEq(two.calls[0], calls, "calls, core 0 racing");
+  expectEq(two.calls[1], calls, "calls, core 1 racing");
+  expectEq(histTotal(two), 2ull * calls, "histogram, two cores racing");
+
+  TaskmanRegionCounters bench = {};
+  uint32_t overhead = taskman_scopeOverhead(bench);
+
+  printf("     clock read %.1f ns, scope %.1f ns (%.1f ns without the 2 clock reads), "
+         "two cores racing %.1f / %.1f ns, taskman_scopeOverhead %u ns\n",
+         clockNs, single, single - 2 * clockNs, perThread[0], perThread[1], overhead);
+
+  // the bookkeeping past the clock reads is a few atomic adds - generous limits, a pc under load is slow
+  if (single - 2 * clockNs > 100) {
+    printf("     scope bookkeeping over 100 ns\n");
+    caseOk = false;
+  }
+  if (perThread[0] > 1000 || perThread[1] > 1000) {
+    printf("     two cores racing over 1 us a scope\n");
+    caseOk = false;
+  }
+  end();
+}
+
+int main(int argc, char** argv) {
+  long calls = argc > 1 ? atol(argv[1]) : 10000000;
+  testSums();
+  testDropped();
+  testQuantiles();
+  testOverhead();
+  testSpeed(calls);
+  printf("%d failed\n", failed);
+  return failed;
+}
@@ -0,0 +1,188 @@
+/*
+  ESP32 Task Manager -- https://github.com/jameszah/ESP32-Task-Manager
+  - reference receiver for the taskman udp export (#define TASKMAN_UDP_EXPORT 1)
+  - listens on a udp port and writes every sample from every device to a csv file
+
+  https://github.com/jameszah/ESP32-Task-Manager is licensed under the GNU General Public License v3.0
+
+  Build and run on linux:
+
+    g++ -O2 -std=c++17 -o taskman_udp_receiver taskman_udp_receiver.cpp
+    ./taskman_udp_receiver 5005 taskman.csv
+
+  and on the esp32, after wifi is up:
+
+    taskman_udp_export_start("192.168.1.50", 5005);
+
+  One csv row per device, period and series:
+
+    recv_ms,device,seq,uptime_ms,interval_ms,series,value
+
+  series are the task names (cpu % of its core), and ram, psram, largest (KB),
+  http_hits and sessions.  Gaps in seq per device are reported on stderr.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// same layout as UdpExport in taskman.h
+static const uint32_t UDP_MAGIC = 0x31554D54;  // "TMU1"
+static const size_t UDP_HEADER_BYTES = 16;
+static const size_t UDP_PERIOD_BYTES = 14;
+
+struct Reader {
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok = true;
+
+  bool need(size_t n) {
+    if ((size_t)(end - p) < n) ok = false;
+    return ok;
+  }
+  uint8_t u8() {
+    if (!need(1)) return 0;
+    return *p++;
+  }
+  uint16_t u16() {
+    if (!need(2)) return 0;
+    uint16_t v = p[0] | (p[1] << 8);
+    p += 2;
+    return v;
+  }
+  uint32_t u32() {
+    uint32_t lo = u16();
+    return lo | ((uint32_t)u16() << 16);
+  }
+};
+
+static uint64_t nowMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// csv field, quoted if the task name has a comma or quote in it
+static std::string csvField(const std::string& s) {
+  if (s.find_first_of(",\"\n") == std::string::npos) return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"') out += '"';
+    out += c;
+  }
+  return out + "\"";
+}
+
+// Parse one datagram and append its rows, false if it isn't a taskman packet
+static bool handlePacket(const uint8_t* buf, size_t len, FILE* out, std::map<uint32_t, uint32_t>& lastSeq) {
+  if (len < UDP_HEADER_BYTES) return false;
+  Reader r{ buf, buf + len };
+
+  if (r.u32() != UDP_MAGIC) return false;
+  uint32_t device = r.u32();
+  uint32_t seq = r.u32();
+  uint16_t intervalMs = r.u16();
+  int periods = r.u8();
+  int taskCount = r.u8();
+
+  std::vector<std::string> names;
+  for (int i = 0; i < taskCount && r.ok; i++) {
+    int n = r.u8();
+    if (!r.need(n)) break;
+    names.emplace_back((const char*)r.p, n);
+    r.p += n;
+  }
+  if (!r.ok || !r.need(periods * (UDP_PERIOD_BYTES + 2 * taskCount))) return false;
+
+  auto it = lastSeq.find(device);
+  if (it != lastSeq.end() && seq != it->second + 1) {
+    fprintf(stderr, "device %08x: seq %u after %u, %d batches lost or reordered\n",
+            device, seq, it->second, (int)(seq - it->second - 1));
+  }
+  lastSeq[device] = seq;
+
+  uint64_t recv = nowMs();
+  char prefix[96];
+
+  for (int k = 0; k < periods; k++) {
+    uint32_t uptime = r.u32();
+    uint16_t ram = r.u16();
+    uint16_t psram = r.u16();
+    uint16_t largest = r.u16();
+    uint16_t hits = r.u16();
+    uint8_t sessions = r.u8();
+    r.u8();  // reserved
+
+    snprintf(prefix, sizeof(prefix), "%llu,%08x,%u,%u,%u", (unsigned long long)recv, device, seq, uptime, intervalMs);
+    fprintf(out, "%s,ram,%u\n", prefix, ram);
+    fprintf(out, "%s,psram,%u\n", prefix, psram);
+    fprintf(out, "%s,largest,%u\n", prefix, largest);
+    fprintf(out, "%s,http_hits,%u\n", prefix, hits);
+    fprintf(out, "%s,sessions,%u\n", prefix, sessions);
+
+    for (int i = 0; i < taskCount; i++) {
+      uint16_t tenths = r.u16();
+      fprintf(out, "%s,%s,%.1f\n", prefix, csvField(names[i]).c_str(), tenths / 10.0);
+    }
+  }
+  fflush(out);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int port = argc > 1 ? atoi(argv[1]) : 5005;
+  const char* path = argc > 2 ? argv[2] : "taskman.csv";
+
+  int sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    return 1;
+  }
+
+  FILE* out = fopen(path, "a");
+  if (!out) {
+    perror(path);
+    return 1;
+  }
+  if (ftell(out) == 0) fprintf(out, "recv_ms,device,seq,uptime_ms,interval_ms,series,value\n");
+
+  fprintf(stderr, "taskman udp receiver on port %d, writing %s\n", port, path);
+
+  std::map<uint32_t, uint32_t> lastSeq;
+  uint8_t buf[2048];
+
+  for (;;) {
+    struct sockaddr_in from;
+    socklen_t fromLen = sizeof(from);
+    ssize_t n = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromLen);
+    if (n < 0) {
+      perror("recvfrom");
+      continue;
+    }
+    if (!handlePacket(buf, n, out, lastSeq)) {
+      char ip[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+      fprintf(stderr, "ignored %zd byte packet from %s\n", n, ip);
+    }
+  }
+}